@@ -24,7 +24,7 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), half_head_(HALF_SYNCED) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -227,6 +227,22 @@ class Blob {
   Dtype* mutable_cpu_diff();
   Dtype* mutable_gpu_diff();
   void Update();
+  /**
+   * @brief Keeps the data in IEEE half precision on CPU, freeing the float
+   *        data.
+   *
+   * Layers that can read or write half precision blobs (see
+   * Layer::AcceptsHalfBottom) use cpu_half_data and mutable_cpu_half_data,
+   * converting inside their kernels. All other accessors of the data still
+   * work: they convert the data to float on demand, allocating the float
+   * data again, and the conversion back to half happens on the next half
+   * precision access.
+   */
+  void StoreDataInHalf();
+  /// @brief Whether StoreDataInHalf was called.
+  inline bool data_in_half() const { return half_data_.get() != NULL; }
+  const uint16_t* cpu_half_data() const;
+  uint16_t* mutable_cpu_half_data();
   void FromProto(const BlobProto& proto, bool reshape = true);
   void ToProto(BlobProto* proto, bool write_diff = false) const;
 
@@ -253,6 +269,15 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareData(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to the SyncedMemory data, which
+   *        must hold at least count() elements. Later reshapes keep using it
+   *        as long as they fit.
+   *
+   * This lets the Net memory planner place blobs whose lifetimes do not
+   * overlap in the same memory.
+   */
+  void ShareDataMemory(const shared_ptr<SyncedMemory>& data);
   /**
    * @brief Set the diff_ shared_ptr to point to the SyncedMemory holding the
    *        diff_ of Blob other -- useful in Layer%s which simply perform a copy
@@ -262,6 +287,18 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the diff_ shared_ptr to point to the SyncedMemory diff, which
+   *        must hold at least count() elements. Call it after
+   *        ShareDataMemory, which resets the diff.
+   */
+  void ShareDiffMemory(const shared_ptr<SyncedMemory>& diff);
+  /**
+   * @brief Set the half precision data to the SyncedMemory half_data, which
+   *        must hold at least count() half precision values. The blob must be
+   *        stored in half precision.
+   */
+  void ShareHalfMemory(const shared_ptr<SyncedMemory>& half_data);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -272,6 +309,18 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  /// @brief The data in half precision, if stored so.
+  shared_ptr<SyncedMemory> half_data_;
+  /// @brief Which of data_ and half_data_ holds the latest data.
+  enum HalfHead { HALF_NEWER, DATA_NEWER, HALF_SYNCED };
+  mutable HalfHead half_head_;
+
+ private:
+  /// @brief Converts the data of a half precision blob to float if the half
+  ///        data is newer.
+  void SyncHalfToData() const;
+  /// @brief The reverse of SyncHalfToData.
+  void SyncDataToHalf() const;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
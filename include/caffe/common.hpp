@@ -161,8 +161,16 @@ class Caffe {
   // Parallel training info
   inline static int solver_count() { return Get().solver_count_; }
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
+  // The rank of the solver whose net is being set up, from 0 for the root to
+  // solver_count() - 1, for layers that split the data between solvers.
+  inline static int solver_rank() { return Get().solver_rank_; }
+  inline static void set_solver_rank(int val) { Get().solver_rank_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // The number of threads the CPU layers run OpenMP loops with. Like the
+  // mode, it is set per thread and passed on to internal threads.
+  inline static int cpu_threads() { return Get().cpu_threads_; }
+  static void set_cpu_threads(const int threads);
 
  protected:
 #ifndef CPU_ONLY
@@ -173,7 +181,9 @@ class Caffe {
 
   Brew mode_;
   int solver_count_;
+  int solver_rank_;
   bool root_solver_;
+  int cpu_threads_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
@@ -19,6 +19,17 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ *
+ * If data_param.reader_threads > 1, the body spawns that many reader threads,
+ * each with its own cursor over a range of consecutive keys (or, with
+ * shuffle_keys, over an interleaved shard of the permuted keys). Records are
+ * read and parsed concurrently and only the final push to each solver queue
+ * is ordered, so the round-robin distribution stays deterministic.
+ *
+ * The read order can be randomized without reconverting the source:
+ * data_param.shuffle_keys visits the keys in a new permutation every epoch
+ * through random seeks, and data_param.shuffle_buffer draws records at random
+ * from an in-memory buffer.
  */
 template <typename T>
 class DataReader {
@@ -56,6 +67,11 @@ class DataReader {
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
 
+    // Orders the pushes of concurrent reader threads to each queue pair.
+    class Sequencer;
+    void read_shard(int reader_id, db::Cursor* cursor,
+        const vector<size_t>& shard_sizes, Sequencer* sequencer);
+
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
 
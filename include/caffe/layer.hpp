@@ -297,6 +297,48 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Returns true if the layer may make its top blobs share the data
+   *        memory of bottom[0] instead of computing them, as Split and Flatten
+   *        do. The Net memory planner keeps such bottoms alive with the tops.
+   */
+  virtual inline bool TopSharesBottomData() const { return false; }
+  /**
+   * @brief Returns true if the tops also share the diff memory of bottom[0],
+   *        as Flatten and Reshape do, but Split does not.
+   */
+  virtual inline bool TopSharesBottomDiff() const {
+    return TopSharesBottomData();
+  }
+  /**
+   * @brief Returns false if running Forward again may give different tops or
+   *        changes the layer, as the random mask of Dropout or the running
+   *        statistics of BatchNorm do. Such layers cannot be recomputed, and
+   *        CPUSync workers keep their own copies of their params.
+   */
+  virtual inline bool ForwardIsRepeatable() const { return true; }
+  /**
+   * @brief Returns true if Forward_cpu reads bottom[bottom_index] in half
+   *        precision when it is stored so (see Blob::StoreDataInHalf),
+   *        converting inside its kernels rather than through the float data.
+   *        Net::StoreActivationsInHalf only stores the blobs in half that all
+   *        their layers accept so.
+   */
+  virtual inline bool AcceptsHalfBottom(const int bottom_index) const {
+    return false;
+  }
+  /// @brief Likewise, whether Forward_cpu writes top[top_index] in half
+  ///        precision when it is stored so.
+  virtual inline bool AcceptsHalfTop(const int top_index) const {
+    return false;
+  }
+  /// @brief Likewise, whether Forward_cpu reads the param
+  ///        blobs()[param_index] in half precision, for
+  ///        Net::StoreParamsInHalf.
+  virtual inline bool AcceptsHalfParam(const int param_index) const {
+    return false;
+  }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -1,6 +1,10 @@
 #ifndef CAFFE_ANNOTATED_R_DATA_LAYER_HPP_
 #define CAFFE_ANNOTATED_R_DATA_LAYER_HPP_
 
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+
 #include <string>
 #include <vector>
 
@@ -12,6 +16,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/rbox_data_cache.hpp"
 
 namespace caffe {
 
@@ -30,8 +35,20 @@ class AnnotatedRDataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
-
-  DataReader<AnnotatedDatumR> reader_;
+  void CacheDataLayerSetUp(const vector<Blob<Dtype>*>& top);
+  // Returns the next cached record, reshuffling at the end of each epoch.
+  int NextCachedRecord();
+#ifdef USE_OPENCV
+  // Wraps the decoded image of a cached record without copying it.
+  cv::Mat CachedImage(int i) const;
+#endif  // USE_OPENCV
+
+  // Exactly one of reader_ and cache_ is set, depending on cache_decoded.
+  shared_ptr<DataReader<AnnotatedDatumR> > reader_;
+  shared_ptr<RBoxDataCache> cache_;
+  vector<int> cache_order_;
+  int cache_pos_;
+  shared_ptr<Caffe::RNG> cache_rng_;
   bool has_anno_type_;
   AnnotatedDatumR_AnnotationType anno_type_;
   vector<BatchSampler> batch_samplers_;
@@ -18,7 +18,7 @@ template <typename Dtype>
 class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), fused_relu_(false), relu_negative_slope_(0) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -28,6 +28,20 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
 
+  /**
+   * @brief Folds a per output channel affine transform
+   *        @f$ y_k = scale_k x_k + shift_k @f$ of the output into the weights
+   *        and bias, adding a bias blob if the layer has none. Used to fold
+   *        BatchNorm and Scale layers into the convolution for inference.
+   */
+  virtual void FoldChannelAffine(const vector<Dtype>& scale,
+      const vector<Dtype>& shift);
+  /// @brief Applies a ReLU with the given negative_slope to the output.
+  void FuseReLU(Dtype negative_slope) {
+    fused_relu_ = true;
+    relu_negative_slope_ = negative_slope;
+  }
+
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
@@ -35,11 +49,22 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
+  // Convolves all num_ images of input and adds bias if not NULL, spreading
+  // the images over parallel_images_ threads.
+  void forward_cpu_gemm_images(const Dtype* input, const Dtype* weights,
+      Dtype* output, const Dtype* bias);
+  // Convolves all images of bottom into top with blobs_[0] and the bias, if
+  // any, and applies the fused ReLU. Blobs stored in half precision are
+  // converted through float buffers of one image per parallel chunk, and
+  // half precision weights while the GEMM packs them.
+  void forward_cpu_images(const Blob<Dtype>& bottom, Blob<Dtype>* top);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Applies the fused ReLU, if any, to count outputs in place.
+  void forward_cpu_relu(Dtype* output, const int count);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -50,6 +75,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_gpu_gemm(const Dtype* col_input, const Dtype* output, Dtype*
       weights);
   void backward_gpu_bias(Dtype* bias, const Dtype* input);
+  void forward_gpu_relu(Dtype* output, const int count);
 #endif
 
   /// @brief The spatial dimensions of the input.
@@ -92,8 +118,16 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  int cpu_parallel_images_;
+  int parallel_images_;
+  bool fused_relu_;
+  Dtype relu_negative_slope_;
 
  private:
+  void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
+      Dtype* output, Dtype* col_buff, bool skip_im2col);
+  void forward_cpu_half_gemm(const Dtype* input, const uint16_t* weights,
+      Dtype* output, Dtype* col_buff);
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
   inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -166,6 +200,11 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int output_offset_;
 
   Blob<Dtype> col_buffer_;
+  // One column buffer per concurrent image when parallel_images_ > 1.
+  Blob<Dtype> col_buffers_;
+  // The float bottom and top images of every parallel chunk, for the blobs
+  // stored in half precision.
+  Blob<Dtype> half_buffers_;
   Blob<Dtype> bias_multiplier_;
 };
 
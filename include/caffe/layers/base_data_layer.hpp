@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYERS_HPP_
 #define CAFFE_DATA_LAYERS_HPP_
 
+#include <boost/thread.hpp>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -51,6 +52,27 @@ class Batch {
   Blob<Dtype> data_, label_;
 };
 
+/**
+ * @brief Counters of a prefetching data layer since they were last reset.
+ *
+ * Times are in milliseconds. batches counts the batches taken by Forward
+ * and loaded those produced by the prefetch thread. full_queue_sum / batches
+ * is the mean number of loaded batches waiting when Forward asked for one;
+ * near zero means the net is starved by the data pipeline.
+ */
+struct PrefetchStats {
+  PrefetchStats()
+      : batches(0), loaded(0), full_queue_sum(0), wait_time(0), load_time(0),
+        read_time(0), transform_time(0) {}
+  int batches;
+  int loaded;
+  int full_queue_sum;
+  double wait_time;
+  double load_time;
+  double read_time;
+  double transform_time;
+};
+
 template <typename Dtype>
 class BasePrefetchingDataLayer :
     public BaseDataLayer<Dtype>, public InternalThread {
@@ -67,16 +89,24 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
+  // Returns the counters accumulated since the last reset.
+  PrefetchStats prefetch_stats(bool reset);
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Pops the next loaded batch, counting how long Forward waited for it.
+  Batch<Dtype>* PopFullBatch();
+  // Called by load_batch with the read and transform time of a batch in
+  // microseconds.
+  void AddLoadTime(double read_time, double transform_time);
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
+  // Prefetches data_param.prefetch batches (asynchronously if to GPU memory)
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  PrefetchStats stats_;
+  boost::mutex stats_mutex_;
 
   Blob<Dtype> transformed_data_;
 };
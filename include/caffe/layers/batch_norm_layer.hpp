@@ -49,6 +49,7 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "BatchNorm"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool ForwardIsRepeatable() const { return use_global_stats_; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -65,6 +65,16 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       : BaseConvolutionLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "Convolution"; }
+  virtual inline bool AcceptsHalfBottom(const int bottom_index) const {
+    return true;
+  }
+  virtual inline bool AcceptsHalfTop(const int top_index) const {
+    return true;
+  }
+  // The filters, but not the bias.
+  virtual inline bool AcceptsHalfParam(const int param_index) const {
+    return param_index == 0;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
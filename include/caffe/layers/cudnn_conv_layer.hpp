@@ -36,6 +36,8 @@ class CuDNNConvolutionLayer : public ConvolutionLayer<Dtype> {
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual ~CuDNNConvolutionLayer();
+  virtual void FoldChannelAffine(const vector<Dtype>& scale,
+      const vector<Dtype>& shift);
 
  protected:
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
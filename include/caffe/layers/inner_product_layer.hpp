@@ -28,6 +28,13 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool AcceptsHalfBottom(const int bottom_index) const {
+    return true;
+  }
+  // The weights, but not the bias.
+  virtual inline bool AcceptsHalfParam(const int param_index) const {
+    return param_index == 0;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
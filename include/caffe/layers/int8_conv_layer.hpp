@@ -0,0 +1,70 @@
+#ifndef CAFFE_INT8_CONV_LAYER_HPP_
+#define CAFFE_INT8_CONV_LAYER_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief INT8 implementation of ConvolutionLayer for CPU inference, used at
+ *        TEST phase for layers with a quantization_param. Fallback to
+ *        ConvolutionLayer for GPU mode, for the backward pass and for
+ *        convolutions that are not 2D.
+ *
+ * The bottom is quantized to int8 over [-bottom_max, bottom_max] and the
+ * weights per output channel over their own range. The int8 patches are
+ * multiplied with int32 accumulation by caffe_cpu_gemm_s8 and the result is
+ * scaled back before the bias is added. The weights are quantized on every
+ * forward pass, which is cheap compared to the convolution, so that loaded
+ * and folded weights are always seen.
+ */
+template <typename Dtype>
+class Int8ConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit Int8ConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), use_int8_(false) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // The quantization reads float blobs.
+  virtual inline bool AcceptsHalfBottom(const int bottom_index) const {
+    return false;
+  }
+  virtual inline bool AcceptsHalfTop(const int top_index) const {
+    return false;
+  }
+  virtual inline bool AcceptsHalfParam(const int param_index) const {
+    return false;
+  }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  bool use_int8_;
+  /// @brief Maps the bottom to [-127, 127].
+  Dtype bottom_scale_;
+  /// @brief Number of output channels and patch size of one group.
+  int group_outputs_, group_kernel_dim_;
+  int out_spatial_dim_;
+  vector<int8_t> weight_int8_;
+  vector<Dtype> weight_scale_;
+  /// @brief One quantized image, its patches and their products.
+  vector<int8_t> bottom_int8_;
+  vector<int8_t> row_buffer_;
+  vector<int32_t> product_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INT8_CONV_LAYER_HPP_
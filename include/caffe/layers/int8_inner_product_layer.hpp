@@ -0,0 +1,58 @@
+#ifndef CAFFE_INT8_INNER_PRODUCT_LAYER_HPP_
+#define CAFFE_INT8_INNER_PRODUCT_LAYER_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/inner_product_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief INT8 implementation of InnerProductLayer for CPU inference, used at
+ *        TEST phase for layers with a quantization_param. Fallback to
+ *        InnerProductLayer for GPU mode and for the backward pass.
+ *
+ * Quantizes like Int8ConvolutionLayer: the bottom over
+ * [-bottom_max, bottom_max] and the weights per output.
+ */
+template <typename Dtype>
+class Int8InnerProductLayer : public InnerProductLayer<Dtype> {
+ public:
+  explicit Int8InnerProductLayer(const LayerParameter& param)
+      : InnerProductLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // The quantization reads float blobs.
+  virtual inline bool AcceptsHalfBottom(const int bottom_index) const {
+    return false;
+  }
+  virtual inline bool AcceptsHalfParam(const int param_index) const {
+    return false;
+  }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Maps the bottom to [-127, 127].
+  Dtype bottom_scale_;
+  /// @brief N_ x K_ quantized weights, transposed if needed.
+  vector<int8_t> weight_int8_;
+  vector<Dtype> weight_scale_;
+  vector<Dtype> weight_buffer_;
+  vector<int8_t> bottom_int8_;
+  vector<int32_t> product_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INT8_INNER_PRODUCT_LAYER_HPP_
@@ -0,0 +1,50 @@
+#ifndef CAFFE_MULTIBOX_GATHER_LAYER_HPP_
+#define CAFFE_MULTIBOX_GATHER_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Gathers the prediction maps of several multibox heads into one
+ *        flat blob in NHWC order.
+ *
+ * Equivalent to a Permute (order 0, 2, 3, 1) and a Flatten (axis 1) of each
+ * bottom followed by a Concat along axis 1, but written in a single pass
+ * without the intermediate permuted and concatenated blobs.
+ *
+ * Bottoms are N x C_i x H_i x W_i and the top is N x sum_i(H_i * W_i * C_i).
+ */
+template <typename Dtype>
+class MultiBoxGatherLayer : public Layer<Dtype> {
+ public:
+  explicit MultiBoxGatherLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "MultiBoxGather"; }
+  virtual inline int MinBottomBlobs() const { return 1; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Offset of each bottom within one item of the top.
+  vector<int> offsets_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_MULTIBOX_GATHER_LAYER_HPP_
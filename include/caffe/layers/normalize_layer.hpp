@@ -27,6 +27,12 @@ class NormalizeLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Normalize"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool AcceptsHalfBottom(const int bottom_index) const {
+    return true;
+  }
+  virtual inline bool AcceptsHalfTop(const int top_index) const {
+    return true;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -41,6 +47,9 @@ class NormalizeLayer : public Layer<Dtype> {
   Blob<Dtype> norm_;
   Blob<Dtype> sum_channel_multiplier_, sum_spatial_multiplier_;
   Blob<Dtype> buffer_, buffer_channel_, buffer_spatial_;
+  /// @brief One bottom and one top image in float, for the blobs stored in
+  /// half precision.
+  Blob<Dtype> half_buffer_;
   bool across_spatial_;
   bool channel_shared_;
   Dtype eps_;
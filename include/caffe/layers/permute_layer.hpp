@@ -34,6 +34,13 @@ class PermuteLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Permute"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool TopSharesBottomData() const { return !need_permute_; }
+  virtual inline bool AcceptsHalfBottom(const int bottom_index) const {
+    return need_permute_;
+  }
+  virtual inline bool AcceptsHalfTop(const int top_index) const {
+    return need_permute_;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -47,6 +54,12 @@ class PermuteLayer : public Layer<Dtype> {
 
   int num_axes_;
   bool need_permute_;
+  // Set when the permutation is a batch of transposes of rows x cols
+  // matrices, which the CPU path runs with a tiled transpose.
+  bool use_transpose_;
+  int transpose_batch_;
+  int transpose_rows_;
+  int transpose_cols_;
 
   // Use Blob because it is convenient to be accessible in .cu file.
   Blob<int> permute_order_;
@@ -33,6 +33,13 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  virtual inline bool AcceptsHalfBottom(const int bottom_index) const {
+    return true;
+  }
+  // The MAX mask stays in float.
+  virtual inline bool AcceptsHalfTop(const int top_index) const {
+    return top_index == 0;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -43,6 +50,11 @@ class PoolingLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // Pool one (n, c) plane on CPU. The max pooling writes the argmax to
+  // top_mask if not NULL, and otherwise to mask.
+  void ForwardMaxPlane_cpu(const Dtype* bottom, Dtype* top, Dtype* top_mask,
+      int* mask);
+  void ForwardAvePlane_cpu(const Dtype* bottom, Dtype* top);
 
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
@@ -0,0 +1,68 @@
+#ifndef CAFFE_RDETECTION_EVALUATE_LAYER_HPP_
+#define CAFFE_RDETECTION_EVALUATE_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe
+{
+
+/**
+* @brief Generate the detection evaluation based on RDetectionOutputLayer and
+* ground truth rotated bounding box labels, matching them by rotated IoU.
+*
+* The top has the layout of DetectionEvaluateLayer, so that
+* Solver::TestDetection computes the mAP of rbox nets during training.
+*
+* NOTE: does not implement Backwards operation.
+*/
+template <typename Dtype>
+class RDetectionEvaluateLayer : public Layer<Dtype>
+{
+public:
+	explicit RDetectionEvaluateLayer(const LayerParameter& param)
+		: Layer<Dtype>(param) {}
+	virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+		const vector<Blob<Dtype>*>& top);
+	virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+		const vector<Blob<Dtype>*>& top);
+
+	virtual inline const char* type() const { return "RDetectionEvaluate"; }
+	virtual inline int ExactBottomBlobs() const { return 2; }
+	virtual inline int ExactNumTopBlobs() const { return 1; }
+
+protected:
+	/**
+	* @brief Evaluate the rbox detection output.
+	*
+	* @param bottom input Blob vector (exact 2)
+	*   -# @f$ (1 \times 1 \times N \times 8) @f$
+	*      N detection results, each row is:
+	*      [image_id, label, confidence, xcenter, ycenter, angle, width, height]
+	*   -# @f$ (1 \times 1 \times M \times 7) @f$
+	*      M ground truth, each row is:
+	*      [image_id, label, xcenter, ycenter, angle, width, height]
+	* @param top Blob vector (length 1)
+	*   -# @f$ (1 \times 1 \times N \times 5) @f$
+	*      N is the number of detections, and each row is:
+	*      [image_id, label, confidence, true_pos, false_pos]
+	*/
+	virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+		const vector<Blob<Dtype>*>& top);
+	/// @brief Not implemented
+	virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+		const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+			NOT_IMPLEMENTED;
+	}
+
+	int num_classes_;
+	int background_label_id_;
+	float overlap_threshold_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_RDETECTION_EVALUATE_LAYER_HPP_
@@ -26,6 +26,9 @@ class SplitLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Split"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline bool TopSharesBottomData() const { return true; }
+  // The bottom diff is the sum of the top diffs.
+  virtual inline bool TopSharesBottomDiff() const { return false; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
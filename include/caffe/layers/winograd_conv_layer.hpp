@@ -0,0 +1,74 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd F(2x2, 3x3) implementation of ConvolutionLayer for CPU.
+ *        Fallback to ConvolutionLayer for GPU mode, for the backward pass
+ *        and for convolutions other than 3x3, stride 1, undilated, 2D.
+ *
+ * Each 2x2 output tile is computed from a 4x4 input tile with 16 instead of
+ * 36 multiplications per input channel. The input tiles of an image are
+ * transformed into 16 matrices of shape (channels x tiles), multiplied by
+ * the 16 transformed filter matrices of shape (num_output x channels), and
+ * the products transformed back into output tiles. The filters are
+ * transformed on every forward pass, which is cheap compared to the
+ * convolution, so that weight updates and loaded weights are always seen.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), use_winograd_(false) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // The Winograd transforms read float blobs.
+  virtual inline bool AcceptsHalfBottom(const int bottom_index) const {
+    return false;
+  }
+  virtual inline bool AcceptsHalfTop(const int top_index) const {
+    return false;
+  }
+  virtual inline bool AcceptsHalfParam(const int param_index) const {
+    return false;
+  }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // U = G g G^T for every (output, input) channel pair.
+  void TransformWeights(const Dtype* weights, Dtype* weight_transform);
+  // V = B^T d B for every (input channel, tile) pair of one image.
+  void TransformInput(const Dtype* input, Dtype* input_transform);
+  // Y = A^T M A for every (output channel, tile) pair of one image.
+  void TransformOutput(const Dtype* output_transform, Dtype* output);
+
+  bool use_winograd_;
+  int height_, width_;
+  int height_out_, width_out_;
+  int pad_h_, pad_w_;
+  int tiles_h_, tiles_w_;
+  /// @brief 16 x num_output x channels transformed filters.
+  Blob<Dtype> weight_transform_;
+  /// @brief 16 x channels x tiles transformed input of one image.
+  Blob<Dtype> input_transform_;
+  /// @brief 16 x num_output x tiles products of one image.
+  Blob<Dtype> output_transform_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
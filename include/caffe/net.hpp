@@ -14,6 +14,9 @@
 
 namespace caffe {
 
+template <typename Dtype> class CPUParams;
+class Timer;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -83,6 +86,81 @@ class Net {
    */
   void Reshape();
 
+  /**
+   * @brief Folds BatchNorm and Scale layers into the Convolution they follow
+   *        and fuses a following ReLU into the convolution output.
+   *
+   * Only layers computing in place on the output of a Convolution, directly
+   * after it, are fused. Call it once the weights are loaded: the fused layers
+   * are skipped by Forward, and the net can no longer run Backward or be
+   * saved. Returns the number of fused layers.
+   */
+  int FuseLayersForInference();
+  /// @brief Whether the layer was fused away by FuseLayersForInference.
+  inline bool layer_fused(int layer_id) const { return layer_fused_[layer_id]; }
+  /**
+   * @brief Lets blobs whose lifetimes do not overlap share memory, for nets
+   *        that only run Forward.
+   *
+   * A blob lives from the first to the last layer that uses it, together
+   * with the blobs that share its data (see Layer::TopSharesBottomData).
+   * Blobs are placed largest first into the first shared buffer whose blobs
+   * all have disjoint lifetimes. Net inputs and outputs and the tops of layers
+   * without bottoms keep their own memory; the other blobs only hold valid
+   * data while Forward runs. Blobs kept in half precision (see
+   * StoreActivationsInHalf) take two bytes per value. Backward is disabled
+   * afterwards. Returns the bytes of activation memory after planning.
+   */
+  size_t ShareActivationMemory();
+  /**
+   * @brief Lets the activations and activation diffs of a TRAIN net share
+   *        memory where their lifetimes over Forward and Backward do not
+   *        overlap.
+   *
+   * Forward runs layer i at step i and Backward runs it at step 2L - 1 - i,
+   * for L layers. Data lives from its forward until the backward of the layer
+   * computing it, and diffs from the backward of the last layer using them
+   * until the backward of that layer, so the diffs of the lower layers reuse
+   * the data of the upper ones. Only param diffs carry over between passes,
+   * which is all iter_size accumulates. Layers with recompute set drop their
+   * tops after Forward and run Forward again during Backward, just before
+   * their tops are needed. Net inputs and outputs, the tops of layers
+   * without bottoms and the blobs with a loss weight keep their own memory;
+   * the other blobs only hold valid data and diffs while Forward and Backward
+   * use them. Returns the bytes of activation memory after planning.
+   */
+  size_t ShareTrainingMemory();
+  /**
+   * @brief Keeps the weights of the layers in half precision on CPU.
+   *
+   * The params that their layers read in half precision (see
+   * Layer::AcceptsHalfParam), such as the filters of Convolution and the
+   * weights of InnerProduct, are converted and their float data freed. The
+   * GEMMs convert them while packing. Biases, per-channel params and params
+   * shared between layers stay in float. Call it after
+   * FuseLayersForInference, if at all. Backward, saving and loading weights
+   * are disabled afterwards. Returns the bytes of param memory after
+   * conversion.
+   */
+  size_t StoreParamsInHalf();
+  /// @brief Whether StoreParamsInHalf converted the params of the net.
+  inline bool params_in_half() const { return params_in_half_; }
+  /**
+   * @brief Keeps the activations between layers in half precision on CPU,
+   *        halving their memory and the memory traffic of the layers.
+   *
+   * A blob is stored in half precision if every layer computing or using it
+   * reads and writes it so inside its kernels (see Layer::AcceptsHalfBottom),
+   * as Convolution, Pooling, Normalize and Permute do. Net inputs and
+   * outputs and blobs computed in place stay in float. Call it after
+   * FuseLayersForInference, which lets the fused ReLUs no longer compute in
+   * place, and before ShareActivationMemory. Backward is disabled
+   * afterwards. Returns the bytes of activation memory after conversion.
+   */
+  size_t StoreActivationsInHalf();
+  /// @brief Whether StoreActivationsInHalf was called.
+  inline bool activations_in_half() const { return activations_in_half_; }
+
   Dtype ForwardBackward() {
     Dtype loss;
     Forward(&loss);
@@ -92,6 +170,35 @@ class Net {
 
   /// @brief Updates the network weights based on the diff values computed.
   void Update();
+  /**
+   * @brief Moves the host memory of the learnable params, and of their diffs,
+   *        into one contiguous array each.
+   *
+   * Update, ClearParamDiffs and the solvers then make one pass over all
+   * params in CPU mode. The solvers call this for their train net. In CPU
+   * mode, a net with a flattened root net uses the data array of the root.
+   */
+  void FlattenParams();
+  /// @brief The arrays of FlattenParams, or NULL if not flattened.
+  inline const shared_ptr<CPUParams<Dtype> >& flat_params() const {
+    return flat_params_;
+  }
+
+  /**
+   * @brief A hook called by BackwardFromTo after the backward of each layer,
+   *        whether the layer needed backward or not.
+   */
+  class Callback {
+   protected:
+    virtual void run(int layer) = 0;
+
+    template <typename T>
+    friend class Net;
+  };
+  const vector<Callback*>& after_backward() const { return after_backward_; }
+  void add_after_backward(Callback* value) {
+    after_backward_.push_back(value);
+  }
   /**
    * @brief Shares weight data of owner blobs with shared blobs.
    *
@@ -105,6 +212,12 @@ class Net {
    *        additional memory) the pre-trained layers from another Net.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief For an already initialized net, copies the pre-trained layers from
+   *        another Net into its own memory, so that they stay unchanged when
+   *        the other Net is trained further.
+   */
+  void CopyTrainedLayersFrom(const Net* other);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -192,6 +305,14 @@ class Net {
     return param_names_index_;
   }
   inline const vector<int>& param_owners() const { return param_owners_; }
+  /// @brief The (layer id, index in the layer's blobs) of each param
+  inline const vector<pair<int, int> >& param_layer_indices() const {
+    return param_layer_indices_;
+  }
+  /// @brief The index in learnable_params of each param, or of its owner
+  inline const vector<int>& learnable_param_ids() const {
+    return learnable_param_ids_;
+  }
   inline const vector<string>& param_display_names() const {
     return param_display_names_;
   }
@@ -217,6 +338,21 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  /**
+   * @brief Starts or stops adding up the milliseconds each layer spends in
+   *        Forward and Backward, clearing the times. In GPU mode, timing
+   *        waits for every layer to finish.
+   */
+  void set_layer_timing(const bool value);
+  void ClearLayerTimes();
+  inline const vector<double>& layer_forward_ms() const {
+    return layer_forward_ms_;
+  }
+  /// @brief Includes the Forward of recompute layers run during Backward.
+  inline const vector<double>& layer_backward_ms() const {
+    return layer_backward_ms_;
+  }
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -242,6 +378,14 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Whether layer_id computes in place on blob_id alone.
+  bool IsInPlaceOn(const int layer_id, const int blob_id) const;
+  /// @brief Whether no params of layer_id are shared with other layers.
+  bool OwnsParamsAlone(const int layer_id) const;
+  /// @brief Shares or copies the params of the layers of other with the
+  ///        same names, for ShareTrainedLayersWith and CopyTrainedLayersFrom.
+  void TakeTrainedLayersFrom(const Net* other, const bool share);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -258,6 +402,20 @@ class Net {
   vector<string> layer_names_;
   map<string, int> layer_names_index_;
   vector<bool> layer_need_backward_;
+  /// @brief Layers folded into a preceding layer by FuseLayersForInference
+  vector<bool> layer_fused_;
+  int num_fused_layers_;
+  /// @brief Set once the net was optimized for Forward only.
+  bool forward_only_;
+  /// @brief Whether to call StoreParamsInHalf before the first Forward.
+  bool half_precision_params_;
+  bool params_in_half_;
+  /// @brief Whether to call StoreActivationsInHalf before the first Forward.
+  bool half_precision_activations_;
+  bool activations_in_half_;
+  /// @brief The recompute layers to run Forward again before the Backward
+  /// of each layer, set by ShareTrainingMemory.
+  vector<vector<int> > recompute_layers_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   vector<string> blob_names_;
@@ -302,12 +460,19 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// The contiguous host memory of learnable_params_, set by FlattenParams
+  shared_ptr<CPUParams<Dtype> > flat_params_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Set by set_layer_timing while the layers are timed.
+  shared_ptr<Timer> layer_timer_;
+  vector<double> layer_forward_ms_;
+  vector<double> layer_backward_ms_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+  vector<Callback*> after_backward_;
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
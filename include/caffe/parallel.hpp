@@ -2,7 +2,11 @@
 #define CAFFE_PARALLEL_HPP_
 
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -23,6 +27,7 @@ template<typename Dtype>
 class Params {
  public:
   explicit Params(shared_ptr<Solver<Dtype> > root_solver);
+  explicit Params(const vector<Blob<Dtype>*>& params);
   virtual ~Params() {
   }
 
@@ -59,6 +64,29 @@ class GPUParams : public Params<Dtype> {
   using Params<Dtype>::diff_;
 };
 
+// Params stored in host memory. The solvers point the host side of the
+// learnable parameters of their net into it in all modes, so that passes over
+// all parameters or gradients run over one array.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  explicit CPUParams(const vector<Blob<Dtype>*>& params);
+  // Uses the data array of root, which must outlive this, and only allocates
+  // the diffs.
+  CPUParams(const vector<Blob<Dtype>*>& params, const CPUParams<Dtype>& root);
+  virtual ~CPUParams();
+
+  void configure(const vector<Blob<Dtype>*>& params) const;
+
+ protected:
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+  bool own_data_;
+  bool data_use_cuda_;
+  bool diff_use_cuda_;
+};
+
 class DevicePair {
  public:
   DevicePair(int parent, int device)
@@ -116,6 +144,102 @@ class P2PSync : public GPUParams<Dtype>, public Solver<Dtype>::Callback,
   using Params<Dtype>::diff_;
 };
 
+// Synchronous data parallelism between CPU worker threads, for hosts with
+// more cores than a single net keeps busy. Each worker trains a copy of the
+// root solver's train net on batches of its own, reading the weights of the
+// root net in place. The gradients are summed in host memory by buckets of
+// params: once the backward pass of every worker went past the layers of a
+// bucket, a reducer thread adds up the diffs of all workers into the root's,
+// in rank order, while the workers carry on with the layers below. Runs are
+// thus reproducible for a given random_seed.
+template<typename Dtype>
+class CPUSync : public Solver<Dtype>::Callback, public Net<Dtype>::Callback,
+    public InternalThread {
+ public:
+  explicit CPUSync(shared_ptr<Solver<Dtype> > root_solver,
+                   CPUSync<Dtype>* root = NULL, int rank = 0);
+  virtual ~CPUSync() {}
+
+  inline const shared_ptr<Solver<Dtype> >& solver() const {
+    return solver_;
+  }
+  inline int rank() const { return rank_; }
+  // The [begin, end) of each bucket in the flattened diffs, set by Run.
+  inline const vector<pair<size_t, size_t> >& buckets() const {
+    return buckets_;
+  }
+
+  // Trains with num_workers workers, the root solver included, splitting the
+  // CPU threads between them. Caffe::solver_count() must be num_workers from
+  // before the root solver was created, for the data readers to deal their
+  // records to all workers.
+  void Run(int num_workers);
+
+ protected:
+  void on_start();
+  void on_gradients_ready();
+  // Called after the backward of each layer of the train net.
+  void run(int layer);
+
+  // Splits the flattened diffs into buckets of about reduce_bucket_size
+  // elements, made of whole params.
+  void InitBuckets();
+  // Marks the buckets whose gradients are complete once the backward pass
+  // reached layer, and queues those all workers marked for reduction.
+  void MarkReady(int layer);
+  void ReduceBucket(int bucket);
+  // Averages the params of state_ids_ over the root and the workers.
+  void ReduceStates();
+
+  void InternalThreadEntry();
+
+  // Sums the buckets of root_ queued by the workers.
+  class Reducer : public InternalThread {
+   public:
+    explicit Reducer(CPUSync* root) : root_(root) {}
+    virtual ~Reducer() { StopInternalThread(); }
+
+    BlockingQueue<int> ready_;
+
+   protected:
+    virtual void InternalThreadEntry();
+
+    CPUSync* root_;
+  };
+
+  CPUSync<Dtype>* root_;
+  const int rank_;
+  const int initial_iter_;
+  shared_ptr<Solver<Dtype> > solver_;
+  size_t size_;
+  // The backward passes of the current iteration, out of iter_size.
+  int backward_passes_;
+  // Whether this worker marked each bucket in the current iteration.
+  vector<bool> marked_;
+
+  // Set on the root by Run, for all workers.
+  shared_ptr<boost::barrier> barrier_;
+  vector<Dtype*> diffs_;
+  vector<pair<size_t, size_t> > buckets_;
+  // The lowest layer using a param of each bucket: the bucket's gradients
+  // are complete after the backward of this layer.
+  vector<int> bucket_layers_;
+  // The workers that marked each bucket, and the buckets reduced, in the
+  // current iteration. Guarded by mutex_.
+  vector<int> bucket_marks_;
+  int buckets_reduced_;
+  boost::mutex mutex_;
+  boost::condition_variable reduced_;
+  shared_ptr<Reducer> reducer_;
+
+  // The learnable params written by the Forward of their layer, and the
+  // copies of a worker, which its net computes with.
+  vector<int> state_ids_;
+  vector<shared_ptr<Blob<Dtype> > > states_;
+  // The workers of the root, set by Run.
+  vector<CPUSync<Dtype>*> workers_;
+};
+
 }  // namespace caffe
 
 #endif
@@ -8,6 +8,34 @@
 
 namespace caffe {
 
+/**
+ * @brief A contiguous range of one parameter blob, updated in one pass by
+ *        SGDSolver::ComputeFusedUpdate.
+ *
+ * The pointers are offset to the start of the range. history2 is only set for
+ * the solvers that keep a second history per parameter (AdaDelta and Adam).
+ */
+template <typename Dtype>
+struct FusedUpdateChunk {
+  int param_id;
+  int count;
+  Dtype* data;
+  Dtype* diff;
+  Dtype* history;
+  Dtype* history2;
+  Dtype normalization;
+  Dtype l2_decay;
+  Dtype l1_decay;
+  Dtype local_rate;
+
+  // The gradient of an element as Normalize and Regularize leave it.
+  inline Dtype gradient(const int i) const {
+    const Dtype w = data[i];
+    return diff[i] * normalization + l2_decay * w +
+        l1_decay * ((Dtype(0) < w) - (w < Dtype(0)));
+  }
+};
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
@@ -31,6 +59,14 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  // Normalizes, regularizes, computes and applies the update of all
+  // parameters on the CPU, with the chunks of the blobs split across threads.
+  void ApplyFusedUpdate(Dtype rate);
+  // Updates one chunk in a single pass: leaves the update value in the diff,
+  // as ComputeUpdateValue does, and subtracts it from the data, as
+  // Net::Update does. Solvers overriding ComputeUpdateValue must override
+  // this as well. Runs concurrently on distinct chunks.
+  virtual void ComputeFusedUpdate(const FusedUpdateChunk<Dtype>& chunk);
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
@@ -60,6 +96,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(const FusedUpdateChunk<Dtype>& chunk);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -75,6 +112,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(const FusedUpdateChunk<Dtype>& chunk);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -95,6 +133,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(const FusedUpdateChunk<Dtype>& chunk);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -119,6 +158,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(const FusedUpdateChunk<Dtype>& chunk);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -143,6 +183,7 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(const FusedUpdateChunk<Dtype>& chunk);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -1,11 +1,14 @@
 #ifndef CAFFE_SOLVER_HPP_
 #define CAFFE_SOLVER_HPP_
 #include <boost/function.hpp>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
 
+#include "caffe/internal_thread.hpp"
 #include "caffe/net.hpp"
 #include "caffe/solver_factory.hpp"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
@@ -31,6 +34,16 @@ namespace caffe {
  */
 typedef boost::function<SolverAction::Enum()> ActionCallback;
 
+/**
+ * @brief The files of a snapshot, copied out of the solver and waiting to be
+ *        written by the snapshot thread of snapshot_async.
+ */
+struct PendingSnapshot {
+  int iter;
+  vector<shared_ptr<google::protobuf::Message> > protos;
+  vector<string> filenames;
+};
+
 /**
  * @brief An interface for classes that perform optimization on Net%s.
  *
@@ -66,7 +79,10 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
-  virtual ~Solver() {}
+  // Blocks until the snapshot being written in the background, if any, is
+  // on disk.
+  void WaitForSnapshot();
+  virtual ~Solver() { WaitForSnapshot(); }
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
   inline const vector<shared_ptr<Net<Dtype> > >& test_nets() {
@@ -100,15 +116,35 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  // Writes a snapshot file through a temporary file. With snapshot_async the
+  // proto is written by the snapshot thread after Snapshot returns, so it
+  // must not be changed afterwards.
+  void WriteSnapshotProto(const shared_ptr<google::protobuf::Message>& proto,
+      const string& filename);
   // The test routine
   void TestAll();
+  void Test(const int test_net_id = 0);
   void TestClassification(const int test_net_id = 0);
   void TestDetection(const int test_net_id = 0);
+  // Handles the actions requested during a test pass, and returns true if the
+  // pass should stop.
+  bool TestInterrupted();
+  // With test_async, copies the weights into the test nets and hands them to
+  // the test thread, after waiting for the previous test pass.
+  void StartAsyncTest();
+  void WaitForAsyncTest();
   virtual void SnapshotSolverState(const string& model_filename) = 0;
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
+  // Logs and resets the prefetch counters of the train net's data layers.
+  void DisplayPrefetchStats();
+  // Starts timing the stages of training, for telemetry_interval.
+  void StartTelemetry();
+  // Appends a record of the iterations since the last one to the telemetry
+  // file, and clears the times.
+  void WriteTelemetry();
   /// Harmonize solver class type with configured proto type.
   void CheckType(SolverParameter* param);
 
@@ -132,6 +168,60 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Runs the test passes of test_async on a background thread.
+  class TestThread : public InternalThread {
+   public:
+    explicit TestThread(Solver* solver) : solver_(solver) {}
+    virtual ~TestThread() { StopInternalThread(); }
+
+    // The iterations whose weights were copied into the test nets, and the
+    // ones whose test pass is done.
+    BlockingQueue<int> requests_;
+    BlockingQueue<int> done_;
+
+   protected:
+    virtual void InternalThreadEntry();
+
+    Solver* solver_;
+  };
+  // The iteration of the weights in the test nets.
+  int tested_iter_;
+  bool async_test_pending_;
+  // Declared last, to be stopped before the nets it tests are destroyed.
+  shared_ptr<TestThread> test_thread_;
+
+  // Writes the snapshots of snapshot_async on a background thread.
+  class SnapshotThread : public InternalThread {
+   public:
+    virtual ~SnapshotThread() { StopInternalThread(); }
+
+    BlockingQueue<shared_ptr<PendingSnapshot> > requests_;
+    // The iterations whose snapshot is on disk.
+    BlockingQueue<int> done_;
+
+   protected:
+    virtual void InternalThreadEntry();
+  };
+  // The snapshot being collected by Snapshot, and the one being written.
+  shared_ptr<PendingSnapshot> pending_snapshot_;
+  int snapshot_in_flight_iter_;
+  shared_ptr<SnapshotThread> snapshot_thread_;
+
+  // The milliseconds spent since the last telemetry record in the stages the
+  // train net does not time itself.
+  struct StageTimes {
+    StageTimes() : sync(0), update(0), test(0), snapshot(0) {}
+    double sync;
+    double update;
+    double test;
+    double snapshot;
+  };
+  StageTimes stage_ms_;
+  int telemetry_iter_;
+  shared_ptr<Timer> telemetry_timer_;
+  shared_ptr<Timer> stage_timer_;
+  shared_ptr<std::ofstream> telemetry_file_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -454,6 +454,36 @@ void ComputeAP(const vector<pair<float, int> >& tp, const int num_pos,
                const vector<pair<float, int> >& fp, const string ap_version,
                vector<float>* prec, vector<float>* rec, float* ap);
 
+// Accumulates the detections of one class over a test run, for computing its
+// average precision.
+//    num_bins: if 0, keeps the score and status of every detection, and
+//      ComputeAP gives the results of the ComputeAP above. Otherwise counts
+//      the true and false positives in num_bins bins of scores in [0, 1],
+//      and computes the precision-recall curve at the bin thresholds, in
+//      memory and time independent of the number of detections.
+class APAccumulator {
+ public:
+  explicit APAccumulator(const int num_bins = 0);
+
+  // Adds a true positive (tp = 1) or false positive (tp = 0) detection.
+  void AddDetection(const float score, const int tp);
+  inline int num_detections() const { return num_detections_; }
+
+  // Compute average precision of the detections given num_pos positives,
+  // with the arguments of ComputeAP.
+  void ComputeAP(const int num_pos, const string& ap_version,
+                 vector<float>* prec, vector<float>* rec, float* ap) const;
+
+ private:
+  int num_bins_;
+  int num_detections_;
+  // Pairs of score and true positive of every detection, if num_bins_ is 0.
+  vector<pair<float, int> > detections_;
+  // True and false positives by score bin otherwise.
+  vector<int> bin_tp_;
+  vector<int> bin_fp_;
+};
+
 #ifndef CPU_ONLY  // GPU
 template <typename Dtype>
 __host__ __device__ Dtype BBoxSizeGPU(const Dtype* bbox,
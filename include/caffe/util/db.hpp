@@ -8,13 +8,18 @@
 
 namespace caffe { namespace db {
 
-enum Mode { READ, WRITE, NEW };
+// READ_RANDOM opens a source read-only for random access, disabling OS
+// readahead where the backend supports it.
+enum Mode { READ, WRITE, NEW, READ_RANDOM };
 
 class Cursor {
  public:
   Cursor() { }
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
+  // Positions the cursor on the first record whose key is not less than key,
+  // in the byte order of the keys, or makes it invalid if there is none.
+  virtual void Seek(const string& key) = 0;
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
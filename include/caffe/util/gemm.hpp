@@ -0,0 +1,83 @@
+#ifndef CAFFE_UTIL_GEMM_H_
+#define CAFFE_UTIL_GEMM_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+// The implementations caffe_cpu_gemm can run on.
+enum GemmBackend {
+  // The CBLAS library Caffe was linked with (ATLAS, MKL or OpenBLAS).
+  GEMM_BLAS = 0,
+  // The built-in blocked GEMM with packed panels, for environments without
+  // a good BLAS. Uses AVX2 and FMA when compiled for them.
+  GEMM_PACKED = 1
+};
+const int kNumGemmBackends = 2;
+
+const char* GemmBackendName(const GemmBackend backend);
+// Parses a name returned by GemmBackendName, case insensitively.
+bool GemmBackendFromName(const std::string& name, GemmBackend* backend);
+
+// The arguments of caffe_cpu_gemm that the best backend depends on.
+struct GemmShape {
+  GemmShape(const CBLAS_TRANSPOSE trans_a, const CBLAS_TRANSPOSE trans_b,
+      const int M, const int N, const int K)
+      : trans_a(trans_a == CblasTrans), trans_b(trans_b == CblasTrans),
+        M(M), N(N), K(K) {}
+  bool operator<(const GemmShape& other) const;
+
+  bool trans_a;
+  bool trans_b;
+  int M;
+  int N;
+  int K;
+};
+
+// The backend of the GEMMs without a backend of their own. Defaults to
+// GEMM_BLAS. The backends are process wide, and should be set before
+// running nets rather than while other threads call caffe_cpu_gemm.
+void caffe_set_gemm_backend(const GemmBackend backend);
+// Sets the backend of the GEMMs of one shape.
+void caffe_set_gemm_backend(const GemmShape& shape, const GemmBackend backend);
+// Drops the backends of all shapes.
+void caffe_clear_gemm_shape_backends();
+// The backend caffe_cpu_gemm runs a GEMM of the shape on. Also counts the
+// call while caffe_record_gemm_shapes is on.
+GemmBackend caffe_gemm_backend(const GemmShape& shape);
+
+// Reads the backend of every shape from a file written by
+// WriteGemmBackendsToFile, as found by tools/gemm_benchmark.
+void ReadGemmBackendsFromFile(const std::string& filename);
+void WriteGemmBackendsToFile(const std::string& filename,
+    const std::map<GemmShape, GemmBackend>& backends);
+
+// Counts the following caffe_cpu_gemm calls by shape into calls, until
+// called again with NULL.
+void caffe_record_gemm_shapes(std::map<GemmShape, int>* calls);
+
+// caffe_cpu_gemm on a given backend.
+template <typename Dtype>
+void caffe_cpu_gemm_on(const GemmBackend backend,
+    const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const Dtype alpha, const Dtype* A,
+    const Dtype* B, const Dtype beta, Dtype* C);
+
+// caffe_cpu_gemm on the packed backend, where A and B may each be stored in
+// half precision (uint16_t). They are converted to Dtype while they are
+// packed, so they are never expanded in memory.
+template <typename Dtype, typename AType, typename BType>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const AType* A, const BType* B, const Dtype beta,
+    Dtype* C);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_GEMM_H_
@@ -0,0 +1,69 @@
+#ifndef CAFFE_UTIL_HALF_MATH_H_
+#define CAFFE_UTIL_HALF_MATH_H_
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+#include <stdint.h>
+
+namespace caffe {
+
+// IEEE 754 half precision numbers are stored as their raw uint16_t bits.
+
+// Rounds x to the nearest half precision number (ties to even); values
+// beyond the half range become infinities.
+uint16_t caffe_float_to_half(const float x);
+
+float caffe_half_to_float(const uint16_t h);
+
+// y = half(x), using the F16C instructions when compiled for them.
+template <typename Dtype>
+void caffe_cpu_float2half(const int n, const Dtype* x, uint16_t* y);
+
+// y = float(x), using the F16C instructions when compiled for them.
+template <typename Dtype>
+void caffe_cpu_half2float(const int n, const uint16_t* x, Dtype* y);
+
+// Converts one value between half precision bits and float or double, and
+// passes it through unchanged between the same types. Inlined into loops that
+// convert while they move values, such as GEMM packing and transposes.
+template <typename To, typename From>
+struct HalfCast {
+  static inline To Run(const From x) { return x; }
+};
+
+template <typename To>
+struct HalfCast<To, uint16_t> {
+  static inline To Run(const uint16_t h) {
+#if defined(__F16C__)
+    return _cvtsh_ss(h);
+#else
+    return caffe_half_to_float(h);
+#endif
+  }
+};
+
+template <typename From>
+struct HalfCast<uint16_t, From> {
+  static inline uint16_t Run(const From x) {
+#if defined(__F16C__)
+    return _cvtss_sh(static_cast<float>(x), _MM_FROUND_TO_NEAREST_INT);
+#else
+    return caffe_float_to_half(static_cast<float>(x));
+#endif
+  }
+};
+
+template <>
+struct HalfCast<uint16_t, uint16_t> {
+  static inline uint16_t Run(const uint16_t h) { return h; }
+};
+
+template <typename To, typename From>
+inline To caffe_half_cast(const From x) {
+  return HalfCast<To, From>::Run(x);
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_MATH_H_
@@ -0,0 +1,37 @@
+#ifndef CAFFE_UTIL_INT8_MATH_H_
+#define CAFFE_UTIL_INT8_MATH_H_
+
+#include <stdint.h>
+
+namespace caffe {
+
+// Quantizes x to y = round(x * scale), saturated to [-127, 127].
+template <typename Dtype>
+void caffe_cpu_quantize_s8(const int n, const Dtype* x, const Dtype scale,
+    int8_t* y);
+
+// Per row quantization of a rows x cols matrix: every row is scaled so that
+// its largest absolute value maps to 127, and scale[row] is set to that
+// factor (1 for all-zero rows).
+template <typename Dtype>
+void caffe_cpu_quantize_rows_s8(const int rows, const int cols,
+    const Dtype* x, int8_t* y, Dtype* scale);
+
+// C = A * B^T with int32 accumulation, where A is M x K and B is N x K, both
+// row major so that every dot product runs over contiguous memory. Uses
+// VNNI or AVX2 when compiled for them.
+void caffe_cpu_gemm_s8(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C);
+
+// Like im2col_cpu for int8 data, but writes the patch of every output pixel
+// as one row, giving the (height_col * width_col) x (channels * kernel_h *
+// kernel_w) matrix used as B by caffe_cpu_gemm_s8.
+void im2row_s8_cpu(const int8_t* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    int8_t* data_row);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INT8_MATH_H_
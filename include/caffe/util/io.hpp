@@ -123,6 +123,13 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Flushes temp_filename to disk and renames it to filename, so that a crash
+// leaves either the previous or the complete new file under filename.
+void CommitTempFile(const string& temp_filename, const string& filename);
+
+// Writes the proto to filename + ".tmp" and commits it under filename.
+void WriteProtoToBinaryFileAtomic(const Message& proto, const string& filename);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
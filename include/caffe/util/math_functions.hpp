@@ -20,6 +20,18 @@ void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
     const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
     Dtype* C);
 
+// The number of threads that each BLAS call may start, 1 for a serial BLAS.
+int caffe_cpu_blas_threads();
+
+// Whether caffe_set_cpu_blas_threads_local can limit the BLAS threads of the
+// calling thread alone.
+bool caffe_cpu_blas_has_local_threads();
+
+// Limits the BLAS calls of the calling thread to the given number of threads
+// and returns the previous limit to restore, where
+// caffe_cpu_blas_has_local_threads().
+int caffe_set_cpu_blas_threads_local(const int threads);
+
 template <typename Dtype>
 void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
@@ -0,0 +1,106 @@
+#ifndef CAFFE_UTIL_RBOX_DATA_CACHE_HPP_
+#define CAFFE_UTIL_RBOX_DATA_CACHE_HPP_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Decoded AnnotatedDatumR records of a source held in one arena.
+ *
+ * Images are stored decoded as uint8 in interleaved HWC order (the cv::Mat
+ * layout) and the rboxes of every record as rows of
+ * [group_label, xcenter, ycenter, angle, width, height]. The arena holds the
+ * header, the images, then the records and rboxes, so that images are
+ * appended as they are decoded. It has the same layout in memory and on
+ * disk, so a cache file written once is mapped directly by later runs
+ * instead of decoding the source again, as long as the source and the
+ * decoding options recorded in its header still match.
+ *
+ * Caches are shared by all layers reading the same source in a process.
+ */
+class RBoxDataCache {
+ public:
+  struct Record {
+    uint64_t image_offset;  // byte offset of the image in the image area
+    int32_t channels;
+    int32_t height;
+    int32_t width;
+    int32_t num_rboxes;
+    uint64_t rbox_offset;   // index of the first rbox row
+  };
+  static const int kRBoxRowSize = 6;
+
+  ~RBoxDataCache();
+
+  // Returns the cache of data_param.source(), mapping cache_file if it
+  // exists, or decoding the source (and writing cache_file if not empty).
+  static shared_ptr<RBoxDataCache> Get(const DataParameter& data_param,
+      const TransformationParameter& transform_param, const string& cache_file);
+
+  inline int size() const { return static_cast<int>(header_->num_records); }
+  inline const Record& record(int i) const { return records_[i]; }
+  inline const uint8_t* image(int i) const {
+    return images_ + records_[i].image_offset;
+  }
+  inline const float* rboxes(int i) const {
+    return rboxes_ + records_[i].rbox_offset * kRBoxRowSize;
+  }
+  inline size_t bytes() const { return arena_size_; }
+
+ protected:
+  struct Header {
+    char magic[8];
+    uint64_t version;
+    uint64_t num_records;
+    uint64_t num_rboxes;
+    uint64_t image_bytes;
+    // What was decoded: a hash of the source path, the size and latest
+    // modification time of the files holding its records, and the options
+    // the images were decoded with.
+    uint64_t source_hash;
+    uint64_t source_bytes;
+    int64_t source_mtime;
+    int32_t force_color;
+    int32_t force_gray;
+  };
+
+  RBoxDataCache();
+  // Fills the identity fields of header for the source and the options.
+  static void Identify(const DataParameter& data_param,
+      const TransformationParameter& transform_param, Header* header);
+  void Build(const DataParameter& data_param, const Header& identity);
+  bool Map(const string& filename, const Header& identity);
+  void Write(const string& filename) const;
+  // Grows the anonymous arena to hold at least size bytes, keeping its data.
+  void Reserve(size_t size);
+  void SetPointers();
+  // Offset of the image area, aligned to a cache line.
+  static size_t ImageAreaOffset();
+  // Offset of the records, aligned to a cache line after the images.
+  static size_t RecordAreaOffset(size_t image_bytes);
+  static size_t ArenaSize(const Header& header);
+
+  char* arena_;
+  size_t arena_size_;
+  size_t arena_capacity_;
+  bool file_backed_;
+  Header* header_;
+  Record* records_;
+  float* rboxes_;
+  uint8_t* images_;
+
+  static map<string, boost::weak_ptr<RBoxDataCache> > caches_;
+
+DISABLE_COPY_AND_ASSIGN(RBoxDataCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_RBOX_DATA_CACHE_HPP_
@@ -63,6 +63,12 @@ float JaccardOverlapRR(const NormalizedRBox& rbox1, const NormalizedRBox& rbox2,
 template <typename Dtype>
 Dtype JaccardOverlapR(const Dtype* rbox1, const Dtype* rbox2);
 
+// JaccardOverlapRR of every rbox in rboxes1 with every rbox in rboxes2, in
+// row major order. Pairs whose circumscribed circles are apart are given 0
+// without computing their intersection.
+void JaccardOverlapRRBatch(const vector<NormalizedRBox>& rboxes1,
+	const vector<NormalizedRBox>& rboxes2, vector<float>* overlaps);
+
 void MatchRBox(const vector<NormalizedRBox>& gt_rboxes,
 	const vector<NormalizedRBox>& pred_rboxes, const int label,
 	const MatchType match_type, const float overlap_threshold,
@@ -18,6 +18,7 @@
 #include "caffe/layers/memory_data_layer.hpp"
 #include "caffe/layers/python_layer.hpp"
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/gemm.hpp"
 
 // Temporary solution for numpy < 1.7 versions: old macro, no promises.
 // You're strongly advised to upgrade to >= 1.7.
@@ -52,6 +53,11 @@ void set_mode_cpu() { Caffe::set_mode(Caffe::CPU); }
 void set_mode_gpu() { Caffe::set_mode(Caffe::GPU); }
 
 void set_random_seed(unsigned int seed) { Caffe::set_random_seed(seed); }
+void set_gemm_backend(const string& name) {
+  GemmBackend backend;
+  CHECK(GemmBackendFromName(name, &backend)) << "Unknown GEMM backend " << name;
+  caffe_set_gemm_backend(backend);
+}
 
 // For convenience, check that input files can be opened, and raise an
 // exception that boost will send to Python if not (caffe could still crash
@@ -287,6 +293,9 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::def("set_mode_gpu", &set_mode_gpu);
   bp::def("set_random_seed", &set_random_seed);
   bp::def("set_device", &Caffe::SetDevice);
+  bp::def("set_cpu_threads", &Caffe::set_cpu_threads);
+  bp::def("set_gemm_backend", &set_gemm_backend);
+  bp::def("read_gemm_backends", &ReadGemmBackendsFromFile);
 
   bp::def("layer_type_list", &LayerRegistry<Dtype>::LayerTypeList);
 
@@ -307,6 +316,11 @@ BOOST_PYTHON_MODULE(_caffe) {
     .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
         &Net<Dtype>::CopyTrainedLayersFrom))
     .def("share_with", &Net<Dtype>::ShareTrainedLayersWith)
+    .def("fuse_layers_for_inference", &Net<Dtype>::FuseLayersForInference)
+    .def("share_activation_memory", &Net<Dtype>::ShareActivationMemory)
+    .def("share_training_memory", &Net<Dtype>::ShareTrainingMemory)
+    .def("store_params_in_half", &Net<Dtype>::StoreParamsInHalf)
+    .def("store_activations_in_half", &Net<Dtype>::StoreActivationsInHalf)
     .add_property("_blob_loss_weights", bp::make_function(
         &Net<Dtype>::blob_loss_weights, bp::return_internal_reference<>()))
     .def("_bottom_ids", bp::make_function(&Net<Dtype>::bottom_ids,
@@ -1176,7 +1176,8 @@ def CreateMultiRBoxHead(net, data_layer="data", num_classes=[], from_layers=[],
         use_scale=True, prior_variance = [0.1],
         aspect_ratios=[], steps=[], img_height=0, img_width=0, share_location=True,
         flip=True, clip=True, offset=0.5, inter_layer_depth=[], kernel_size=1, pad=0,
-        conf_postfix='', loc_postfix='', regress_size = False, regress_angle = False, **bn_param):
+        conf_postfix='', loc_postfix='', regress_size = False, regress_angle = False,
+        fuse_gather=False, **bn_param):
     assert num_classes, "must provide num_classes"
     assert num_classes > 0, "num_classes must be positive number"
     if normalizations:
@@ -1234,22 +1235,28 @@ def CreateMultiRBoxHead(net, data_layer="data", num_classes=[], from_layers=[],
             num_loc_output *= num_classes
         ConvBNLayer(net, from_layer, name, use_bn=use_batchnorm, use_relu=False, lr_mult=lr_mult,
             num_output=num_loc_output, kernel_size=kernel_size, pad=pad, stride=1, **bn_param)
-        permute_name = "{}_perm".format(name)
-        net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
-        flatten_name = "{}_flat".format(name)
-        net[flatten_name] = L.Flatten(net[permute_name], axis=1)
-        loc_layers.append(net[flatten_name])
+        if fuse_gather:
+            loc_layers.append(net[name])
+        else:
+            permute_name = "{}_perm".format(name)
+            net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
+            flatten_name = "{}_flat".format(name)
+            net[flatten_name] = L.Flatten(net[permute_name], axis=1)
+            loc_layers.append(net[flatten_name])
 
         # Create confidence prediction layer.
         name = "{}_mbox_conf_plane{}".format(from_layer, conf_postfix)
         num_conf_output = num_priors_per_location * num_classes;
         ConvBNLayer(net, from_layer, name, use_bn=use_batchnorm, use_relu=False, lr_mult=lr_mult,
             num_output=num_conf_output, kernel_size=kernel_size, pad=pad, stride=1, **bn_param)
-        permute_name = "{}_perm".format(name)
-        net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
-        flatten_name = "{}_flat".format(name)
-        net[flatten_name] = L.Flatten(net[permute_name], axis=1)
-        conf_layers.append(net[flatten_name])
+        if fuse_gather:
+            conf_layers.append(net[name])
+        else:
+            permute_name = "{}_perm".format(name)
+            net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
+            flatten_name = "{}_flat".format(name)
+            net[flatten_name] = L.Flatten(net[permute_name], axis=1)
+            conf_layers.append(net[flatten_name])
 
         # Create prior generation layer.
         name = "{}_mbox_priorrbox_plane".format(from_layer)
@@ -1272,26 +1279,39 @@ def CreateMultiRBoxHead(net, data_layer="data", num_classes=[], from_layers=[],
             num_obj_output = num_priors_per_location * 2;
             ConvBNLayer(net, from_layer, name, use_bn=use_batchnorm, use_relu=False, lr_mult=lr_mult,
                 num_output=num_obj_output, kernel_size=kernel_size, pad=pad, stride=1, **bn_param)
-            permute_name = "{}_perm".format(name)
-            net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
-            flatten_name = "{}_flat".format(name)
-            net[flatten_name] = L.Flatten(net[permute_name], axis=1)
-            objectness_layers.append(net[flatten_name])
-
-    # Concatenate priorbox, loc, and conf layers.
+            if fuse_gather:
+                objectness_layers.append(net[name])
+            else:
+                permute_name = "{}_perm".format(name)
+                net[permute_name] = L.Permute(net[name], order=[0, 2, 3, 1])
+                flatten_name = "{}_flat".format(name)
+                net[flatten_name] = L.Flatten(net[permute_name], axis=1)
+                objectness_layers.append(net[flatten_name])
+
+    # Concatenate priorbox, loc, and conf layers. With fuse_gather, a single
+    # MultiBoxGather layer replaces the Permute, Flatten and Concat layers.
     mbox_layers = []
     name = "mbox_loc_plane"
-    net[name] = L.Concat(*loc_layers, axis=1)
+    if fuse_gather:
+        net[name] = L.MultiBoxGather(*loc_layers)
+    else:
+        net[name] = L.Concat(*loc_layers, axis=1)
     mbox_layers.append(net[name])
     name = "mbox_conf_plane"
-    net[name] = L.Concat(*conf_layers, axis=1)
+    if fuse_gather:
+        net[name] = L.MultiBoxGather(*conf_layers)
+    else:
+        net[name] = L.Concat(*conf_layers, axis=1)
     mbox_layers.append(net[name])
     name = "mbox_priorbox_plane"
     net[name] = L.Concat(*priorrbox_layers, axis=2)
     mbox_layers.append(net[name])
     if use_objectness:
         name = "mbox_objectness_plane"
-        net[name] = L.Concat(*objectness_layers, axis=1)
+        if fuse_gather:
+            net[name] = L.MultiBoxGather(*objectness_layers)
+        else:
+            net[name] = L.Concat(*objectness_layers, axis=1)
         mbox_layers.append(net[name])
 
     return mbox_layers
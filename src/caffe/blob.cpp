@@ -1,13 +1,50 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half_math.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// Only real blobs are stored in half precision.
+template <typename Dtype>
+static void HalfToData(const int n, const uint16_t* x, Dtype* y) {
+  caffe_cpu_half2float(n, x, y);
+}
+
+template <> void HalfToData(const int n, const uint16_t* x, unsigned int* y) {
+  NOT_IMPLEMENTED;
+}
+
+template <> void HalfToData(const int n, const uint16_t* x, int* y) {
+  NOT_IMPLEMENTED;
+}
+
+template <> void HalfToData(const int n, const uint16_t* x, bool* y) {
+  NOT_IMPLEMENTED;
+}
+
+template <typename Dtype>
+static void DataToHalf(const int n, const Dtype* x, uint16_t* y) {
+  caffe_cpu_float2half(n, x, y);
+}
+
+template <> void DataToHalf(const int n, const unsigned int* x, uint16_t* y) {
+  NOT_IMPLEMENTED;
+}
+
+template <> void DataToHalf(const int n, const int* x, uint16_t* y) {
+  NOT_IMPLEMENTED;
+}
+
+template <> void DataToHalf(const int n, const bool* x, uint16_t* y) {
+  NOT_IMPLEMENTED;
+}
+
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
     const int width) {
@@ -41,6 +78,10 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    if (half_data_) {
+      half_data_.reset(new SyncedMemory(capacity_ * sizeof(uint16_t)));
+      half_head_ = HALF_NEWER;
+    }
   }
   
 }
@@ -64,14 +105,14 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), half_head_(HALF_SYNCED) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), half_head_(HALF_SYNCED) {
   Reshape(shape);
 }
 
@@ -84,6 +125,7 @@ const int* Blob<Dtype>::gpu_shape() const {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
+  SyncHalfToData();
   return (const Dtype*)data_->cpu_data();
 }
 
@@ -91,11 +133,13 @@ template <typename Dtype>
 void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
   data_->set_cpu_data(data);
+  if (half_data_) { half_head_ = DATA_NEWER; }
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
+  SyncHalfToData();
   return (const Dtype*)data_->gpu_data();
 }
 
@@ -115,12 +159,16 @@ template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
 	if (!data_) LOG(INFO)<<"Failed******";
   CHECK(data_);
+  SyncHalfToData();
+  if (half_data_) { half_head_ = DATA_NEWER; }
   return static_cast<Dtype*>(data_->mutable_cpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
+  SyncHalfToData();
+  if (half_data_) { half_head_ = DATA_NEWER; }
   return static_cast<Dtype*>(data_->mutable_gpu_data());
 }
 
@@ -136,18 +184,97 @@ Dtype* Blob<Dtype>::mutable_gpu_diff() {
   return static_cast<Dtype*>(diff_->mutable_gpu_data());
 }
 
+template <typename Dtype>
+void Blob<Dtype>::SyncHalfToData() const {
+  if (half_data_ && half_head_ == HALF_NEWER) {
+    HalfToData(count_, static_cast<const uint16_t*>(half_data_->cpu_data()),
+        static_cast<Dtype*>(data_->mutable_cpu_data()));
+    half_head_ = HALF_SYNCED;
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::SyncDataToHalf() const {
+  if (half_head_ == DATA_NEWER) {
+    DataToHalf(count_, static_cast<const Dtype*>(data_->cpu_data()),
+        static_cast<uint16_t*>(half_data_->mutable_cpu_data()));
+    half_head_ = HALF_SYNCED;
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::StoreDataInHalf() {
+  CHECK(data_);
+  if (half_data_) { return; }
+  half_data_.reset(new SyncedMemory(capacity_ * sizeof(uint16_t)));
+  if (data_->head() != SyncedMemory::UNINITIALIZED) {
+    DataToHalf(count_, cpu_data(),
+        static_cast<uint16_t*>(half_data_->mutable_cpu_data()));
+  }
+  // The float data is only allocated again when it is accessed.
+  data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  half_head_ = HALF_NEWER;
+}
+
+template <typename Dtype>
+const uint16_t* Blob<Dtype>::cpu_half_data() const {
+  CHECK(half_data_) << "The blob is not stored in half precision.";
+  SyncDataToHalf();
+  return static_cast<const uint16_t*>(half_data_->cpu_data());
+}
+
+template <typename Dtype>
+uint16_t* Blob<Dtype>::mutable_cpu_half_data() {
+  CHECK(half_data_) << "The blob is not stored in half precision.";
+  SyncDataToHalf();
+  half_head_ = HALF_NEWER;
+  return static_cast<uint16_t*>(half_data_->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK(!half_data_ && !other.half_data_)
+      << "Cannot share the data of a blob stored in half precision.";
   data_ = other.data();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataMemory(const shared_ptr<SyncedMemory>& data) {
+  CHECK(!half_data_) << "Use ShareHalfMemory for blobs stored in half.";
+  CHECK_GE(data->size(), count_ * sizeof(Dtype));
+  capacity_ = data->size() / sizeof(Dtype);
+  data_ = data;
+  // Keep the diff as large as the capacity; it is only allocated on use.
+  diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+}
+
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffMemory(const shared_ptr<SyncedMemory>& diff) {
+  CHECK_GE(diff->size(), count_ * sizeof(Dtype));
+  // Reshapes beyond the smaller of data and diff reallocate both.
+  capacity_ = std::min(capacity_,
+      static_cast<int>(diff->size() / sizeof(Dtype)));
+  diff_ = diff;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareHalfMemory(const shared_ptr<SyncedMemory>& half_data) {
+  CHECK(half_data_) << "The blob is not stored in half precision.";
+  CHECK_GE(half_data->size(), count_ * sizeof(uint16_t));
+  // Reshapes beyond the smaller of data and half data reallocate both.
+  capacity_ = std::min(capacity_,
+      static_cast<int>(half_data->size() / sizeof(uint16_t)));
+  half_data_ = half_data;
+  half_head_ = HALF_NEWER;
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -157,21 +284,20 @@ template <> void Blob<bool>::Update() { NOT_IMPLEMENTED; }
 
 template <typename Dtype>
 void Blob<Dtype>::Update() {
+  SyncHalfToData();
   // We will perform update based on where the data is located.
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     // perform computation on CPU
     caffe_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->cpu_data()),
-        static_cast<Dtype*>(data_->mutable_cpu_data()));
+        static_cast<const Dtype*>(diff_->cpu_data()), mutable_cpu_data());
     break;
   case SyncedMemory::HEAD_AT_GPU:
   case SyncedMemory::SYNCED:
 #ifndef CPU_ONLY
     // perform computation on GPU
     caffe_gpu_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->gpu_data()),
-        static_cast<Dtype*>(data_->mutable_gpu_data()));
+        static_cast<const Dtype*>(diff_->gpu_data()), mutable_gpu_data());
 #else
     NO_GPU;
 #endif
@@ -199,6 +325,7 @@ template <> bool Blob<bool>::asum_data() const {
 template <typename Dtype>
 Dtype Blob<Dtype>::asum_data() const {
   if (!data_) { return 0; }
+  SyncHalfToData();
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     return caffe_cpu_asum(count_, cpu_data());
@@ -281,6 +408,7 @@ Dtype Blob<Dtype>::sumsq_data() const {
   Dtype sumsq;
   const Dtype* data;
   if (!data_) { return 0; }
+  SyncHalfToData();
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = cpu_data();
@@ -361,6 +489,7 @@ template <typename Dtype>
 void Blob<Dtype>::scale_data(Dtype scale_factor) {
   Dtype* data;
   if (!data_) { return; }
+  SyncHalfToData();
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = mutable_cpu_data();
@@ -457,8 +586,7 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
       caffe_copy(count_, source.gpu_diff(),
           static_cast<Dtype*>(diff_->mutable_gpu_data()));
     } else {
-      caffe_copy(count_, source.gpu_data(),
-          static_cast<Dtype*>(data_->mutable_gpu_data()));
+      caffe_copy(count_, source.gpu_data(), mutable_gpu_data());
     }
     break;
   case Caffe::CPU:
@@ -466,8 +594,7 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
       caffe_copy(count_, source.cpu_diff(),
           static_cast<Dtype*>(diff_->mutable_cpu_data()));
     } else {
-      caffe_copy(count_, source.cpu_data(),
-          static_cast<Dtype*>(data_->mutable_cpu_data()));
+      caffe_copy(count_, source.cpu_data(), mutable_cpu_data());
     }
     break;
   default:
@@ -534,15 +661,12 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_double_data();
   proto->clear_double_diff();
-  const double* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_double_data(data_vec[i]);
-  }
+  proto->mutable_double_data()->Resize(count_, 0);
+  caffe_copy(count_, cpu_data(), proto->mutable_double_data()->mutable_data());
   if (write_diff) {
-    const double* diff_vec = cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      proto->add_double_diff(diff_vec[i]);
-    }
+    proto->mutable_double_diff()->Resize(count_, 0);
+    caffe_copy(count_, cpu_diff(),
+        proto->mutable_double_diff()->mutable_data());
   }
 }
 
@@ -554,15 +678,11 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
-  const float* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_data(data_vec[i]);
-  }
+  proto->mutable_data()->Resize(count_, 0);
+  caffe_copy(count_, cpu_data(), proto->mutable_data()->mutable_data());
   if (write_diff) {
-    const float* diff_vec = cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      proto->add_diff(diff_vec[i]);
-    }
+    proto->mutable_diff()->Resize(count_, 0);
+    caffe_copy(count_, cpu_diff(), proto->mutable_diff()->mutable_data());
   }
 }
 
@@ -1,5 +1,8 @@
 #include <boost/thread.hpp>
 #include <glog/logging.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <cmath>
 #include <cstdio>
 #include <ctime>
@@ -40,6 +43,23 @@ int64_t cluster_seedgen(void) {
 }
 
 
+// The OpenMP default: OMP_NUM_THREADS, or else the number of cores.
+static int default_cpu_threads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+void Caffe::set_cpu_threads(const int threads) {
+  CHECK_GE(threads, 1) << "Need at least one CPU thread.";
+  Get().cpu_threads_ = threads;
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
 void GlobalInit(int* pargc, char*** pargv) {
   // Google flags.
   ::gflags::ParseCommandLineFlags(pargc, pargv, true);
@@ -53,7 +73,8 @@ void GlobalInit(int* pargc, char*** pargv) {
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), root_solver_(true) { }
+      solver_count_(1), solver_rank_(0), root_solver_(true),
+      cpu_threads_(default_cpu_threads()) { }
 
 Caffe::~Caffe() { }
 
@@ -106,7 +127,8 @@ void* Caffe::RNG::generator() {
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
-    mode_(Caffe::CPU), solver_count_(1), root_solver_(true) {
+    mode_(Caffe::CPU), solver_count_(1), solver_rank_(0), root_solver_(true),
+    cpu_threads_(default_cpu_threads()) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
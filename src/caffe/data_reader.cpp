@@ -1,6 +1,8 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/common.hpp"
@@ -9,6 +11,8 @@
 #include "caffe/layers/annotated_data_layer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
@@ -88,15 +92,254 @@ DataReader<T>::Body::~Body() {
   StopInternalThread();
 }
 
+template <typename T>
+class DataReader<T>::Body::Sequencer {
+ public:
+  explicit Sequencer(int num_queues) : qps_(), next_(num_queues, 0) {}
+
+  inline int num_queues() const { return next_.size(); }
+  // Adds the queue pair of the next solver, once its data layer exists.
+  void add_queue(QueuePair* qp) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      qps_.push_back(qp);
+    }
+    condition_.notify_all();
+  }
+  // Blocks until the queue pair of solver q was added.
+  QueuePair* queue(int q) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (qps_.size() <= static_cast<size_t>(q)) {
+      condition_.wait(lock);
+    }
+    return qps_[q];
+  }
+  // Blocks until the record with sequence number seq is next for queue q.
+  void wait(int q, size_t seq) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (next_[q] != seq) {
+      condition_.wait(lock);
+    }
+  }
+  // Marks the current record of queue q as pushed.
+  void done(int q) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      ++next_[q];
+    }
+    condition_.notify_all();
+  }
+
+ private:
+  vector<QueuePair*> qps_;
+  vector<size_t> next_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+// Cursor over the records first, first + stride, first + 2 * stride, ... of
+// a source, restarting from the beginning at the end of the source. If keys
+// are given, every epoch visits them in a new permutation (the same for all
+// shards of a source, as it only depends on seed and epoch). Otherwise the
+// cursor can be limited to the keys in [begin_key, end_key), an empty key
+// meaning the start or end of the source. If buffer_size is positive,
+// records are additionally drawn at random from a buffer.
+class ShardCursor : public db::Cursor {
+ public:
+  ShardCursor(db::Cursor* cursor, size_t first, size_t stride,
+      const vector<string>* keys, unsigned int seed, int buffer_size,
+      const string& begin_key = "", const string& end_key = "")
+      : cursor_(cursor), first_(first), stride_(stride), keys_(keys),
+        seed_(seed), buffer_size_(buffer_size), begin_key_(begin_key),
+        end_key_(end_key), epoch_(0), position_(0), current_(0),
+        buffer_rng_(seed + static_cast<unsigned int>(first)) {
+    SeekToFirst();
+  }
+
+  virtual void SeekToFirst() {
+    if (keys_) {
+      epoch_ = 0;
+      position_ = 0;
+      Permute();
+    } else {
+      Restart();
+    }
+    Advance(first_);
+    buffer_.clear();
+    for (int i = 0; i < buffer_size_; ++i) {
+      buffer_.push_back(std::make_pair(cursor_->key(), cursor_->value()));
+      Advance(stride_);
+    }
+    Draw();
+  }
+  // A shard visits every stride-th record, in permuted order with keys, and
+  // draws from its buffer at random, so a key has no position to resume from.
+  virtual void Seek(const string& key) {
+    LOG(FATAL) << "Cannot seek a shard cursor to key " << key
+        << "; it only supports SeekToFirst and Next.";
+  }
+  virtual void Next() {
+    if (buffer_.empty()) {
+      Advance(stride_);
+    } else {
+      buffer_[current_] = std::make_pair(cursor_->key(), cursor_->value());
+      Advance(stride_);
+      Draw();
+    }
+  }
+  virtual string key() {
+    return buffer_.empty() ? cursor_->key() : buffer_[current_].first;
+  }
+  virtual string value() {
+    return buffer_.empty() ? cursor_->value() : buffer_[current_].second;
+  }
+  virtual bool valid() { return true; }
+
+ private:
+  void Advance(size_t steps) {
+    if (keys_) {
+      position_ += steps;
+      while (position_ >= keys_->size()) {
+        position_ -= keys_->size();
+        ++epoch_;
+        Permute();
+      }
+      const string& key = (*keys_)[order_[position_]];
+      cursor_->Seek(key);
+      CHECK(cursor_->valid() && cursor_->key() == key)
+          << "Key " << key << " not found.";
+      return;
+    }
+    for (size_t i = 0; i < steps; ++i) {
+      cursor_->Next();
+      if (!cursor_->valid() ||
+          (!end_key_.empty() && cursor_->key() >= end_key_)) {
+        DLOG(INFO) << "Restarting data prefetching from start.";
+        Restart();
+      }
+    }
+  }
+  void Restart() {
+    if (begin_key_.empty()) {
+      cursor_->SeekToFirst();
+    } else {
+      cursor_->Seek(begin_key_);
+    }
+    CHECK(cursor_->valid()) << "Empty source.";
+  }
+  void Permute() {
+    order_.resize(keys_->size());
+    for (size_t i = 0; i < order_.size(); ++i) {
+      order_[i] = i;
+    }
+    rng_t rng(seed_ + static_cast<unsigned int>(epoch_));
+    shuffle(order_.begin(), order_.end(), &rng);
+    DLOG(INFO) << "Shuffled keys for epoch " << epoch_;
+  }
+  void Draw() {
+    if (!buffer_.empty()) {
+      current_ = buffer_rng_() % buffer_.size();
+    }
+  }
+
+  db::Cursor* cursor_;
+  const size_t first_, stride_;
+  const vector<string>* keys_;
+  const unsigned int seed_;
+  const int buffer_size_;
+  const string begin_key_, end_key_;
+  size_t epoch_, position_;
+  vector<size_t> order_;
+  vector<pair<string, string> > buffer_;
+  size_t current_;
+  rng_t buffer_rng_;
+
+  DISABLE_COPY_AND_ASSIGN(ShardCursor);
+};
+
 template <typename T>
 void DataReader<T>::Body::InternalThreadEntry() {
-  shared_ptr<db::DB> db(db::GetDB(param_.data_param().backend()));
-  db->Open(param_.data_param().source(), db::READ);
-  shared_ptr<db::Cursor> cursor(db->NewCursor());
+  const DataParameter& data_param = param_.data_param();
+  shared_ptr<db::DB> db(db::GetDB(data_param.backend()));
+  db->Open(data_param.source(),
+           data_param.shuffle_keys() ? db::READ_RANDOM : db::READ);
+  shared_ptr<db::Cursor> db_cursor(db->NewCursor());
+  // Keys are only needed to visit the source in random order.
+  vector<string> keys;
+  if (data_param.shuffle_keys()) {
+    for (; db_cursor->valid(); db_cursor->Next()) {
+      keys.push_back(db_cursor->key());
+    }
+    CHECK(!keys.empty()) << "Empty source " << data_param.source();
+    LOG(INFO) << "Shuffling " << keys.size() << " keys every epoch.";
+  }
+  const unsigned int seed = caffe_rng_rand();
+  const int num_readers = data_param.reader_threads();
   vector<shared_ptr<QueuePair> > qps;
+  // Shared with the reader threads, so they must outlive the try block.
+  vector<shared_ptr<db::Cursor> > db_cursors, cursors;
+  shared_ptr<Sequencer> sequencer;
+  boost::thread_group readers;
   try {
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
 
+    if (num_readers > 1) {
+      // Each reader needs a free datum of its own to make progress.
+      CHECK_GE(data_param.prefetch() * data_param.batch_size(), num_readers)
+          << "prefetch * batch_size must be at least reader_threads";
+      // Without shuffled keys, every reader reads a range of consecutive
+      // keys of its own, of the same size up to one record.
+      vector<string> begin_keys(num_readers), end_keys(num_readers);
+      vector<size_t> shard_sizes;
+      if (keys.empty()) {
+        vector<string> all_keys;
+        for (db_cursor->SeekToFirst(); db_cursor->valid();
+             db_cursor->Next()) {
+          all_keys.push_back(db_cursor->key());
+        }
+        const size_t num_keys = all_keys.size();
+        CHECK_GE(num_keys, static_cast<size_t>(num_readers))
+            << "Fewer records than reader_threads in " << data_param.source();
+        for (int r = 0; r < num_readers; ++r) {
+          const size_t begin = r * num_keys / num_readers;
+          const size_t end = (r + 1) * num_keys / num_readers;
+          begin_keys[r] = all_keys[begin];
+          if (end < num_keys) {
+            end_keys[r] = all_keys[end];
+          }
+          shard_sizes.push_back(end - begin);
+        }
+      }
+      // Cursors are created here as opening them is not thread safe. The
+      // readers deal every record, the first ones included, and wait for
+      // the queue pair of each solver to be added below.
+      sequencer.reset(new Sequencer(solver_count));
+      for (int r = 0; r < num_readers; ++r) {
+        db_cursors.push_back(shared_ptr<db::Cursor>(db->NewCursor()));
+        cursors.push_back(shared_ptr<db::Cursor>(keys.empty() ?
+            new ShardCursor(db_cursors[r].get(), 0, 1, NULL, seed,
+                data_param.shuffle_buffer(), begin_keys[r], end_keys[r]) :
+            new ShardCursor(db_cursors[r].get(), r, num_readers, &keys, seed,
+                data_param.shuffle_buffer())));
+        readers.create_thread(boost::bind(&Body::read_shard, this, r,
+            cursors[r].get(), boost::cref(shard_sizes), sequencer.get()));
+      }
+      for (int i = 0; i < solver_count; ++i) {
+        shared_ptr<QueuePair> qp(new_queue_pairs_.pop());
+        qps.push_back(qp);
+        sequencer->add_queue(qp.get());
+      }
+      while (!must_stop()) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+        CHECK_EQ(new_queue_pairs_.size(), 0);
+      }
+      readers.interrupt_all();
+      readers.join_all();
+      return;
+    }
+
+    shared_ptr<db::Cursor> cursor(new ShardCursor(db_cursor.get(), 0, 1,
+        keys.empty() ? NULL : &keys, seed, data_param.shuffle_buffer()));
     // To ensure deterministic runs, only start running once all solvers
     // are ready. But solvers need to peek on one item during initialization,
     // so read one item, then wait for the next solver.
@@ -118,6 +361,8 @@ void DataReader<T>::Body::InternalThreadEntry() {
     }
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
+    readers.interrupt_all();
+    readers.join_all();
   }
 }
 
@@ -136,6 +381,54 @@ void DataReader<T>::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
   }
 }
 
+// Returns the position, in the order records are dealt to the solvers, of
+// the k-th record of reader r. Readers over shuffled keys (shard_sizes empty)
+// simply take turns. Readers over key ranges of shard_sizes records, which
+// differ by at most one, also take turns, and then deal the records left
+// over in reader order, so that every pass deals each record once.
+static size_t DealPosition(size_t k, int r, int num_readers,
+    const vector<size_t>& shard_sizes) {
+  if (shard_sizes.empty()) {
+    return k * num_readers + r;
+  }
+  size_t num_records = 0;
+  size_t min_size = shard_sizes[0];
+  int leftover_rank = 0;
+  for (int i = 0; i < num_readers; ++i) {
+    num_records += shard_sizes[i];
+    min_size = std::min(min_size, shard_sizes[i]);
+  }
+  for (int i = 0; i < r; ++i) {
+    leftover_rank += shard_sizes[i] > min_size;
+  }
+  const size_t pass = k / shard_sizes[r];
+  const size_t i = k % shard_sizes[r];
+  return pass * num_records + (i < min_size ? i * num_readers + r :
+      min_size * num_readers + leftover_rank);
+}
+
+// Record i goes to solver i % solver_count, where it is the
+// (i / solver_count)-th item.
+template <typename T>
+void DataReader<T>::Body::read_shard(int reader_id, db::Cursor* cursor,
+    const vector<size_t>& shard_sizes, Sequencer* sequencer) {
+  const int num_readers = param_.data_param().reader_threads();
+  const int solver_count = sequencer->num_queues();
+  for (size_t k = 0; ; ++k) {
+    boost::this_thread::interruption_point();
+    const size_t record =
+        DealPosition(k, reader_id, num_readers, shard_sizes);
+    const int q = record % solver_count;
+    QueuePair* qp = sequencer->queue(q);
+    T* t = qp->free_.pop();
+    t->ParseFromString(cursor->value());
+    sequencer->wait(q, record / solver_count);
+    qp->full_.push(t);
+    sequencer->done(q);
+    cursor->Next();
+  }
+}
+
 // Instance class
 template class DataReader<Datum>;
 template class DataReader<AnnotatedDatum>;
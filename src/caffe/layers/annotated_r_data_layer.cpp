@@ -10,6 +10,8 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/annotated_r_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 #include "caffe/util/sampler.hpp"
 
 namespace caffe {
@@ -17,7 +19,10 @@ namespace caffe {
 template <typename Dtype>
 AnnotatedRDataLayer<Dtype>::AnnotatedRDataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    reader_(param) {
+    cache_pos_(0) {
+  if (!param.annotated_r_data_param().cache_decoded()) {
+    reader_.reset(new DataReader<AnnotatedDatumR>(param));
+  }
 }
 
 template <typename Dtype>
@@ -32,9 +37,13 @@ void AnnotatedRDataLayer<Dtype>::DataLayerSetUp(
   const AnnotatedRDataParameter& anno_data_param =
       this->layer_param_.annotated_r_data_param();
   label_map_file_ = anno_data_param.label_map_file();
+  if (anno_data_param.cache_decoded()) {
+    CacheDataLayerSetUp(top);
+    return;
+  }
 
   // Read a data point, and use it to initialize the top blob.
-  AnnotatedDatumR& anno_datum = *(reader_.full().peek());
+  AnnotatedDatumR& anno_datum = *(reader_->full().peek());
 
   // Use data_transformer to infer the expected blob shape from anno_datum.
   vector<int> top_shape =
@@ -43,8 +52,8 @@ void AnnotatedRDataLayer<Dtype>::DataLayerSetUp(
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -92,8 +101,8 @@ void AnnotatedRDataLayer<Dtype>::DataLayerSetUp(
     }
     LOG(INFO)<<"ANNOTATED LABEL INPUT";
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
     LOG(INFO)<<"ANNOTATED LABEL INPUT DONE";
     LOG(INFO) << "output label size: " << top[1]->num() << ","
@@ -102,6 +111,95 @@ void AnnotatedRDataLayer<Dtype>::DataLayerSetUp(
   }
 }
 
+template <typename Dtype>
+void AnnotatedRDataLayer<Dtype>::CacheDataLayerSetUp(
+    const vector<Blob<Dtype>*>& top) {
+#ifdef USE_OPENCV
+  const int batch_size = this->layer_param_.data_param().batch_size();
+  const AnnotatedRDataParameter& anno_data_param =
+      this->layer_param_.annotated_r_data_param();
+  cache_ = RBoxDataCache::Get(this->layer_param_.data_param(),
+      this->layer_param_.transform_param(), anno_data_param.cache_file());
+  // Like the data readers, split the records of a TRAIN net between the
+  // solvers: each one takes the records rank, rank + solver_count, ...
+  const int solver_count =
+      this->phase_ == TRAIN ? Caffe::solver_count() : 1;
+  const int solver_rank = this->phase_ == TRAIN ? Caffe::solver_rank() : 0;
+  CHECK_GE(cache_->size(), solver_count)
+      << "Fewer records than solvers in "
+      << this->layer_param_.data_param().source();
+  cache_order_.clear();
+  for (int i = solver_rank; i < cache_->size(); i += solver_count) {
+    cache_order_.push_back(i);
+  }
+  cache_pos_ = 0;
+  if (this->layer_param_.data_param().shuffle_keys()) {
+    cache_rng_.reset(new Caffe::RNG(caffe_rng_rand()));
+    caffe::rng_t* rng = static_cast<caffe::rng_t*>(cache_rng_->generator());
+    shuffle(cache_order_.begin(), cache_order_.end(), rng);
+  }
+
+  // Use the first cached record to initialize the top blob.
+  vector<int> top_shape =
+      this->data_transformer_->InferBlobShape(CachedImage(cache_order_[0]));
+  this->transformed_data_.Reshape(top_shape);
+  top_shape[0] = batch_size;
+  top[0]->Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
+  }
+  LOG(INFO) << "output data size: " << top[0]->num() << ","
+      << top[0]->channels() << "," << top[0]->height() << ","
+      << top[0]->width();
+
+  if (this->output_labels_) {
+    // The cache only keeps rboxes, so the label is always the rbox format.
+    has_anno_type_ = true;
+    anno_type_ = AnnotatedDatumR_AnnotationType_RBOX;
+    if (anno_data_param.has_anno_type()) {
+      anno_type_ = anno_data_param.anno_type();
+    }
+    CHECK_EQ(anno_type_, AnnotatedDatumR_AnnotationType_RBOX)
+        << "Unknown annotation type.";
+    vector<int> label_shape(4, 1);
+    label_shape[2] =
+        std::max(cache_->record(cache_order_[0]).num_rboxes, 1);
+    label_shape[3] = 7;
+    top[1]->Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
+    }
+    LOG(INFO) << "output label size: " << top[1]->num() << ","
+      << top[1]->channels() << "," << top[1]->height() << ","
+      << top[1]->width();
+  }
+#else
+  LOG(FATAL) << "cache_decoded requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+}
+
+template <typename Dtype>
+int AnnotatedRDataLayer<Dtype>::NextCachedRecord() {
+  const int record_id = cache_order_[cache_pos_++];
+  if (cache_pos_ == cache_order_.size()) {
+    cache_pos_ = 0;
+    if (cache_rng_) {
+      caffe::rng_t* rng = static_cast<caffe::rng_t*>(cache_rng_->generator());
+      shuffle(cache_order_.begin(), cache_order_.end(), rng);
+    }
+  }
+  return record_id;
+}
+
+#ifdef USE_OPENCV
+template <typename Dtype>
+cv::Mat AnnotatedRDataLayer<Dtype>::CachedImage(int i) const {
+  const RBoxDataCache::Record& record = cache_->record(i);
+  return cv::Mat(record.height, record.width, CV_8UC(record.channels),
+                 const_cast<uint8_t*>(cache_->image(i)));
+}
+#endif  // USE_OPENCV
+
 // This function is called on prefetch thread
 template<typename Dtype>
 void AnnotatedRDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
@@ -117,10 +215,17 @@ void AnnotatedRDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   // Reshape according to the first anno_datum of each batch
   // on single input batches allows for inputs of varying dimension.
   const int batch_size = this->layer_param_.data_param().batch_size();
-  AnnotatedDatumR& anno_datum = *(reader_.full().peek());
-  // Use data_transformer to infer the expected blob shape from anno_datum.
-  vector<int> top_shape =
-      this->data_transformer_->InferBlobShape(anno_datum.datum());
+  vector<int> top_shape;
+  if (cache_) {
+#ifdef USE_OPENCV
+    top_shape = this->data_transformer_->InferBlobShape(
+        CachedImage(cache_order_[cache_pos_]));
+#endif  // USE_OPENCV
+  } else {
+    AnnotatedDatumR& anno_datum = *(reader_->full().peek());
+    // Use data_transformer to infer the expected blob shape from anno_datum.
+    top_shape = this->data_transformer_->InferBlobShape(anno_datum.datum());
+  }
   this->transformed_data_.Reshape(top_shape);
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
@@ -132,57 +237,75 @@ void AnnotatedRDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     top_label = batch->label_.mutable_cpu_data();
   }
 
-  // Store transformed annotation.
-  map<int, vector<AnnotationGroupR> > all_anno;
-  int num_rboxes = 0;
+  // Store transformed annotation, 7 values per rbox.
+  vector<Dtype> rbox_rows;
 
   for (int item_id = 0; item_id < batch_size; ++item_id) {
+    const int offset = batch->data_.offset(item_id);
+    this->transformed_data_.set_cpu_data(top_data + offset);
+    if (cache_) {
+#ifdef USE_OPENCV
+      // Decoded records only need the transformation.
+      timer.Start();
+      const int record_id = NextCachedRecord();
+      this->data_transformer_->Transform(CachedImage(record_id),
+                                         &(this->transformed_data_));
+      if (this->output_labels_) {
+        const float* rows = cache_->rboxes(record_id);
+        const int num_rows = cache_->record(record_id).num_rboxes;
+        for (int r = 0; r < num_rows; ++r) {
+          rbox_rows.push_back(item_id);
+          for (int k = 0; k < RBoxDataCache::kRBoxRowSize; ++k) {
+            rbox_rows.push_back(rows[r * RBoxDataCache::kRBoxRowSize + k]);
+          }
+        }
+      }
+      trans_time += timer.MicroSeconds();
+#endif  // USE_OPENCV
+      continue;
+    }
     timer.Start();
     // get a anno_datum
-    AnnotatedDatumR& anno_datum = *(reader_.full().pop("Waiting for data"));
+    AnnotatedDatumR& anno_datum = *(reader_->full().pop("Waiting for data"));
     read_time += timer.MicroSeconds();
     timer.Start();
-   
-
-    vector<AnnotationGroupR> transformed_anno_vec;
+    this->data_transformer_->Transform(anno_datum.datum(),
+                                       &(this->transformed_data_));
     if (this->output_labels_) {
       if (has_anno_type_) {
         if (anno_type_ == AnnotatedDatumR_AnnotationType_RBOX) {
-        	int offset = batch->data_.offset(item_id);
-          this->transformed_data_.set_cpu_data(top_data + offset);
-		      this->data_transformer_->Transform(anno_datum.datum(), &(this->transformed_data_));
-		      for (int i = 0; i < anno_datum.annotation_group().size(); i++)
-		      {
-		  	    transformed_anno_vec.push_back(anno_datum.annotation_group(i));
-		      }
-          // Count the number of rboxes.
-          for (int g = 0; g < transformed_anno_vec.size(); ++g) {
-            num_rboxes += transformed_anno_vec[g].annotation_size();
+          for (int g = 0; g < anno_datum.annotation_group_size(); ++g) {
+            const AnnotationGroupR& anno_group = anno_datum.annotation_group(g);
+            for (int a = 0; a < anno_group.annotation_size(); ++a) {
+              const NormalizedRBox& rbox = anno_group.annotation(a).rbox();
+              rbox_rows.push_back(item_id);
+              rbox_rows.push_back(anno_group.group_label());
+              rbox_rows.push_back(rbox.xcenter());
+              rbox_rows.push_back(rbox.ycenter());
+              rbox_rows.push_back(rbox.angle());
+              rbox_rows.push_back(rbox.width());
+              rbox_rows.push_back(rbox.height());
+            }
           }
         } else {
           LOG(FATAL) << "Unknown annotation type.";
         }
-        all_anno[item_id] = transformed_anno_vec;
       } else {
-        this->data_transformer_->Transform(anno_datum.datum(),
-                                           &(this->transformed_data_));
         // Otherwise, store the label from datum.
         CHECK(anno_datum.datum().has_label()) << "Cannot find any label.";
         top_label[item_id] = anno_datum.datum().label();
       }
-    } else {
-      this->data_transformer_->Transform(anno_datum.datum(),
-                                         &(this->transformed_data_));
     }
     trans_time += timer.MicroSeconds();
 
-    reader_.free().push(const_cast<AnnotatedDatumR*>(&anno_datum));
+    reader_->free().push(const_cast<AnnotatedDatumR*>(&anno_datum));
   }
 
   // Store "rich" annotation if needed.
   if (this->output_labels_ && has_anno_type_) {
     vector<int> label_shape(4);
     if (anno_type_ == AnnotatedDatumR_AnnotationType_RBOX) {
+      const int num_rboxes = rbox_rows.size() / 7;
       label_shape[0] = 1;
       label_shape[1] = 1;
       label_shape[3] = 7;
@@ -195,30 +318,8 @@ void AnnotatedRDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
         // Reshape the label and store the annotation.
         label_shape[2] = num_rboxes;
         batch->label_.Reshape(label_shape);
-        top_label = batch->label_.mutable_cpu_data();
-        int idx = 0;
-        for (int item_id = 0; item_id < batch_size; ++item_id) {
-          const vector<AnnotationGroupR>& anno_vec = all_anno[item_id];
-          for (int g = 0; g < anno_vec.size(); ++g) {
-            const AnnotationGroupR& anno_group = anno_vec[g];
-            for (int a = 0; a < anno_group.annotation_size(); ++a) {
-              const AnnotationR& anno = anno_group.annotation(a);
-              const NormalizedRBox& rbox = anno.rbox();
-              top_label[idx++] = item_id;
-              top_label[idx++] = anno_group.group_label();
-              top_label[idx++] = rbox.xcenter();
-              top_label[idx++] = rbox.ycenter();
-              top_label[idx++] = rbox.angle();
-              top_label[idx++] = rbox.width();
-              top_label[idx++] = rbox.height();
-              //LOG(INFO)<<item_id<<" "<<anno_group.group_label();
-            }
-          }
-        }
-        idx = 0;
-        for (int i=0;i<label_shape[2];i++){
-            //LOG(INFO)<<top_label[idx++]<<" "<<top_label[idx++]<<" "<<top_label[idx++]<<" "<<top_label[idx++]<<" "<<top_label[idx++]<<" "<<top_label[idx++]<<" "<<top_label[idx++];
-          }
+        caffe_copy<Dtype>(rbox_rows.size(), &rbox_rows[0],
+                          batch->label_.mutable_cpu_data());
       }
     } else {
       LOG(FATAL) << "Unknown annotation type.";
@@ -229,6 +330,7 @@ void AnnotatedRDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  this->AddLoadTime(read_time, trans_time);
 }
 
 INSTANTIATE_CLASS(AnnotatedRDataLayer);
@@ -3,6 +3,8 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/gemm.hpp"
+#include "caffe/util/half_math.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -14,6 +16,10 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Configure the kernel size, padding, stride, and inputs.
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
   force_nd_im2col_ = conv_param.force_nd_im2col();
+  cpu_parallel_images_ = conv_param.cpu_parallel_images();
+  if (cpu_parallel_images_ == 0) {
+    cpu_parallel_images_ = Caffe::cpu_threads();
+  }
   channel_axis_ = bottom[0]->CanonicalAxisIndex(conv_param.axis());
   const int first_spatial_axis = channel_axis_ + 1;
   const int num_axes = bottom[0]->num_axes();
@@ -239,6 +245,26 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   col_buffer_.Reshape(col_buffer_shape_);
+  // Images convolved concurrently on CPU, limited by the memory of their
+  // column buffers. Each chunk of images must run its GEMMs on one thread,
+  // so a threaded BLAS that cannot be limited per thread keeps its cores.
+  parallel_images_ = std::min(cpu_parallel_images_, num_);
+  if (caffe_cpu_blas_threads() > 1 && !caffe_cpu_blas_has_local_threads()) {
+    parallel_images_ = 1;
+  }
+  if (!is_1x1_ && parallel_images_ > 1) {
+    const size_t col_bytes = col_buffer_.count() * sizeof(Dtype);
+    const size_t limit_bytes = static_cast<size_t>(
+        this->layer_param_.convolution_param().col_buffer_limit_mb()) << 20;
+    parallel_images_ = std::max(1, std::min(parallel_images_,
+        static_cast<int>(limit_bytes / std::max(col_bytes, size_t(1)))));
+    if (parallel_images_ > 1) {
+      vector<int> col_buffers_shape(1, parallel_images_);
+      col_buffers_shape.insert(col_buffers_shape.end(),
+          col_buffer_shape_.begin(), col_buffer_shape_.end());
+      col_buffers_.Reshape(col_buffers_shape);
+    }
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -253,15 +279,47 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::FoldChannelAffine(const vector<Dtype>& scale,
+    const vector<Dtype>& shift) {
+  CHECK(!reverse_dimensions()) << "Only convolution weights can be folded.";
+  CHECK_EQ(scale.size(), num_output_);
+  CHECK_EQ(shift.size(), num_output_);
+  if (!bias_term_) {
+    // The bias multiplier is set up by the next Reshape.
+    bias_term_ = true;
+    this->blobs_.resize(2);
+    this->blobs_[1].reset(new Blob<Dtype>(vector<int>(1, num_output_)));
+    caffe_set(num_output_, Dtype(0), this->blobs_[1]->mutable_cpu_data());
+    this->param_propagate_down_.resize(this->blobs_.size(), false);
+  }
+  // Weights are num_output_ x (channels_ / group_) x kernel, so every output
+  // channel owns one contiguous row.
+  const int kernel_count = this->blobs_[0]->count(1);
+  Dtype* weight = this->blobs_[0]->mutable_cpu_data();
+  Dtype* bias = this->blobs_[1]->mutable_cpu_data();
+  for (int k = 0; k < num_output_; ++k) {
+    caffe_scal(kernel_count, scale[k], weight + k * kernel_count);
+    bias[k] = bias[k] * scale[k] + shift[k];
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
+  Dtype* col_buff = is_1x1_ ? NULL : col_buffer_.mutable_cpu_data();
+  forward_cpu_gemm(input, weights, output, col_buff, skip_im2col);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
+    const Dtype* weights, Dtype* output, Dtype* col_buffer, bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buffer);
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = col_buffer;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -271,6 +329,22 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_half_gemm(const Dtype* input,
+    const uint16_t* weights, Dtype* output, Dtype* col_buffer) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    conv_im2col_cpu(input, col_buffer);
+    col_buff = col_buffer;
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm_half<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+        group_, conv_out_spatial_dim_, kernel_dim_,
+        (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
+        (Dtype)0., output + output_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -279,6 +353,116 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
       (Dtype)1., output);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_images(const Dtype* input,
+    const Dtype* weights, Dtype* output, const Dtype* bias) {
+  if (parallel_images_ <= 1) {
+    for (int n = 0; n < num_; ++n) {
+      forward_cpu_gemm(input + n * bottom_dim_, weights,
+          output + n * top_dim_);
+      if (bias) {
+        forward_cpu_bias(output + n * top_dim_, bias);
+      }
+    }
+    return;
+  }
+  // Fetch the buffers once so that no thread triggers a synchronization.
+  Dtype* col_buffers = is_1x1_ ? NULL : col_buffers_.mutable_cpu_data();
+  if (bias) {
+    bias_multiplier_.cpu_data();
+  }
+  const int chunks = parallel_images_;
+  #pragma omp parallel for num_threads(chunks)
+  for (int c = 0; c < chunks; ++c) {
+    const bool limit_blas = caffe_cpu_blas_threads() > 1;
+    const int blas_threads =
+        limit_blas ? caffe_set_cpu_blas_threads_local(1) : 0;
+    Dtype* col_buff =
+        is_1x1_ ? NULL : col_buffers + c * col_buffer_.count();
+    for (int n = c * num_ / chunks; n < (c + 1) * num_ / chunks; ++n) {
+      forward_cpu_gemm(input + n * bottom_dim_, weights,
+          output + n * top_dim_, col_buff, false);
+      if (bias) {
+        forward_cpu_bias(output + n * top_dim_, bias);
+      }
+    }
+    if (limit_blas) {
+      caffe_set_cpu_blas_threads_local(blas_threads);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_images(const Blob<Dtype>& bottom,
+    Blob<Dtype>* top) {
+  const Blob<Dtype>& weight = *this->blobs_[0];
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const bool half_bottom = bottom.data_in_half();
+  const bool half_top = top->data_in_half();
+  const bool half_weight = weight.data_in_half();
+  if (!half_bottom && !half_top && !half_weight) {
+    Dtype* top_data = top->mutable_cpu_data();
+    forward_cpu_gemm_images(bottom.cpu_data(), weight.cpu_data(), top_data,
+        bias);
+    forward_cpu_relu(top_data, top->count());
+    return;
+  }
+  // Fetch all data once so that no thread triggers a synchronization.
+  const Dtype* bottom_data = half_bottom ? NULL : bottom.cpu_data();
+  const uint16_t* bottom_half = half_bottom ? bottom.cpu_half_data() : NULL;
+  Dtype* top_data = half_top ? NULL : top->mutable_cpu_data();
+  uint16_t* top_half = half_top ? top->mutable_cpu_half_data() : NULL;
+  const Dtype* weight_data = half_weight ? NULL : weight.cpu_data();
+  const uint16_t* weight_half = half_weight ? weight.cpu_half_data() : NULL;
+  const int chunks = std::max(parallel_images_, 1);
+  const int bottom_buffer_dim = half_bottom ? bottom_dim_ : 0;
+  const int buffer_dim = bottom_buffer_dim + (half_top ? top_dim_ : 0);
+  Dtype* buffers = NULL;
+  if (buffer_dim > 0) {
+    half_buffers_.Reshape(vector<int>(1, chunks * buffer_dim));
+    buffers = half_buffers_.mutable_cpu_data();
+  }
+  Dtype* col_buffers = is_1x1_ ? NULL : chunks > 1 ?
+      col_buffers_.mutable_cpu_data() : col_buffer_.mutable_cpu_data();
+  if (bias) {
+    bias_multiplier_.cpu_data();
+  }
+  #pragma omp parallel for num_threads(chunks) if (chunks > 1)
+  for (int c = 0; c < chunks; ++c) {
+    const bool limit_blas = chunks > 1 && caffe_cpu_blas_threads() > 1;
+    const int blas_threads =
+        limit_blas ? caffe_set_cpu_blas_threads_local(1) : 0;
+    Dtype* buffer = buffers + c * buffer_dim;
+    Dtype* col_buff =
+        is_1x1_ ? NULL : col_buffers + c * col_buffer_.count();
+    for (int n = c * num_ / chunks; n < (c + 1) * num_ / chunks; ++n) {
+      const Dtype* input =
+          half_bottom ? buffer : bottom_data + n * bottom_dim_;
+      Dtype* output =
+          half_top ? buffer + bottom_buffer_dim : top_data + n * top_dim_;
+      if (half_bottom) {
+        caffe_cpu_half2float(bottom_dim_, bottom_half + n * bottom_dim_,
+            buffer);
+      }
+      if (half_weight) {
+        forward_cpu_half_gemm(input, weight_half, output, col_buff);
+      } else {
+        forward_cpu_gemm(input, weight_data, output, col_buff, false);
+      }
+      if (bias) {
+        forward_cpu_bias(output, bias);
+      }
+      forward_cpu_relu(output, top_dim_);
+      if (half_top) {
+        caffe_cpu_float2half(top_dim_, output, top_half + n * top_dim_);
+      }
+    }
+    if (limit_blas) {
+      caffe_set_cpu_blas_threads_local(blas_threads);
+    }
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
@@ -320,6 +504,19 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_relu(Dtype* output,
+    const int count) {
+  if (!fused_relu_) {
+    return;
+  }
+  const Dtype negative_slope = relu_negative_slope_;
+  for (int i = 0; i < count; ++i) {
+    output[i] = std::max(output[i], Dtype(0))
+        + negative_slope * std::min(output[i], Dtype(0));
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
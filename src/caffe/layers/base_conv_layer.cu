@@ -0,0 +1,32 @@
+#include <vector>
+
+#include "caffe/layers/base_conv_layer.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+__global__ void FusedReLUForward(const int n, Dtype* data,
+    Dtype negative_slope) {
+  CUDA_KERNEL_LOOP(index, n) {
+    data[index] = data[index] > 0 ? data[index] : data[index] * negative_slope;
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_gpu_relu(Dtype* output,
+    const int count) {
+  if (!fused_relu_) {
+    return;
+  }
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  FusedReLUForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, output, relu_negative_slope_);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template void BaseConvolutionLayer<float>::forward_gpu_relu(float* output,
+    const int count);
+template void BaseConvolutionLayer<double>::forward_gpu_relu(double* output,
+    const int count);
+
+}  // namespace caffe
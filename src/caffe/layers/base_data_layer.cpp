@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
@@ -38,9 +39,12 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
+      prefetch_(param.data_param().prefetch()),
       prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+  CHECK_GT(prefetch_.size(), 0) << "data_param.prefetch must be positive";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
@@ -52,18 +56,18 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
@@ -84,9 +88,17 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 
   try {
+    CPUTimer timer;
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
+      timer.Start();
       load_batch(batch);
+      timer.Stop();
+      {
+        boost::mutex::scoped_lock lock(stats_mutex_);
+        ++stats_.loaded;
+        stats_.load_time += timer.MilliSeconds();
+      }
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
@@ -105,10 +117,24 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::PopFullBatch() {
+  CPUTimer timer;
+  timer.Start();
+  const int full_queue = prefetch_full_.size();
+  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  timer.Stop();
+  boost::mutex::scoped_lock lock(stats_mutex_);
+  ++stats_.batches;
+  stats_.full_queue_sum += full_queue;
+  stats_.wait_time += timer.MilliSeconds();
+  return batch;
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = PopFullBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
@@ -126,6 +152,24 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
   prefetch_free_.push(batch);
 }
 
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::AddLoadTime(double read_time,
+    double transform_time) {
+  boost::mutex::scoped_lock lock(stats_mutex_);
+  stats_.read_time += read_time / 1000;
+  stats_.transform_time += transform_time / 1000;
+}
+
+template <typename Dtype>
+PrefetchStats BasePrefetchingDataLayer<Dtype>::prefetch_stats(bool reset) {
+  boost::mutex::scoped_lock lock(stats_mutex_);
+  PrefetchStats stats = stats_;
+  if (reset) {
+    stats_ = PrefetchStats();
+  }
+  return stats;
+}
+
 #ifdef CPU_ONLY
 STUB_GPU_FORWARD(BasePrefetchingDataLayer, Forward);
 #endif
@@ -19,6 +19,7 @@ void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
         this->forward_gpu_bias(top_data + n * this->top_dim_, bias);
       }
     }
+    this->forward_gpu_relu(top_data, top[i]->count());
   }
 }
 
@@ -231,6 +231,17 @@ void CuDNNConvolutionLayer<Dtype>::Reshape(
   }
 }
 
+template <typename Dtype>
+void CuDNNConvolutionLayer<Dtype>::FoldChannelAffine(const vector<Dtype>& scale,
+    const vector<Dtype>& shift) {
+  const bool had_bias = this->bias_term_;
+  ConvolutionLayer<Dtype>::FoldChannelAffine(scale, shift);
+  // The descriptor of a newly added bias is set by the next Reshape.
+  if (!had_bias && handles_setup_) {
+    cudnn::createTensor4dDesc<Dtype>(&bias_desc_);
+  }
+}
+
 template <typename Dtype>
 CuDNNConvolutionLayer<Dtype>::~CuDNNConvolutionLayer() {
   // Check that handles have been setup before destroying.
@@ -1,4 +1,3 @@
-#include <cfloat>
 #include <vector>
 
 #include "caffe/layers/eltwise_layer.hpp"
@@ -45,50 +44,59 @@ template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   int* mask = NULL;
-  const Dtype* bottom_data_a = NULL;
-  const Dtype* bottom_data_b = NULL;
   const int count = top[0]->count();
+  const int num_bottoms = bottom.size();
   Dtype* top_data = top[0]->mutable_cpu_data();
+  // Fetch the bottoms once so that no thread triggers a synchronization.
+  vector<const Dtype*> bottom_data(num_bottoms);
+  for (int i = 0; i < num_bottoms; ++i) {
+    bottom_data[i] = bottom[i]->cpu_data();
+  }
+  const Dtype* const* bottoms = &bottom_data[0];
+  const Dtype* coeffs = &coeffs_[0];
+  // Every output only depends on the same element of the bottoms, so the
+  // elements are computed in parallel.
   switch (op_) {
   case EltwiseParameter_EltwiseOp_PROD:
-    caffe_mul(count, bottom[0]->cpu_data(), bottom[1]->cpu_data(), top_data);
-    for (int i = 2; i < bottom.size(); ++i) {
-      caffe_mul(count, top_data, bottom[i]->cpu_data(), top_data);
+    #pragma omp parallel for if (count > 32768)
+    for (int idx = 0; idx < count; ++idx) {
+      Dtype prod = bottoms[0][idx] * bottoms[1][idx];
+      for (int i = 2; i < num_bottoms; ++i) {
+        prod *= bottoms[i][idx];
+      }
+      top_data[idx] = prod;
     }
     break;
   case EltwiseParameter_EltwiseOp_SUM:
-    caffe_set(count, Dtype(0), top_data);
-    // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
-    for (int i = 0; i < bottom.size(); ++i) {
-      caffe_axpy(count, coeffs_[i], bottom[i]->cpu_data(), top_data);
+    #pragma omp parallel for if (count > 32768)
+    for (int idx = 0; idx < count; ++idx) {
+      Dtype sum = 0;
+      for (int i = 0; i < num_bottoms; ++i) {
+        sum += coeffs[i] * bottoms[i][idx];
+      }
+      top_data[idx] = sum;
     }
     break;
   case EltwiseParameter_EltwiseOp_MAX:
-    // Initialize
     mask = max_idx_.mutable_cpu_data();
-    caffe_set(count, -1, mask);
-    caffe_set(count, Dtype(-FLT_MAX), top_data);
-    // bottom 0 & 1
-    bottom_data_a = bottom[0]->cpu_data();
-    bottom_data_b = bottom[1]->cpu_data();
+    #pragma omp parallel for if (count > 32768)
     for (int idx = 0; idx < count; ++idx) {
-      if (bottom_data_a[idx] > bottom_data_b[idx]) {
-        top_data[idx] = bottom_data_a[idx];  // maxval
-        mask[idx] = 0;  // maxid
-      } else {
-        top_data[idx] = bottom_data_b[idx];  // maxval
-        mask[idx] = 1;  // maxid
+      // bottom 0 & 1
+      Dtype maxval = bottoms[1][idx];
+      int maxid = 1;
+      if (bottoms[0][idx] > maxval) {
+        maxval = bottoms[0][idx];
+        maxid = 0;
       }
-    }
-    // bottom 2++
-    for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
-      bottom_data_b = bottom[blob_idx]->cpu_data();
-      for (int idx = 0; idx < count; ++idx) {
-        if (bottom_data_b[idx] > top_data[idx]) {
-          top_data[idx] = bottom_data_b[idx];  // maxval
-          mask[idx] = blob_idx;  // maxid
+      // bottom 2++
+      for (int i = 2; i < num_bottoms; ++i) {
+        if (bottoms[i][idx] > maxval) {
+          maxval = bottoms[i][idx];
+          maxid = i;
         }
       }
+      top_data[idx] = maxval;
+      mask[idx] = maxid;
     }
     break;
   default:
@@ -2,6 +2,7 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/gemm.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -83,12 +84,27 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  const Blob<Dtype>& weight = *this->blobs_[0];
+  const CBLAS_TRANSPOSE trans_weight = transpose_ ? CblasNoTrans : CblasTrans;
+  // A bottom or weights stored in half precision are converted while the
+  // GEMM packs them.
+  if (bottom[0]->data_in_half() && weight.data_in_half()) {
+    caffe_cpu_gemm_half<Dtype>(CblasNoTrans, trans_weight, M_, N_, K_,
+        (Dtype)1., bottom[0]->cpu_half_data(), weight.cpu_half_data(),
+        (Dtype)0., top_data);
+  } else if (bottom[0]->data_in_half()) {
+    caffe_cpu_gemm_half<Dtype>(CblasNoTrans, trans_weight, M_, N_, K_,
+        (Dtype)1., bottom[0]->cpu_half_data(), weight.cpu_data(),
+        (Dtype)0., top_data);
+  } else if (weight.data_in_half()) {
+    caffe_cpu_gemm_half<Dtype>(CblasNoTrans, trans_weight, M_, N_, K_,
+        (Dtype)1., bottom[0]->cpu_data(), weight.cpu_half_data(),
+        (Dtype)0., top_data);
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, trans_weight, M_, N_, K_, (Dtype)1.,
+        bottom[0]->cpu_data(), weight.cpu_data(), (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -145,6 +161,5 @@ STUB_GPU(InnerProductLayer);
 #endif
 
 INSTANTIATE_CLASS(InnerProductLayer);
-REGISTER_LAYER_CLASS(InnerProduct);
 
 }  // namespace caffe
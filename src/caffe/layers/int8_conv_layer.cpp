@@ -0,0 +1,91 @@
+#include <vector>
+
+#include "caffe/layers/int8_conv_layer.hpp"
+#include "caffe/util/int8_math.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  CHECK_GT(quant_param.bottom_max(), 0)
+      << "Layer " << this->layer_param_.name() << " is not calibrated.";
+  bottom_scale_ = Dtype(127) / quant_param.bottom_max();
+  use_int8_ = this->num_spatial_axes_ == 2 && !this->force_nd_im2col_;
+  if (!use_int8_) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " is not a 2D "
+        << "convolution; it runs in floating point.";
+  }
+}
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!use_int8_) {
+    return;
+  }
+  group_outputs_ = this->num_output_ / this->group_;
+  group_kernel_dim_ = this->blobs_[0]->count(1);
+  out_spatial_dim_ = this->output_shape_[0] * this->output_shape_[1];
+  weight_int8_.resize(this->blobs_[0]->count());
+  weight_scale_.resize(this->num_output_);
+  bottom_int8_.resize(this->bottom_dim_);
+  row_buffer_.resize(out_spatial_dim_ * group_kernel_dim_);
+  product_.resize(group_outputs_ * out_spatial_dim_);
+}
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_int8_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  caffe_cpu_quantize_rows_s8(this->num_output_, group_kernel_dim_,
+      this->blobs_[0]->cpu_data(), &weight_int8_[0], &weight_scale_[0]);
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int group_channels = this->channels_ / this->group_;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      caffe_cpu_quantize_s8(this->bottom_dim_,
+          bottom_data + n * this->bottom_dim_, bottom_scale_,
+          &bottom_int8_[0]);
+      for (int g = 0; g < this->group_; ++g) {
+        im2row_s8_cpu(&bottom_int8_[g * group_channels * height * width],
+            group_channels, height, width, kernel_shape[0], kernel_shape[1],
+            pad[0], pad[1], stride[0], stride[1], dilation[0], dilation[1],
+            &row_buffer_[0]);
+        caffe_cpu_gemm_s8(group_outputs_, out_spatial_dim_, group_kernel_dim_,
+            &weight_int8_[g * group_outputs_ * group_kernel_dim_],
+            &row_buffer_[0], &product_[0]);
+        for (int m = 0; m < group_outputs_; ++m) {
+          const int o = g * group_outputs_ + m;
+          const Dtype scale = 1 / (bottom_scale_ * weight_scale_[o]);
+          const Dtype shift = bias ? bias[o] : Dtype(0);
+          const int32_t* product = &product_[m * out_spatial_dim_];
+          Dtype* output = top_data + n * this->top_dim_ + o * out_spatial_dim_;
+          for (int p = 0; p < out_spatial_dim_; ++p) {
+            output[p] = product[p] * scale + shift;
+          }
+        }
+      }
+    }
+    this->forward_cpu_relu(top_data, top[i]->count());
+  }
+}
+
+INSTANTIATE_CLASS(Int8ConvolutionLayer);
+
+}  // namespace caffe
@@ -0,0 +1,66 @@
+#include <vector>
+
+#include "caffe/layers/int8_inner_product_layer.hpp"
+#include "caffe/util/int8_math.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  InnerProductLayer<Dtype>::LayerSetUp(bottom, top);
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  CHECK_GT(quant_param.bottom_max(), 0)
+      << "Layer " << this->layer_param_.name() << " is not calibrated.";
+  bottom_scale_ = Dtype(127) / quant_param.bottom_max();
+  weight_int8_.resize(this->N_ * this->K_);
+  weight_scale_.resize(this->N_);
+  if (this->transpose_) {
+    weight_buffer_.resize(this->N_ * this->K_);
+  }
+}
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  InnerProductLayer<Dtype>::Reshape(bottom, top);
+  bottom_int8_.resize(this->M_ * this->K_);
+  product_.resize(this->M_ * this->N_);
+}
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int M = this->M_;
+  const int N = this->N_;
+  const int K = this->K_;
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (this->transpose_) {
+    // Weights are K x N; quantize them as N rows of K.
+    for (int k = 0; k < K; ++k) {
+      for (int n = 0; n < N; ++n) {
+        weight_buffer_[n * K + k] = weight[k * N + n];
+      }
+    }
+    weight = &weight_buffer_[0];
+  }
+  caffe_cpu_quantize_rows_s8(N, K, weight, &weight_int8_[0],
+      &weight_scale_[0]);
+  caffe_cpu_quantize_s8(M * K, bottom[0]->cpu_data(), bottom_scale_,
+      &bottom_int8_[0]);
+  caffe_cpu_gemm_s8(M, N, K, &bottom_int8_[0], &weight_int8_[0],
+      &product_[0]);
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      top_data[m * N + n] = product_[m * N + n] /
+          (bottom_scale_ * weight_scale_[n]) + (bias ? bias[n] : Dtype(0));
+    }
+  }
+}
+
+INSTANTIATE_CLASS(Int8InnerProductLayer);
+
+}  // namespace caffe
@@ -110,45 +110,45 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
+  const int plane_size = height_ * width_;
+  const int image_size = channels_ * plane_size;
   Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
-    }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
+  // go through the images in parallel, each thread with its own padded square
+  #pragma omp parallel if (num_ > 1 && scale_.count() > 4096)
+  {
+    vector<Dtype> padded_square((channels_ + size_ - 1) * plane_size, 0);
+    #pragma omp for
+    for (int n = 0; n < num_; ++n) {
+      Dtype* scale_image = scale_data + scale_.offset(n);
+      // compute the padded square
+      caffe_sqr(image_size, bottom_data + bottom[0]->offset(n),
+          &padded_square[pre_pad_ * plane_size]);
+      // Create the first channel scale, starting with the constant value
+      caffe_set(plane_size, k_, scale_image);
+      for (int c = 0; c < size_; ++c) {
+        caffe_axpy<Dtype>(plane_size, alpha_over_size,
+            &padded_square[c * plane_size], scale_image);
+      }
+      for (int c = 1; c < channels_; ++c) {
+        // copy previous scale
+        caffe_copy<Dtype>(plane_size, scale_image + (c - 1) * plane_size,
+            scale_image + c * plane_size);
+        // add head
+        caffe_axpy<Dtype>(plane_size, alpha_over_size,
+            &padded_square[(c + size_ - 1) * plane_size],
+            scale_image + c * plane_size);
+        // subtract tail
+        caffe_axpy<Dtype>(plane_size, -alpha_over_size,
+            &padded_square[(c - 1) * plane_size],
+            scale_image + c * plane_size);
+      }
+      // compute the output of the image while its scale is in cache
+      Dtype* top_image = top_data + top[0]->offset(n);
+      caffe_powx<Dtype>(image_size, scale_image, -beta_, top_image);
+      caffe_mul<Dtype>(image_size, top_image,
+          bottom_data + bottom[0]->offset(n), top_image);
     }
   }
-
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
 }
 
 template <typename Dtype>
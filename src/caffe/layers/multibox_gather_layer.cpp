@@ -0,0 +1,74 @@
+#include <vector>
+
+#include "caffe/layers/multibox_gather_layer.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void MultiBoxGatherLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const int num = bottom[0]->num();
+  offsets_.resize(bottom.size());
+  int dim = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    CHECK_EQ(bottom[i]->num_axes(), 4) << "Bottoms must be N x C x H x W.";
+    CHECK_EQ(bottom[i]->num(), num) << "Bottoms must have the same num.";
+    offsets_[i] = dim;
+    dim += bottom[i]->count(1);
+  }
+  vector<int> top_shape(2, num);
+  top_shape[1] = dim;
+  top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void MultiBoxGatherLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int top_dim = top[0]->count(1);
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    const int channels = bottom[i]->channels();
+    const int spatial_dim = bottom[i]->count(2);
+    for (int n = 0; n < bottom[i]->num(); ++n) {
+      const Dtype* src = bottom_data + n * channels * spatial_dim;
+      Dtype* dst = top_data + n * top_dim + offsets_[i];
+      for (int s = 0; s < spatial_dim; ++s) {
+        for (int c = 0; c < channels; ++c) {
+          dst[s * channels + c] = src[c * spatial_dim + s];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void MultiBoxGatherLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const int top_dim = top[0]->count(1);
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (!propagate_down[i]) { continue; }
+    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+    const int channels = bottom[i]->channels();
+    const int spatial_dim = bottom[i]->count(2);
+    for (int n = 0; n < bottom[i]->num(); ++n) {
+      const Dtype* src = top_diff + n * top_dim + offsets_[i];
+      Dtype* dst = bottom_diff + n * channels * spatial_dim;
+      for (int c = 0; c < channels; ++c) {
+        for (int s = 0; s < spatial_dim; ++s) {
+          dst[c * spatial_dim + s] = src[s * channels + c];
+        }
+      }
+    }
+  }
+}
+
+#ifdef CPU_ONLY
+STUB_GPU(MultiBoxGatherLayer);
+#endif
+
+INSTANTIATE_CLASS(MultiBoxGatherLayer);
+REGISTER_LAYER_CLASS(MultiBoxGather);
+
+}  // namespace caffe
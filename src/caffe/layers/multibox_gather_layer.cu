@@ -0,0 +1,60 @@
+#include <vector>
+
+#include "caffe/layers/multibox_gather_layer.hpp"
+
+namespace caffe {
+
+// Moves one bottom between N x C x S and its N x (S * C) slice of the top.
+template <typename Dtype>
+__global__ void MultiBoxGatherKernel(const int nthreads, const bool forward,
+    const int channels, const int spatial_dim, const int top_dim,
+    const int offset, Dtype* const bottom, Dtype* const top) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int s = index % spatial_dim;
+    const int c = (index / spatial_dim) % channels;
+    const int n = index / spatial_dim / channels;
+    const int top_index = n * top_dim + offset + s * channels + c;
+    if (forward) {
+      top[top_index] = bottom[index];
+    } else {
+      bottom[index] = top[top_index];
+    }
+  }
+}
+
+template <typename Dtype>
+void MultiBoxGatherLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  Dtype* top_data = top[0]->mutable_gpu_data();
+  const int top_dim = top[0]->count(1);
+  for (int i = 0; i < bottom.size(); ++i) {
+    Dtype* bottom_data = const_cast<Dtype*>(bottom[i]->gpu_data());
+    const int count = bottom[i]->count();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    MultiBoxGatherKernel<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, true, bottom[i]->channels(),
+        bottom[i]->count(2), top_dim, offsets_[i], bottom_data, top_data);
+    CUDA_POST_KERNEL_CHECK;
+  }
+}
+
+template <typename Dtype>
+void MultiBoxGatherLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  Dtype* top_diff = const_cast<Dtype*>(top[0]->gpu_diff());
+  const int top_dim = top[0]->count(1);
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (!propagate_down[i]) { continue; }
+    Dtype* bottom_diff = bottom[i]->mutable_gpu_diff();
+    const int count = bottom[i]->count();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    MultiBoxGatherKernel<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, false, bottom[i]->channels(),
+        bottom[i]->count(2), top_dim, offsets_[i], bottom_diff, top_diff);
+    CUDA_POST_KERNEL_CHECK;
+  }
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(MultiBoxGatherLayer);
+
+}  // namespace caffe
@@ -2,6 +2,7 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/normalize_layer.hpp"
+#include "caffe/util/half_math.hpp"
 
 namespace caffe {
 
@@ -68,6 +69,8 @@ void NormalizeLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top[0]->ReshapeLike(*bottom[0]);
   buffer_.Reshape(1, bottom[0]->channels(),
                    bottom[0]->height(), bottom[0]->width());
+  half_buffer_.Reshape(2, bottom[0]->channels(),
+                       bottom[0]->height(), bottom[0]->width());
   if (!across_spatial_) {
     norm_.Reshape(bottom[0]->num(), 1, bottom[0]->height(), bottom[0]->width());
   }
@@ -84,8 +87,16 @@ void NormalizeLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void NormalizeLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
+  // Images stored in half precision are normalized one at a time through
+  // float buffers.
+  const bool half_bottom = bottom[0]->data_in_half();
+  const bool half_top = top[0]->data_in_half();
+  const Dtype* bottom_data = half_bottom ? NULL : bottom[0]->cpu_data();
+  const uint16_t* bottom_half = half_bottom ? bottom[0]->cpu_half_data() : NULL;
+  Dtype* top_data = half_top ? NULL : top[0]->mutable_cpu_data();
+  uint16_t* top_half = half_top ? top[0]->mutable_cpu_half_data() : NULL;
+  Dtype* half_buffer = half_bottom || half_top ?
+      half_buffer_.mutable_cpu_data() : NULL;
   const Dtype* scale = this->blobs_[0]->cpu_data();
   Dtype* buffer_data = buffer_.mutable_cpu_data();
   Dtype* norm_data = norm_.mutable_cpu_data();
@@ -98,13 +109,19 @@ void NormalizeLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   int spatial_dim = bottom[0]->height() * bottom[0]->width();
   int channels = bottom[0]->channels();
   for (int n = 0; n < num; ++n) {
-    caffe_sqr<Dtype>(dim, bottom_data, buffer_data);
+    const Dtype* bottom_image =
+        half_bottom ? half_buffer : bottom_data + n * dim;
+    Dtype* top_image = half_top ? half_buffer + dim : top_data + n * dim;
+    if (half_bottom) {
+      caffe_cpu_half2float(dim, bottom_half + n * dim, half_buffer);
+    }
+    caffe_sqr<Dtype>(dim, bottom_image, buffer_data);
     if (across_spatial_) {
       // add eps to avoid overflow
       norm_data[n] = pow(caffe_cpu_asum<Dtype>(dim, buffer_data)+eps_,
                          Dtype(0.5));
-      caffe_cpu_scale<Dtype>(dim, Dtype(1.0 / norm_data[n]), bottom_data,
-                             top_data);
+      caffe_cpu_scale<Dtype>(dim, Dtype(1.0 / norm_data[n]), bottom_image,
+                             top_image);
     } else {
       caffe_cpu_gemv<Dtype>(CblasTrans, channels, spatial_dim, Dtype(1),
                             buffer_data, sum_channel_multiplier, Dtype(1),
@@ -115,21 +132,22 @@ void NormalizeLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, spatial_dim,
                             1, Dtype(1), sum_channel_multiplier, norm_data,
                             Dtype(0), buffer_data);
-      caffe_div<Dtype>(dim, bottom_data, buffer_data, top_data);
+      caffe_div<Dtype>(dim, bottom_image, buffer_data, top_image);
       norm_data += spatial_dim;
     }
     // scale the output
     if (channel_shared_) {
-      caffe_scal<Dtype>(dim, scale[0], top_data);
+      caffe_scal<Dtype>(dim, scale[0], top_image);
     } else {
       caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, spatial_dim,
                             1, Dtype(1), scale, sum_spatial_multiplier,
                             Dtype(0),
                             buffer_data);
-      caffe_mul<Dtype>(dim, top_data, buffer_data, top_data);
+      caffe_mul<Dtype>(dim, top_image, buffer_data, top_image);
+    }
+    if (half_top) {
+      caffe_cpu_float2half(dim, top_image, top_half + n * dim);
     }
-    bottom_data += dim;
-    top_data += dim;
   }
 }
 
@@ -1,6 +1,11 @@
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/permute_layer.hpp"
+#include "caffe/util/half_math.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -25,6 +30,71 @@ void Permute(const int count, Dtype* bottom_data, const bool forward,
     }
 }
 
+// Transposes a rows x cols block at (r0, c0) of src (row stride src_stride)
+// into dst (row stride dst_stride): dst[c][r] = src[r][c]. Either may be
+// stored in half precision, and is converted on the way.
+template <typename SrcType, typename DstType>
+static void TransposeBlock(const SrcType* src, const int src_stride,
+    DstType* dst, const int dst_stride, const int r0, const int r1,
+    const int c0, const int c1) {
+  for (int r = r0; r < r1; ++r) {
+    for (int c = c0; c < c1; ++c) {
+      dst[c * dst_stride + r] =
+          caffe_half_cast<DstType>(src[r * src_stride + c]);
+    }
+  }
+}
+
+#ifdef __SSE__
+// Transposes 4x4 sub-blocks in registers, leaving the ragged edges to the
+// scalar loop.
+static void TransposeBlock(const float* src, const int src_stride,
+    float* dst, const int dst_stride, const int r0, const int r1,
+    const int c0, const int c1) {
+  const int r4 = r0 + (r1 - r0) / 4 * 4;
+  const int c4 = c0 + (c1 - c0) / 4 * 4;
+  for (int r = r0; r < r4; r += 4) {
+    for (int c = c0; c < c4; c += 4) {
+      __m128 row0 = _mm_loadu_ps(src + r * src_stride + c);
+      __m128 row1 = _mm_loadu_ps(src + (r + 1) * src_stride + c);
+      __m128 row2 = _mm_loadu_ps(src + (r + 2) * src_stride + c);
+      __m128 row3 = _mm_loadu_ps(src + (r + 3) * src_stride + c);
+      _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+      _mm_storeu_ps(dst + c * dst_stride + r, row0);
+      _mm_storeu_ps(dst + (c + 1) * dst_stride + r, row1);
+      _mm_storeu_ps(dst + (c + 2) * dst_stride + r, row2);
+      _mm_storeu_ps(dst + (c + 3) * dst_stride + r, row3);
+    }
+  }
+  for (int r = r0; r < r1; ++r) {
+    for (int c = (r < r4 ? c4 : c0); c < c1; ++c) {
+      dst[c * dst_stride + r] = src[r * src_stride + c];
+    }
+  }
+}
+#endif  // __SSE__
+
+// Transposes batch matrices of rows x cols from src into dst, one cache-sized
+// tile at a time.
+template <typename SrcType, typename DstType>
+void BatchTranspose(const int batch, const int rows, const int cols,
+    const SrcType* src, DstType* dst) {
+  const int kTile = 32;
+  const int row_tiles = (rows + kTile - 1) / kTile;
+  #pragma omp parallel for
+  for (int t = 0; t < batch * row_tiles; ++t) {
+    const int n = t / row_tiles;
+    const int r0 = (t % row_tiles) * kTile;
+    const int r1 = std::min(r0 + kTile, rows);
+    const SrcType* src_n = src + n * rows * cols;
+    DstType* dst_n = dst + n * rows * cols;
+    for (int c0 = 0; c0 < cols; c0 += kTile) {
+      TransposeBlock(src_n, cols, dst_n, rows, r0, r1, c0,
+          std::min(c0 + kTile, cols));
+    }
+  }
+}
+
 template <typename Dtype>
 void PermuteLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -92,19 +162,92 @@ void PermuteLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       new_steps_.mutable_cpu_data()[i] = top[0]->count(i + 1);
     }
   }
+
+  // Ignoring unit axes and merging axes that stay adjacent and in order,
+  // most permutations (e.g. NCHW <-> NHWC) reduce to a batched transpose.
+  const int* permute_order = permute_order_.cpu_data();
+  vector<int> group_start, group_end;  // bottom axes of each top group
+  for (int i = 0; i < num_axes_; ++i) {
+    const int axis = permute_order[i];
+    if (bottom[0]->shape(axis) == 1) {
+      continue;
+    }
+    int next_axis = group_end.empty() ? -1 : group_end.back() + 1;
+    while (next_axis > 0 && next_axis < num_axes_ &&
+           bottom[0]->shape(next_axis) == 1) {
+      ++next_axis;
+    }
+    if (axis == next_axis) {
+      group_end.back() = axis;
+    } else {
+      group_start.push_back(axis);
+      group_end.push_back(axis);
+    }
+  }
+  vector<int> group_size(group_start.size());
+  for (int g = 0; g < group_start.size(); ++g) {
+    group_size[g] = bottom[0]->count(group_start[g], group_end[g] + 1);
+  }
+  use_transpose_ = true;
+  if (group_start.size() <= 1) {
+    transpose_batch_ = 1;
+    transpose_rows_ = 1;
+    transpose_cols_ = bottom[0]->count();
+  } else if (group_start.size() == 2 && group_start[0] > group_start[1]) {
+    transpose_batch_ = 1;
+    transpose_rows_ = group_size[1];
+    transpose_cols_ = group_size[0];
+  } else if (group_start.size() == 3 && group_start[0] < group_start[2] &&
+             group_start[2] < group_start[1]) {
+    transpose_batch_ = group_size[0];
+    transpose_rows_ = group_size[2];
+    transpose_cols_ = group_size[1];
+  } else {
+    use_transpose_ = false;
+  }
 }
 
 template <typename Dtype>
 void PermuteLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   if (need_permute_) {
-    Dtype* bottom_data = bottom[0]->mutable_cpu_data();
-    Dtype* top_data = top[0]->mutable_cpu_data();
+    const bool half_bottom = bottom[0]->data_in_half();
+    const bool half_top = top[0]->data_in_half();
     const int top_count = top[0]->count();
     const int* permute_order = permute_order_.cpu_data();
     const int* old_steps = old_steps_.cpu_data();
     const int* new_steps = new_steps_.cpu_data();
     bool forward = true;
+    if (use_transpose_) {
+      // Blobs stored in half precision are transposed as they are, or
+      // converted on the way.
+      const int batch = transpose_batch_;
+      const int rows = transpose_rows_;
+      const int cols = transpose_cols_;
+      if (half_bottom && half_top) {
+        BatchTranspose(batch, rows, cols, bottom[0]->cpu_half_data(),
+            top[0]->mutable_cpu_half_data());
+      } else if (half_bottom) {
+        BatchTranspose(batch, rows, cols, bottom[0]->cpu_half_data(),
+            top[0]->mutable_cpu_data());
+      } else if (half_top) {
+        BatchTranspose(batch, rows, cols, bottom[0]->cpu_data(),
+            top[0]->mutable_cpu_half_data());
+      } else {
+        BatchTranspose(batch, rows, cols, bottom[0]->cpu_data(),
+            top[0]->mutable_cpu_data());
+      }
+      return;
+    }
+    if (half_bottom && half_top) {
+      Permute(top_count, const_cast<uint16_t*>(bottom[0]->cpu_half_data()),
+          forward, permute_order, old_steps, new_steps, num_axes_,
+          top[0]->mutable_cpu_half_data());
+      return;
+    }
+    // Otherwise a blob stored in half precision goes through its float data.
+    Dtype* bottom_data = bottom[0]->mutable_cpu_data();
+    Dtype* top_data = top[0]->mutable_cpu_data();
     Permute(top_count, bottom_data, forward, permute_order, old_steps,
             new_steps, num_axes_, top_data);
   } else {
@@ -124,6 +267,11 @@ void PermuteLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const int* old_steps = old_steps_.cpu_data();
     const int* new_steps = new_steps_.cpu_data();
     bool forward = false;
+    if (use_transpose_) {
+      BatchTranspose(transpose_batch_, transpose_cols_, transpose_rows_,
+          top[0]->cpu_diff(), bottom_diff);
+      return;
+    }
     Permute(top_count, bottom_diff, forward, permute_order, old_steps,
             new_steps, num_axes_, top_diff);
   } else {
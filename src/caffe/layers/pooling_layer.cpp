@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/half_math.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -124,99 +125,91 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
 // TODO(Yangqing): Is there a faster way to do pooling in the channel-first
 // case?
+template <typename Dtype>
+void PoolingLayer<Dtype>::ForwardMaxPlane_cpu(const Dtype* bottom, Dtype* top,
+    Dtype* top_mask, int* mask) {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = min(hstart + kernel_h_, height_);
+      int wend = min(wstart + kernel_w_, width_);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      Dtype max_value = -FLT_MAX;
+      int max_index = -1;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const int index = h * width_ + w;
+          if (bottom[index] > max_value) {
+            max_value = bottom[index];
+            max_index = index;
+          }
+        }
+      }
+      const int pool_index = ph * pooled_width_ + pw;
+      top[pool_index] = max_value;
+      if (top_mask) {
+        top_mask[pool_index] = static_cast<Dtype>(max_index);
+      } else {
+        mask[pool_index] = max_index;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ForwardAvePlane_cpu(const Dtype* bottom,
+    Dtype* top) {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = min(hstart + kernel_h_, height_ + pad_h_);
+      int wend = min(wstart + kernel_w_, width_ + pad_w_);
+      int pool_size = (hend - hstart) * (wend - wstart);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      hend = min(hend, height_);
+      wend = min(wend, width_);
+      Dtype sum = 0;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          sum += bottom[h * width_ + w];
+        }
+      }
+      top[ph * pooled_width_ + pw] = sum / pool_size;
+    }
+  }
+}
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
+  const PoolingParameter_PoolMethod pool =
+      this->layer_param_.pooling_param().pool();
+  // Blobs stored in half precision are pooled one plane at a time through
+  // float buffers, so that the memory traffic is halved.
+  const bool half_bottom = bottom[0]->data_in_half();
+  const bool half_top = top[0]->data_in_half();
+  const Dtype* bottom_data = half_bottom ? NULL : bottom[0]->cpu_data();
+  const uint16_t* bottom_half = half_bottom ? bottom[0]->cpu_half_data() : NULL;
+  Dtype* top_data = half_top ? NULL : top[0]->mutable_cpu_data();
+  uint16_t* top_half = half_top ? top[0]->mutable_cpu_half_data() : NULL;
   const int top_count = top[0]->count();
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
   int* mask = NULL;  // suppress warnings about uninitalized variables
   Dtype* top_mask = NULL;
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more code.
-  switch (this->layer_param_.pooling_param().pool()) {
+  switch (pool) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
     if (use_top_mask) {
       top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
     } else {
       mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
-    }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
-      }
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-      }
-    }
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
@@ -224,6 +217,37 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   default:
     LOG(FATAL) << "Unknown pooling method.";
   }
+  // The (n, c) planes are pooled independently, in parallel.
+  const int num_planes = bottom[0]->num() * channels_;
+  const int bottom_plane_size = bottom[0]->offset(0, 1);
+  const int top_plane_size = top[0]->offset(0, 1);
+  #pragma omp parallel if (top_count > 4096)
+  {
+    vector<Dtype> bottom_buffer(half_bottom ? bottom_plane_size : 0);
+    vector<Dtype> top_buffer(half_top ? top_plane_size : 0);
+    #pragma omp for
+    for (int nc = 0; nc < num_planes; ++nc) {
+      const Dtype* bottom_plane = half_bottom ?
+          &bottom_buffer[0] : bottom_data + nc * bottom_plane_size;
+      if (half_bottom) {
+        caffe_cpu_half2float(bottom_plane_size,
+            bottom_half + nc * bottom_plane_size, &bottom_buffer[0]);
+      }
+      Dtype* top_plane =
+          half_top ? &top_buffer[0] : top_data + nc * top_plane_size;
+      if (pool == PoolingParameter_PoolMethod_MAX) {
+        ForwardMaxPlane_cpu(bottom_plane, top_plane,
+            use_top_mask ? top_mask + nc * top_plane_size : NULL,
+            use_top_mask ? NULL : mask + nc * top_plane_size);
+      } else {
+        ForwardAvePlane_cpu(bottom_plane, top_plane);
+      }
+      if (half_top) {
+        caffe_cpu_float2half(top_plane_size, top_plane,
+            top_half + nc * top_plane_size);
+      }
+    }
+  }
 }
 
 template <typename Dtype>
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "caffe/layers/rdetection_evaluate_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rbox_util.hpp"
+
+namespace caffe
+{
+
+static bool SortRBoxDescend(const NormalizedRBox& rbox1,
+	const NormalizedRBox& rbox2)
+{
+	return rbox1.score() > rbox2.score();
+}
+
+template <typename Dtype>
+void RDetectionEvaluateLayer<Dtype>::LayerSetUp(
+	const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top)
+{
+	const RDetectionEvaluateParameter& rdetection_evaluate_param =
+		this->layer_param_.rdetection_evaluate_param();
+	CHECK(rdetection_evaluate_param.has_num_classes())
+		<< "Must provide num_classes.";
+	num_classes_ = rdetection_evaluate_param.num_classes();
+	background_label_id_ = rdetection_evaluate_param.background_label_id();
+	overlap_threshold_ = rdetection_evaluate_param.overlap_threshold();
+	CHECK_GT(overlap_threshold_, 0.) << "overlap_threshold must be non negative.";
+	// Rotated ground truth carries no difficult flag, and the normalized rboxes
+	// are compared as they are.
+	if (rdetection_evaluate_param.has_name_size_file() ||
+		rdetection_evaluate_param.has_resize_param())
+	{
+		LOG(WARNING) << "RDetectionEvaluate compares normalized rboxes; "
+			<< "name_size_file and resize_param are ignored.";
+	}
+}
+
+template <typename Dtype>
+void RDetectionEvaluateLayer<Dtype>::Reshape(
+	const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top)
+{
+	CHECK_EQ(bottom[0]->num(), 1);
+	CHECK_EQ(bottom[0]->channels(), 1);
+	CHECK_EQ(bottom[0]->width(), 8);
+	CHECK_EQ(bottom[1]->num(), 1);
+	CHECK_EQ(bottom[1]->channels(), 1);
+	CHECK_EQ(bottom[1]->width(), 7);
+
+	// num() and channels() are 1.
+	vector<int> top_shape(2, 1);
+	int num_pos_classes = background_label_id_ == -1 ?
+		num_classes_ : num_classes_ - 1;
+	int num_valid_det = 0;
+	const Dtype* det_data = bottom[0]->cpu_data();
+	for (int i = 0; i < bottom[0]->height(); ++i)
+	{
+		if (det_data[0] != -1)
+		{
+			++num_valid_det;
+		}
+		det_data += 8;
+	}
+	top_shape.push_back(num_pos_classes + num_valid_det);
+	// Each row is a 5 dimension vector, which stores
+	// [image_id, label, confidence, true_pos, false_pos]
+	top_shape.push_back(5);
+	top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void RDetectionEvaluateLayer<Dtype>::Forward_cpu(
+	const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top)
+{
+	// Retrieve all detection results.
+	map<int, LabelRBox> all_detections;
+	GetRDetectionResults(bottom[0]->cpu_data(), bottom[0]->height(),
+		background_label_id_, &all_detections);
+
+	// Retrieve all ground truth, and group it by image and label.
+	map<int, vector<NormalizedRBox> > all_gt;
+	GetGroundTruthR(bottom[1]->cpu_data(), bottom[1]->height(),
+		background_label_id_, &all_gt);
+	map<int, LabelRBox> all_gt_rboxes;
+	map<int, int> num_pos;
+	for (map<int, vector<NormalizedRBox> >::iterator it = all_gt.begin();
+		it != all_gt.end(); ++it)
+	{
+		for (int i = 0; i < it->second.size(); ++i)
+		{
+			const int label = it->second[i].label();
+			all_gt_rboxes[it->first][label].push_back(it->second[i]);
+			++num_pos[label];
+		}
+	}
+
+	Dtype* top_data = top[0]->mutable_cpu_data();
+	caffe_set(top[0]->count(), Dtype(0.), top_data);
+	int num_det = 0;
+
+	// Insert number of ground truth for each label.
+	for (int c = 0; c < num_classes_; ++c)
+	{
+		if (c == background_label_id_)
+		{
+			continue;
+		}
+		top_data[num_det * 5] = -1;
+		top_data[num_det * 5 + 1] = c;
+		top_data[num_det * 5 + 2] =
+			num_pos.find(c) == num_pos.end() ? 0 : num_pos[c];
+		top_data[num_det * 5 + 3] = -1;
+		top_data[num_det * 5 + 4] = -1;
+		++num_det;
+	}
+
+	// Insert detection evaluate status.
+	vector<float> overlaps;
+	for (map<int, LabelRBox>::iterator it = all_detections.begin();
+		it != all_detections.end(); ++it)
+	{
+		const int image_id = it->first;
+		const map<int, LabelRBox>::const_iterator gt_it =
+			all_gt_rboxes.find(image_id);
+		for (LabelRBox::iterator iit = it->second.begin();
+			iit != it->second.end(); ++iit)
+		{
+			const int label = iit->first;
+			vector<NormalizedRBox>& rboxes = iit->second;
+			if (gt_it == all_gt_rboxes.end() ||
+				gt_it->second.find(label) == gt_it->second.end())
+			{
+				// No ground truth for current image or label. All detections
+				// become false_pos.
+				for (int i = 0; i < rboxes.size(); ++i)
+				{
+					top_data[num_det * 5] = image_id;
+					top_data[num_det * 5 + 1] = label;
+					top_data[num_det * 5 + 2] = rboxes[i].score();
+					top_data[num_det * 5 + 3] = 0;
+					top_data[num_det * 5 + 4] = 1;
+					++num_det;
+				}
+				continue;
+			}
+			const vector<NormalizedRBox>& gt_rboxes =
+				gt_it->second.find(label)->second;
+			// Sort detections in descend order based on scores, and compute
+			// their overlaps with all ground truth at once.
+			std::stable_sort(rboxes.begin(), rboxes.end(), SortRBoxDescend);
+			JaccardOverlapRRBatch(rboxes, gt_rboxes, &overlaps);
+			const int num_gt = gt_rboxes.size();
+			vector<bool> visited(num_gt, false);
+			for (int i = 0; i < rboxes.size(); ++i)
+			{
+				top_data[num_det * 5] = image_id;
+				top_data[num_det * 5 + 1] = label;
+				top_data[num_det * 5 + 2] = rboxes[i].score();
+				float overlap_max = -1;
+				int jmax = -1;
+				for (int j = 0; j < num_gt; ++j)
+				{
+					if (overlaps[i * num_gt + j] > overlap_max)
+					{
+						overlap_max = overlaps[i * num_gt + j];
+						jmax = j;
+					}
+				}
+				if (overlap_max >= overlap_threshold_ && !visited[jmax])
+				{
+					// true positive.
+					top_data[num_det * 5 + 3] = 1;
+					top_data[num_det * 5 + 4] = 0;
+					visited[jmax] = true;
+				}
+				else
+				{
+					// false positive (or multiple detection).
+					top_data[num_det * 5 + 3] = 0;
+					top_data[num_det * 5 + 4] = 1;
+				}
+				++num_det;
+			}
+		}
+	}
+}
+
+INSTANTIATE_CLASS(RDetectionEvaluateLayer);
+REGISTER_LAYER_CLASS(RDetectionEvaluate);
+
+}  // namespace caffe
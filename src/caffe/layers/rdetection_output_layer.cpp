@@ -114,7 +114,7 @@ void RDetectionOutputLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 	top_shape.push_back(1);
 	// Each row is a 8 dimension vector, which stores
 	// [image_id, label, confidence, xcenter, ycenter, angle, width, height]
-	top_shape.push_back(1);
+	top_shape.push_back(8);
 	top[0]->Reshape(top_shape);
 }
 
@@ -230,24 +230,22 @@ void RDetectionOutputLayer<Dtype>::Forward_cpu(
 	}
 
 	vector<int> top_shape(2, 1);
-	top_shape.push_back(1);
-	top_shape.push_back(1);
+	top_shape.push_back(num_kept);
+	top_shape.push_back(8);
 	Dtype* top_data;
 	if (num_kept == 0)
 	{
 		LOG(INFO) << "Couldn't find any detections";
+		// Output a single fake result, which RDetectionEvaluate skips.
+		top_shape[2] = 1;
 		top[0]->Reshape(top_shape);
 		top_data = top[0]->mutable_cpu_data();
-		//caffe_set<Dtype>(top[0]->count(), -1, top_data);
-		// Generate fake results per image.
-		
-		top_data[0]=-1;
+		caffe_set<Dtype>(top[0]->count(), -1, top_data);
 	}
 	else
 	{
 		top[0]->Reshape(top_shape);
 		top_data = top[0]->mutable_cpu_data();
-		top_data[0] = 0;
 	}
 
 	int count = 0;
@@ -289,16 +287,16 @@ void RDetectionOutputLayer<Dtype>::Forward_cpu(
 				for (int j = 0; j < indices.size(); ++j)
 				{
 					int idx = indices[j];
-					//top_data[count * 8] = i;
-					//top_data[count * 8 + 1] = label;
-					//top_data[count * 8 + 2] = scores[idx];
+					top_data[count * 8] = i;
+					top_data[count * 8 + 1] = label;
+					top_data[count * 8 + 2] = scores[idx];
 					const NormalizedRBox& rbox = rboxes[idx];
-					//top_data[count * 8 + 3] = rbox.xcenter();
-					//top_data[count * 8 + 4] = rbox.ycenter();
-					//top_data[count * 8 + 5] = rbox.angle();
-					//top_data[count * 8 + 6] = rbox.width();
-					//top_data[count * 8 + 7] = rbox.height();
-					//++count;
+					top_data[count * 8 + 3] = rbox.xcenter();
+					top_data[count * 8 + 4] = rbox.ycenter();
+					top_data[count * 8 + 5] = rbox.angle();
+					top_data[count * 8 + 6] = rbox.width();
+					top_data[count * 8 + 7] = rbox.height();
+					++count;
 					if (need_save_)
 					{
 						outfile << rbox.xcenter()*300 << " "<< rbox.ycenter()*300 << " " 
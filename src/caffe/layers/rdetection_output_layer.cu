@@ -161,18 +161,16 @@ void RDetectionOutputLayer<Dtype>::Forward_gpu(
 	if (num_kept == 0)
 	{
 		//LOG(INFO) << "Couldn't find any detections";
+		// Output a single fake result, which RDetectionEvaluate skips.
+		top_shape[2] = 1;
 		top[0]->Reshape(top_shape);
 		top_data = top[0]->mutable_cpu_data();
 		caffe_set<Dtype>(top[0]->count(), -1, top_data);
-		// Generate fake results per image.
-		
-		//top_data[0]=-1;
 	}
 	else
 	{
 		top[0]->Reshape(top_shape);
 		top_data = top[0]->mutable_cpu_data();
-		//top_data[0] = 0;
 	}
 
 	int count = 0;
@@ -28,33 +28,47 @@ void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
   int channels = bottom[0]->shape(softmax_axis_);
   int dim = bottom[0]->count() / outer_num_;
-  caffe_copy(bottom[0]->count(), bottom_data, top_data);
   // We need to subtract the max to avoid numerical issues, compute the exp,
-  // and then normalize.
-  for (int i = 0; i < outer_num_; ++i) {
-    // initialize scale_data to the first plane
-    caffe_copy(inner_num_, bottom_data + i * dim, scale_data);
-    for (int j = 0; j < channels; j++) {
-      for (int k = 0; k < inner_num_; k++) {
-        scale_data[k] = std::max(scale_data[k],
-            bottom_data[i * dim + j * inner_num_ + k]);
+  // and then normalize. The outer slices are independent and run in
+  // parallel, each thread with its own scale.
+  #pragma omp parallel if (outer_num_ > 1 && bottom[0]->count() > 4096)
+  {
+    vector<Dtype> scale(inner_num_);
+    Dtype* scale_data = &scale[0];
+    #pragma omp for
+    for (int i = 0; i < outer_num_; ++i) {
+      const Dtype* bottom_slice = bottom_data + i * dim;
+      Dtype* top_slice = top_data + i * dim;
+      // initialize scale_data to the first plane
+      caffe_copy(inner_num_, bottom_slice, scale_data);
+      for (int j = 1; j < channels; j++) {
+        for (int k = 0; k < inner_num_; k++) {
+          scale_data[k] = std::max(scale_data[k],
+              bottom_slice[j * inner_num_ + k]);
+        }
+      }
+      // subtraction
+      for (int j = 0; j < channels; j++) {
+        for (int k = 0; k < inner_num_; k++) {
+          top_slice[j * inner_num_ + k] =
+              bottom_slice[j * inner_num_ + k] - scale_data[k];
+        }
+      }
+      // exponentiation
+      caffe_exp<Dtype>(dim, top_slice, top_slice);
+      // sum after exp
+      caffe_copy(inner_num_, top_slice, scale_data);
+      for (int j = 1; j < channels; j++) {
+        caffe_axpy<Dtype>(inner_num_, 1., top_slice + j * inner_num_,
+            scale_data);
+      }
+      // division
+      for (int j = 0; j < channels; j++) {
+        caffe_div(inner_num_, top_slice + j * inner_num_, scale_data,
+            top_slice + j * inner_num_);
       }
-    }
-    // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_,
-        1, -1., sum_multiplier_.cpu_data(), scale_data, 1., top_data);
-    // exponentiation
-    caffe_exp<Dtype>(dim, top_data, top_data);
-    // sum after exp
-    caffe_cpu_gemv<Dtype>(CblasTrans, channels, inner_num_, 1.,
-        top_data, sum_multiplier_.cpu_data(), 0., scale_data);
-    // division
-    for (int j = 0; j < channels; j++) {
-      caffe_div(inner_num_, top_data, scale_data, top_data);
-      top_data += inner_num_;
     }
   }
 }
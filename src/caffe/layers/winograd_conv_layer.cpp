@@ -0,0 +1,196 @@
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Number of elements of a transformed 4x4 tile.
+static const int kTileSize = 16;
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  use_winograd_ = this->num_spatial_axes_ == 2 && this->group_ == 1 &&
+      !this->force_nd_im2col_;
+  for (int i = 0; i < this->num_spatial_axes_ && use_winograd_; ++i) {
+    use_winograd_ = this->kernel_shape_.cpu_data()[i] == 3 &&
+        this->stride_.cpu_data()[i] == 1 &&
+        this->dilation_.cpu_data()[i] == 1;
+  }
+  if (use_winograd_) {
+    pad_h_ = this->pad_.cpu_data()[0];
+    pad_w_ = this->pad_.cpu_data()[1];
+  } else {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " is not a 2D 3x3 "
+        << "stride 1 convolution; the WINOGRAD engine uses im2col instead.";
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!use_winograd_) {
+    return;
+  }
+  height_ = this->input_shape(1);
+  width_ = this->input_shape(2);
+  height_out_ = this->output_shape_[0];
+  width_out_ = this->output_shape_[1];
+  tiles_h_ = (height_out_ + 1) / 2;
+  tiles_w_ = (width_out_ + 1) / 2;
+  const int tiles = tiles_h_ * tiles_w_;
+  vector<int> shape(3, kTileSize);
+  shape[1] = this->num_output_;
+  shape[2] = this->channels_;
+  weight_transform_.Reshape(shape);
+  shape[1] = this->channels_;
+  shape[2] = tiles;
+  input_transform_.Reshape(shape);
+  shape[1] = this->num_output_;
+  output_transform_.Reshape(shape);
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformWeights(const Dtype* weights,
+    Dtype* weight_transform) {
+  const int pairs = this->num_output_ * this->channels_;
+  #pragma omp parallel for
+  for (int p = 0; p < pairs; ++p) {
+    const Dtype* g = weights + p * 9;
+    // G g, with G = [1 0 0; .5 .5 .5; .5 -.5 .5; 0 0 1].
+    Dtype gg[4][3];
+    for (int j = 0; j < 3; ++j) {
+      gg[0][j] = g[j];
+      gg[1][j] = Dtype(0.5) * (g[j] + g[3 + j] + g[6 + j]);
+      gg[2][j] = Dtype(0.5) * (g[j] - g[3 + j] + g[6 + j]);
+      gg[3][j] = g[6 + j];
+    }
+    // (G g) G^T
+    for (int i = 0; i < 4; ++i) {
+      Dtype u[4];
+      u[0] = gg[i][0];
+      u[1] = Dtype(0.5) * (gg[i][0] + gg[i][1] + gg[i][2]);
+      u[2] = Dtype(0.5) * (gg[i][0] - gg[i][1] + gg[i][2]);
+      u[3] = gg[i][2];
+      for (int j = 0; j < 4; ++j) {
+        weight_transform[(i * 4 + j) * pairs + p] = u[j];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformInput(const Dtype* input,
+    Dtype* input_transform) {
+  const int tiles = tiles_h_ * tiles_w_;
+  const int planes = this->channels_ * tiles;
+  #pragma omp parallel for
+  for (int p = 0; p < planes; ++p) {
+    const int c = p / tiles;
+    const int t = p % tiles;
+    const int h0 = (t / tiles_w_) * 2 - pad_h_;
+    const int w0 = (t % tiles_w_) * 2 - pad_w_;
+    const Dtype* data = input + c * height_ * width_;
+    Dtype d[4][4];
+    for (int i = 0; i < 4; ++i) {
+      const int h = h0 + i;
+      for (int j = 0; j < 4; ++j) {
+        const int w = w0 + j;
+        d[i][j] = (h >= 0 && h < height_ && w >= 0 && w < width_) ?
+            data[h * width_ + w] : Dtype(0);
+      }
+    }
+    // B^T d, with B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1].
+    Dtype bd[4][4];
+    for (int j = 0; j < 4; ++j) {
+      bd[0][j] = d[0][j] - d[2][j];
+      bd[1][j] = d[1][j] + d[2][j];
+      bd[2][j] = d[2][j] - d[1][j];
+      bd[3][j] = d[1][j] - d[3][j];
+    }
+    // (B^T d) B
+    for (int i = 0; i < 4; ++i) {
+      Dtype* v = input_transform + i * 4 * planes + p;
+      v[0] = bd[i][0] - bd[i][2];
+      v[planes] = bd[i][1] + bd[i][2];
+      v[2 * planes] = bd[i][2] - bd[i][1];
+      v[3 * planes] = bd[i][1] - bd[i][3];
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformOutput(
+    const Dtype* output_transform, Dtype* output) {
+  const int tiles = tiles_h_ * tiles_w_;
+  const int planes = this->num_output_ * tiles;
+  #pragma omp parallel for
+  for (int p = 0; p < planes; ++p) {
+    const int k = p / tiles;
+    const int t = p % tiles;
+    const int h0 = (t / tiles_w_) * 2;
+    const int w0 = (t % tiles_w_) * 2;
+    Dtype m[4][4];
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        m[i][j] = output_transform[(i * 4 + j) * planes + p];
+      }
+    }
+    // A^T m A, with A^T = [1 1 1 0; 0 1 -1 -1].
+    Dtype am[2][4];
+    for (int j = 0; j < 4; ++j) {
+      am[0][j] = m[0][j] + m[1][j] + m[2][j];
+      am[1][j] = m[1][j] - m[2][j] - m[3][j];
+    }
+    Dtype* top = output + k * height_out_ * width_out_;
+    for (int i = 0; i < 2 && h0 + i < height_out_; ++i) {
+      top[(h0 + i) * width_out_ + w0] = am[i][0] + am[i][1] + am[i][2];
+      if (w0 + 1 < width_out_) {
+        top[(h0 + i) * width_out_ + w0 + 1] = am[i][1] - am[i][2] - am[i][3];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int num_output = this->num_output_;
+  const int channels = this->channels_;
+  const int tiles = tiles_h_ * tiles_w_;
+  TransformWeights(this->blobs_[0]->cpu_data(),
+      weight_transform_.mutable_cpu_data());
+  const Dtype* weight_transform = weight_transform_.cpu_data();
+  Dtype* input_transform = input_transform_.mutable_cpu_data();
+  Dtype* output_transform = output_transform_.mutable_cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      TransformInput(bottom_data + n * this->bottom_dim_, input_transform);
+      for (int e = 0; e < kTileSize; ++e) {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output, tiles,
+            channels, (Dtype)1., weight_transform + e * num_output * channels,
+            input_transform + e * channels * tiles,
+            (Dtype)0., output_transform + e * num_output * tiles);
+      }
+      TransformOutput(output_transform, top_data + n * this->top_dim_);
+      if (this->bias_term_) {
+        this->forward_cpu_bias(top_data + n * this->top_dim_,
+            this->blobs_[1]->cpu_data());
+      }
+    }
+    this->forward_cpu_relu(top_data, top[i]->count());
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -9,9 +9,11 @@
 
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/conv_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
@@ -283,7 +285,27 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   }
   ShareWeights();
   debug_info_ = param.debug_info();
+  layer_fused_.assign(layers_.size(), false);
+  num_fused_layers_ = 0;
+  forward_only_ = false;
+  half_precision_params_ = param.half_precision_params() && phase_ == TEST;
+  LOG_IF(WARNING, param.half_precision_params() && phase_ != TEST)
+      << "Ignoring half_precision_params of a TRAIN net.";
+  half_precision_activations_ =
+      param.half_precision_activations() && phase_ == TEST;
+  LOG_IF(WARNING, param.half_precision_activations() && phase_ != TEST)
+      << "Ignoring half_precision_activations of a TRAIN net.";
+  params_in_half_ = false;
+  activations_in_half_ = false;
+  recompute_layers_.assign(layers_.size(), vector<int>());
+  layer_timer_.reset();
+  ClearLayerTimes();
+  LOG_IF(WARNING, param.share_training_memory() && phase_ != TRAIN)
+      << "Ignoring share_training_memory of a TEST net.";
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
+  if (param.share_training_memory() && phase_ == TRAIN) {
+    ShareTrainingMemory();
+  }
 }
 
 template <typename Dtype>
@@ -547,10 +569,19 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  if (half_precision_params_ && !params_in_half_) {
+    StoreParamsInHalf();
+  }
+  if (half_precision_activations_ && !activations_in_half_) {
+    StoreActivationsInHalf();
+  }
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
+    if (layer_fused_[i]) { continue; }
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    if (layer_timer_) { layer_timer_->Start(); }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    if (layer_timer_) { layer_forward_ms_[i] += layer_timer_->MilliSeconds(); }
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
@@ -593,13 +624,40 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  CHECK(!forward_only_) << "Cannot run Backward on a net optimized for "
+      << "inference.";
   for (int i = start; i >= end; --i) {
+    if (layer_timer_) { layer_timer_->Start(); }
+    for (int k = 0; k < recompute_layers_[i].size(); ++k) {
+      const int layer_id = recompute_layers_[i][k];
+      layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+    }
     if (layer_need_backward_[i]) {
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
-      if (debug_info_) { BackwardDebugInfo(i); }
     }
+    if (layer_timer_) { layer_backward_ms_[i] += layer_timer_->MilliSeconds(); }
+    if (layer_need_backward_[i] && debug_info_) { BackwardDebugInfo(i); }
+    for (int c = 0; c < after_backward_.size(); ++c) {
+      after_backward_[c]->run(i);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_layer_timing(const bool value) {
+  if (value) {
+    layer_timer_.reset(new Timer());
+  } else {
+    layer_timer_.reset();
   }
+  ClearLayerTimes();
+}
+
+template <typename Dtype>
+void Net<Dtype>::ClearLayerTimes() {
+  layer_forward_ms_.assign(layers_.size(), 0);
+  layer_backward_ms_.assign(layers_.size(), 0);
 }
 
 template <typename Dtype>
@@ -614,7 +672,8 @@ void Net<Dtype>::ForwardDebugInfo(const int layer_id) {
         << ", top blob " << blob_name
         << " data: " << data_abs_val_mean;
   }
-  for (int param_id = 0; param_id < layers_[layer_id]->blobs().size();
+  // A bias added by FuseLayersForInference has no net param.
+  for (int param_id = 0; param_id < param_id_vecs_[layer_id].size();
        ++param_id) {
     const Blob<Dtype>& blob = *layers_[layer_id]->blobs()[param_id];
     const int net_param_id = param_id_vecs_[layer_id][param_id];
@@ -681,8 +740,538 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
   }
 }
 
+template <typename Dtype>
+bool Net<Dtype>::IsInPlaceOn(const int layer_id, const int blob_id) const {
+  return bottom_id_vecs_[layer_id].size() == 1 &&
+      bottom_id_vecs_[layer_id][0] == blob_id &&
+      top_id_vecs_[layer_id].size() == 1 &&
+      top_id_vecs_[layer_id][0] == blob_id;
+}
+
+template <typename Dtype>
+bool Net<Dtype>::OwnsParamsAlone(const int layer_id) const {
+  for (int i = 0; i < param_id_vecs_[layer_id].size(); ++i) {
+    const int param_id = param_id_vecs_[layer_id][i];
+    if (param_owners_[param_id] != -1) { return false; }
+    for (int j = 0; j < param_owners_.size(); ++j) {
+      if (param_owners_[j] == param_id) { return false; }
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+int Net<Dtype>::FuseLayersForInference() {
+  CHECK_EQ(phase_, TEST) << "Only TEST nets can be fused.";
+  CHECK(!params_in_half_ && !activations_in_half_)
+      << "Fuse layers before storing params or activations in half precision.";
+  int num_fused = 0;
+  for (int i = 0; i < layers_.size(); ++i) {
+    BaseConvolutionLayer<Dtype>* conv_layer =
+        dynamic_cast<ConvolutionLayer<Dtype>*>(layers_[i].get());
+    if (layer_fused_[i] || conv_layer == NULL ||
+        top_id_vecs_[i].size() != 1 || !OwnsParamsAlone(i)) {
+      continue;
+    }
+    const int blob_id = top_id_vecs_[i][0];
+    const int num_output =
+        layers_[i]->layer_param().convolution_param().num_output();
+    vector<Dtype> scale(num_output, 1);
+    vector<Dtype> shift(num_output, 0);
+    bool fold = false;
+    int j = i + 1;
+    if (j < layers_.size() && !layer_fused_[j] && IsInPlaceOn(j, blob_id) &&
+        strcmp(layers_[j]->type(), "BatchNorm") == 0 &&
+        (!layers_[j]->layer_param().batch_norm_param().has_use_global_stats()
+        || layers_[j]->layer_param().batch_norm_param().use_global_stats())) {
+      // y = (x - mean) / sqrt(var + eps), with the stored statistics
+      // normalized by the moving average factor.
+      const vector<shared_ptr<Blob<Dtype> > >& bn = layers_[j]->blobs();
+      const Dtype eps = layers_[j]->layer_param().batch_norm_param().eps();
+      const Dtype factor = bn[2]->cpu_data()[0] == 0 ?
+          0 : 1 / bn[2]->cpu_data()[0];
+      for (int k = 0; k < num_output; ++k) {
+        const Dtype mean = bn[0]->cpu_data()[k] * factor;
+        const Dtype variance = bn[1]->cpu_data()[k] * factor;
+        scale[k] = 1 / sqrt(variance + eps);
+        shift[k] = -mean * scale[k];
+      }
+      fold = true;
+      layer_fused_[j++] = true;
+    }
+    if (j < layers_.size() && !layer_fused_[j] && IsInPlaceOn(j, blob_id) &&
+        strcmp(layers_[j]->type(), "Scale") == 0 &&
+        layers_[j]->blobs()[0]->count() == num_output &&
+        bottom_vecs_[j][0]->CanonicalAxisIndex(
+            layers_[j]->layer_param().scale_param().axis()) == 1) {
+      // y = gamma * x + beta
+      const vector<shared_ptr<Blob<Dtype> > >& sc = layers_[j]->blobs();
+      const Dtype* gamma = sc[0]->cpu_data();
+      const Dtype* beta = sc.size() > 1 ? sc[1]->cpu_data() : NULL;
+      for (int k = 0; k < num_output; ++k) {
+        scale[k] *= gamma[k];
+        shift[k] = shift[k] * gamma[k] + (beta ? beta[k] : 0);
+      }
+      fold = true;
+      layer_fused_[j++] = true;
+    }
+    if (fold) {
+      conv_layer->FoldChannelAffine(scale, shift);
+    }
+    if (j < layers_.size() && !layer_fused_[j] && IsInPlaceOn(j, blob_id) &&
+        strcmp(layers_[j]->type(), "ReLU") == 0) {
+      conv_layer->FuseReLU(layers_[j]->layer_param().relu_param()
+          .negative_slope());
+      layer_fused_[j++] = true;
+    }
+    for (int k = i + 1; k < j; ++k) {
+      LOG_IF(INFO, Caffe::root_solver()) << "Fused " << layer_names_[k]
+          << " into " << layer_names_[i];
+    }
+    num_fused += j - i - 1;
+    i = j - 1;
+  }
+  num_fused_layers_ += num_fused;
+  forward_only_ = forward_only_ || num_fused > 0;
+  return num_fused;
+}
+
+template <typename Dtype>
+size_t Net<Dtype>::ShareActivationMemory() {
+  CHECK_EQ(phase_, TEST) << "Only TEST nets can share activation memory.";
+  if (half_precision_activations_ && !activations_in_half_) {
+    StoreActivationsInHalf();
+  }
+  Reshape();
+  const int num_blobs = blobs_.size();
+  // Group every blob with the blob whose data it may share. Layers run in
+  // order, so the bottom of a sharing layer already maps to its group root.
+  vector<int> group(num_blobs);
+  for (int i = 0; i < num_blobs; ++i) { group[i] = i; }
+  vector<bool> pinned(num_blobs, false);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    pinned[net_input_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    pinned[net_output_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      if (bottom_id_vecs_[i].empty()) {
+        // Data layers may point their tops to memory of their own.
+        pinned[blob_id] = true;
+      } else if (layers_[i]->TopSharesBottomData()) {
+        group[blob_id] = group[bottom_id_vecs_[i][0]];
+      }
+    }
+  }
+  // Lifetime [first, last] layer and the largest size of every group.
+  vector<int> first(num_blobs, layers_.size());
+  vector<int> last(num_blobs, -1);
+  vector<size_t> bytes(num_blobs, 0);
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int k = 0; k < 2; ++k) {
+      const vector<int>& ids = k == 0 ? bottom_id_vecs_[i] : top_id_vecs_[i];
+      for (int j = 0; j < ids.size(); ++j) {
+        const int root = group[ids[j]];
+        first[root] = std::min(first[root], i);
+        last[root] = std::max(last[root], i);
+      }
+    }
+  }
+  for (int i = 0; i < num_blobs; ++i) {
+    const int root = group[i];
+    const size_t value_bytes =
+        blobs_[i]->data_in_half() ? sizeof(uint16_t) : sizeof(Dtype);
+    bytes[root] = std::max(bytes[root], blobs_[i]->count() * value_bytes);
+    pinned[root] = pinned[root] || pinned[i];
+  }
+  size_t pinned_bytes = 0;
+  size_t unshared_bytes = 0;
+  vector<pair<size_t, int> > candidates;
+  for (int i = 0; i < num_blobs; ++i) {
+    if (group[i] != i) { continue; }
+    if (pinned[i]) {
+      pinned_bytes += bytes[i];
+    } else if (bytes[i] > 0) {
+      unshared_bytes += bytes[i];
+      candidates.push_back(std::make_pair(bytes[i], i));
+    }
+  }
+  std::sort(candidates.rbegin(), candidates.rend());
+  // First fit into buffers, largest groups first, so that the first group
+  // placed in a buffer sets its size.
+  vector<size_t> buffer_bytes;
+  vector<vector<int> > buffer_groups;
+  vector<int> buffer_of(num_blobs, -1);
+  for (int c = 0; c < candidates.size(); ++c) {
+    const int root = candidates[c].second;
+    int buffer = 0;
+    for (; buffer < buffer_groups.size(); ++buffer) {
+      bool disjoint = true;
+      for (int g = 0; g < buffer_groups[buffer].size() && disjoint; ++g) {
+        const int other = buffer_groups[buffer][g];
+        disjoint = last[other] < first[root] || last[root] < first[other];
+      }
+      if (disjoint) { break; }
+    }
+    if (buffer == buffer_groups.size()) {
+      buffer_bytes.push_back(bytes[root]);
+      buffer_groups.push_back(vector<int>());
+    }
+    buffer_groups[buffer].push_back(root);
+    buffer_of[root] = buffer;
+  }
+  vector<shared_ptr<SyncedMemory> > buffers(buffer_bytes.size());
+  size_t shared_bytes = 0;
+  for (int b = 0; b < buffers.size(); ++b) {
+    buffers[b].reset(new SyncedMemory(buffer_bytes[b]));
+    shared_bytes += buffer_bytes[b];
+  }
+  for (int i = 0; i < num_blobs; ++i) {
+    const int buffer = buffer_of[group[i]];
+    if (buffer >= 0 && blobs_[i]->data_in_half()) {
+      blobs_[i]->ShareHalfMemory(buffers[buffer]);
+    } else if (buffer >= 0) {
+      blobs_[i]->ShareDataMemory(buffers[buffer]);
+    }
+  }
+  // Let the layers sharing data at Reshape point their tops to the buffers.
+  Reshape();
+  forward_only_ = true;
+  LOG_IF(INFO, Caffe::root_solver()) << "Activation memory of " << name_
+      << ": " << ((pinned_bytes + unshared_bytes) >> 20) << " MB -> "
+      << ((pinned_bytes + shared_bytes) >> 20) << " MB ("
+      << candidates.size() << " blobs in " << buffers.size()
+      << " shared buffers, " << (pinned_bytes >> 20) << " MB not shared)";
+  return pinned_bytes + shared_bytes;
+}
+
+template <typename Dtype>
+size_t Net<Dtype>::ShareTrainingMemory() {
+  CHECK_EQ(phase_, TRAIN) << "Only TRAIN nets can share training memory.";
+  CHECK(!forward_only_) << "Cannot plan Backward for a net optimized for "
+      << "inference.";
+  Reshape();
+  const int num_layers = layers_.size();
+  const int num_blobs = blobs_.size();
+  // Group every blob with the blob whose data, and whose diff, it may share.
+  vector<int> data_group(num_blobs);
+  vector<int> diff_group(num_blobs);
+  for (int i = 0; i < num_blobs; ++i) { data_group[i] = diff_group[i] = i; }
+  vector<bool> data_pinned(num_blobs, false);
+  vector<bool> diff_pinned(num_blobs, false);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    data_pinned[net_input_blob_indices_[i]] = true;
+    diff_pinned[net_input_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    data_pinned[net_output_blob_indices_[i]] = true;
+    diff_pinned[net_output_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < num_blobs; ++i) {
+    // Loss weights are kept in the diffs, which ShareDataMemory would reset.
+    if (blob_loss_weights_[i] != Dtype(0)) {
+      data_pinned[i] = diff_pinned[i] = true;
+    }
+    if (!blob_need_backward_[i]) { diff_pinned[i] = true; }
+  }
+  // The step from which each blob's diff lives, before the backward of the
+  // last layer using it for loss layers keeping scratch in their bottom
+  // diffs from Forward, as HingeLoss does.
+  vector<int> diff_start(num_blobs, 2 * num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    bool loss = false;
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      if (bottom_id_vecs_[i].empty()) {
+        // Data layers may point their tops to memory of their own.
+        data_pinned[blob_id] = diff_pinned[blob_id] = true;
+      } else {
+        if (layers_[i]->TopSharesBottomData()) {
+          data_group[blob_id] = data_group[bottom_id_vecs_[i][0]];
+        }
+        if (layers_[i]->TopSharesBottomDiff()) {
+          diff_group[blob_id] = diff_group[bottom_id_vecs_[i][0]];
+        }
+      }
+      loss = loss || layers_[i]->loss(j) != Dtype(0);
+    }
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int blob_id = bottom_id_vecs_[i][j];
+      // Layers skipping the backward to a bottom leave its diff as it is.
+      if (!bottom_need_backward_[i][j]) { diff_pinned[blob_id] = true; }
+      if (loss) { diff_start[blob_id] = std::min(diff_start[blob_id], i); }
+    }
+  }
+  // The first and last layer using every group, and its largest size.
+  vector<int> data_first(num_blobs, num_layers);
+  vector<int> data_last(num_blobs, -1);
+  vector<int> diff_first(num_blobs, num_layers);
+  vector<int> diff_last(num_blobs, -1);
+  for (int i = 0; i < num_layers; ++i) {
+    for (int k = 0; k < 2; ++k) {
+      const vector<int>& ids = k == 0 ? bottom_id_vecs_[i] : top_id_vecs_[i];
+      for (int j = 0; j < ids.size(); ++j) {
+        const int data_root = data_group[ids[j]];
+        const int diff_root = diff_group[ids[j]];
+        data_first[data_root] = std::min(data_first[data_root], i);
+        data_last[data_root] = std::max(data_last[data_root], i);
+        diff_first[diff_root] = std::min(diff_first[diff_root], i);
+        diff_last[diff_root] = std::max(diff_last[diff_root], i);
+      }
+    }
+  }
+  vector<size_t> data_bytes(num_blobs, 0);
+  vector<size_t> diff_bytes(num_blobs, 0);
+  for (int i = 0; i < num_blobs; ++i) {
+    const size_t bytes = blobs_[i]->count() * sizeof(Dtype);
+    const int data_root = data_group[i];
+    const int diff_root = diff_group[i];
+    data_bytes[data_root] = std::max(data_bytes[data_root], bytes);
+    diff_bytes[diff_root] = std::max(diff_bytes[diff_root], bytes);
+    data_pinned[data_root] = data_pinned[data_root] || data_pinned[i];
+    diff_pinned[diff_root] = diff_pinned[diff_root] || diff_pinned[i];
+    diff_start[diff_root] = std::min(diff_start[diff_root], diff_start[i]);
+  }
+  // Before the backward of which layer each recompute layer runs Forward
+  // again: that of the last layer using its tops, or earlier if a recompute
+  // layer above needs its tops to be computed again.
+  const int kNotRecomputed = -1;
+  vector<int> recompute_at(num_layers, kNotRecomputed);
+  for (int i = 0; i < num_layers; ++i) {
+    recompute_layers_[i].clear();
+    if (!layers_[i]->layer_param().recompute()) { continue; }
+    CHECK(!bottom_id_vecs_[i].empty() && !layers_[i]->TopSharesBottomData())
+        << "Layer " << layer_names_[i] << " cannot be recomputed.";
+    CHECK(layers_[i]->ForwardIsRepeatable())
+        << "Layer " << layer_names_[i] << " of type " << layers_[i]->type()
+        << " cannot be recomputed, as its Forward is random or updates "
+        << "the layer.";
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      CHECK(!data_pinned[blob_id] && data_group[blob_id] == blob_id &&
+          data_first[blob_id] == i)
+          << "Layer " << layer_names_[i] << " cannot be recomputed, as top "
+          << blob_names_[blob_id] << " is a net output, has a loss weight or "
+          << "is computed in place.";
+      recompute_at[i] = std::max(recompute_at[i], data_last[blob_id]);
+    }
+  }
+  for (int i = num_layers - 1; i >= 0; --i) {
+    if (recompute_at[i] == kNotRecomputed) { continue; }
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int producer = data_first[data_group[bottom_id_vecs_[i][j]]];
+      if (producer < num_layers && recompute_at[producer] != kNotRecomputed) {
+        recompute_at[producer] =
+            std::max(recompute_at[producer], recompute_at[i]);
+      }
+    }
+  }
+  for (int i = 0; i < num_layers; ++i) {
+    if (recompute_at[i] != kNotRecomputed) {
+      recompute_layers_[recompute_at[i]].push_back(i);
+    }
+  }
+  // The steps [first, last] each data and diff group lives, data first.
+  // Recomputed data lives twice: in Forward, and from its recomputation on.
+  const int last_step = 2 * num_layers - 1;
+  vector<vector<pair<int, int> > > lifetimes(2 * num_blobs);
+  size_t pinned_bytes = 0;
+  size_t unshared_bytes = 0;
+  vector<pair<size_t, int> > candidates;
+  for (int i = 0; i < num_blobs; ++i) {
+    if (data_group[i] == i) {
+      if (data_pinned[i]) {
+        pinned_bytes += data_bytes[i];
+      } else if (data_bytes[i] > 0) {
+        const int producer = data_first[i];
+        if (recompute_at[producer] == kNotRecomputed) {
+          lifetimes[i].push_back(std::make_pair(producer,
+              last_step - producer));
+        } else {
+          lifetimes[i].push_back(std::make_pair(producer, data_last[i]));
+          lifetimes[i].push_back(std::make_pair(
+              last_step - recompute_at[producer], last_step - producer));
+        }
+        unshared_bytes += data_bytes[i];
+        candidates.push_back(std::make_pair(data_bytes[i], i));
+      }
+    }
+    if (diff_group[i] == i) {
+      if (diff_pinned[i]) {
+        pinned_bytes += diff_bytes[i];
+      } else if (diff_bytes[i] > 0) {
+        lifetimes[num_blobs + i].push_back(std::make_pair(
+            std::min(diff_start[i], last_step - diff_last[i]),
+            last_step - diff_first[i]));
+        unshared_bytes += diff_bytes[i];
+        candidates.push_back(std::make_pair(diff_bytes[i], num_blobs + i));
+      }
+    }
+  }
+  std::sort(candidates.rbegin(), candidates.rend());
+  // First fit into buffers, largest groups first, as ShareActivationMemory.
+  vector<size_t> buffer_bytes;
+  vector<vector<int> > buffer_groups;
+  vector<int> buffer_of(2 * num_blobs, -1);
+  for (int c = 0; c < candidates.size(); ++c) {
+    const int group = candidates[c].second;
+    int buffer = 0;
+    for (; buffer < buffer_groups.size(); ++buffer) {
+      bool disjoint = true;
+      for (int g = 0; g < buffer_groups[buffer].size() && disjoint; ++g) {
+        const vector<pair<int, int> >& other =
+            lifetimes[buffer_groups[buffer][g]];
+        for (int k = 0; k < lifetimes[group].size() && disjoint; ++k) {
+          for (int l = 0; l < other.size() && disjoint; ++l) {
+            disjoint = other[l].second < lifetimes[group][k].first ||
+                lifetimes[group][k].second < other[l].first;
+          }
+        }
+      }
+      if (disjoint) { break; }
+    }
+    if (buffer == buffer_groups.size()) {
+      buffer_bytes.push_back(candidates[c].first);
+      buffer_groups.push_back(vector<int>());
+    }
+    buffer_groups[buffer].push_back(group);
+    buffer_of[group] = buffer;
+  }
+  vector<shared_ptr<SyncedMemory> > buffers(buffer_bytes.size());
+  size_t shared_bytes = 0;
+  for (int b = 0; b < buffers.size(); ++b) {
+    buffers[b].reset(new SyncedMemory(buffer_bytes[b]));
+    shared_bytes += buffer_bytes[b];
+  }
+  // The data first, as ShareDataMemory resets the diff.
+  for (int i = 0; i < num_blobs; ++i) {
+    const int data_buffer = buffer_of[data_group[i]];
+    const int diff_buffer = buffer_of[num_blobs + diff_group[i]];
+    if (data_buffer >= 0) {
+      blobs_[i]->ShareDataMemory(buffers[data_buffer]);
+    }
+    if (diff_buffer >= 0) {
+      blobs_[i]->ShareDiffMemory(buffers[diff_buffer]);
+    }
+  }
+  // Let the layers sharing data at Reshape point their tops to the buffers.
+  Reshape();
+  LOG_IF(INFO, Caffe::root_solver()) << "Training memory of " << name_
+      << ": " << ((pinned_bytes + unshared_bytes) >> 20) << " MB -> "
+      << ((pinned_bytes + shared_bytes) >> 20) << " MB ("
+      << candidates.size() << " data and diffs in " << buffers.size()
+      << " shared buffers, " << (pinned_bytes >> 20) << " MB not shared)";
+  return pinned_bytes + shared_bytes;
+}
+
+template <typename Dtype>
+size_t Net<Dtype>::StoreParamsInHalf() {
+  CHECK_EQ(phase_, TEST) << "Only TEST nets can store params in half.";
+  CHECK(Caffe::mode() == Caffe::CPU)
+      << "Half precision params are only supported in CPU mode.";
+  CHECK(!params_in_half_) << "The params are already in half precision.";
+  size_t float_bytes = 0;
+  size_t half_bytes = 0;
+  for (int i = 0; i < layers_.size(); ++i) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = layers_[i]->blobs();
+    // Params shared between layers share their float data, and stay so.
+    const bool convert = !layer_fused_[i] && OwnsParamsAlone(i);
+    for (int j = 0; j < blobs.size(); ++j) {
+      const size_t bytes = blobs[j]->count() * sizeof(Dtype);
+      float_bytes += bytes;
+      if (convert && layers_[i]->AcceptsHalfParam(j)) {
+        blobs[j]->StoreDataInHalf();
+        half_bytes += blobs[j]->count() * sizeof(uint16_t);
+      } else {
+        half_bytes += bytes;
+      }
+    }
+  }
+  params_in_half_ = true;
+  forward_only_ = true;
+  LOG_IF(INFO, Caffe::root_solver()) << "Param memory of " << name_ << ": "
+      << (float_bytes >> 20) << " MB -> " << (half_bytes >> 20) << " MB";
+  return half_bytes;
+}
+
+template <typename Dtype>
+size_t Net<Dtype>::StoreActivationsInHalf() {
+  CHECK_EQ(phase_, TEST) << "Only TEST nets can store activations in half.";
+  CHECK(Caffe::mode() == Caffe::CPU)
+      << "Half precision activations are only supported in CPU mode.";
+  CHECK(!activations_in_half_)
+      << "The activations are already in half precision.";
+  Reshape();
+  const int num_blobs = blobs_.size();
+  // A blob is stored in half if a layer computes it and every layer computing
+  // or using it accepts it so. The net inputs and outputs stay in float for
+  // the caller, and so do the blobs computed in place.
+  vector<bool> computed(num_blobs, false);
+  vector<bool> half(num_blobs, true);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    half[net_input_blob_indices_[i]] = false;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    half[net_output_blob_indices_[i]] = false;
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (layer_fused_[i]) { continue; }
+    const vector<int>& bottom_ids = bottom_id_vecs_[i];
+    for (int j = 0; j < bottom_ids.size(); ++j) {
+      if (!layers_[i]->AcceptsHalfBottom(j)) {
+        half[bottom_ids[j]] = false;
+      }
+    }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      computed[blob_id] = true;
+      if (!layers_[i]->AcceptsHalfTop(j) || std::find(bottom_ids.begin(),
+          bottom_ids.end(), blob_id) != bottom_ids.end()) {
+        half[blob_id] = false;
+      }
+    }
+  }
+  size_t float_bytes = 0;
+  size_t half_bytes = 0;
+  int num_half = 0;
+  for (int i = 0; i < num_blobs; ++i) {
+    const size_t bytes = blobs_[i]->count() * sizeof(Dtype);
+    float_bytes += bytes;
+    if (computed[i] && half[i]) {
+      blobs_[i]->StoreDataInHalf();
+      half_bytes += blobs_[i]->count() * sizeof(uint16_t);
+      ++num_half;
+    } else {
+      half_bytes += bytes;
+    }
+  }
+  activations_in_half_ = true;
+  forward_only_ = true;
+  LOG_IF(INFO, Caffe::root_solver()) << "Activation memory of " << name_
+      << ": " << (float_bytes >> 20) << " MB -> " << (half_bytes >> 20)
+      << " MB (" << num_half << " of " << num_blobs
+      << " blobs in half precision)";
+  return half_bytes;
+}
+
 template <typename Dtype>
 void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
+  TakeTrainedLayersFrom(other, true);
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const Net* other) {
+  TakeTrainedLayersFrom(other, false);
+}
+
+template <typename Dtype>
+void Net<Dtype>::TakeTrainedLayersFrom(const Net* other, const bool share) {
+  const char* action = share ? "share" : "copy";
+  CHECK(!params_in_half_ && !other->params_in_half_)
+      << "Cannot " << action << " half precision params.";
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     Layer<Dtype>* source_layer = other->layers()[i].get();
@@ -693,7 +1282,7 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
       ++target_layer_id;
     }
     if (target_layer_id == layer_names_.size()) {
-      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      LOG_IF(INFO, share) << "Ignoring source layer " << source_layer_name;
       continue;
     }
     DLOG(INFO) << "Copying source layer " << source_layer_name;
@@ -704,11 +1293,15 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
     for (int j = 0; j < target_blobs.size(); ++j) {
       Blob<Dtype>* source_blob = source_layer->blobs()[j].get();
       CHECK(target_blobs[j]->shape() == source_blob->shape())
-          << "Cannot share param " << j << " weights from layer '"
+          << "Cannot " << action << " param " << j << " weights from layer '"
           << source_layer_name << "'; shape mismatch.  Source param shape is "
           << source_blob->shape_string() << "; target param shape is "
           << target_blobs[j]->shape_string();
-      target_blobs[j]->ShareData(*source_blob);
+      if (share) {
+        target_blobs[j]->ShareData(*source_blob);
+      } else {
+        target_blobs[j]->CopyFrom(*source_blob);
+      }
     }
   }
 }
@@ -751,6 +1344,8 @@ void Net<Dtype>::Reshape() {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
+  CHECK(!params_in_half_)
+      << "Cannot load weights into a net with half precision params.";
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
@@ -807,6 +1402,8 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+  CHECK(!params_in_half_)
+      << "Cannot load weights into a net with half precision params.";
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
@@ -857,6 +1454,9 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
 
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
+  CHECK_EQ(num_fused_layers_, 0) << "Cannot save a fused net.";
+  CHECK(!params_in_half_)
+      << "Cannot save a net with half precision params.";
   param->Clear();
   param->set_name(name_);
   // Add bottom and top
@@ -869,6 +1469,9 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  CHECK_EQ(num_fused_layers_, 0) << "Cannot save a fused net.";
+  CHECK(!params_in_half_)
+      << "Cannot save a net with half precision params.";
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -926,13 +1529,54 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  if (flat_params_ && Caffe::mode() == Caffe::CPU) {
+    // Sync every param to the host first, as Blob::Update would.
+    size_t offset = 0;
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      // The one-pass update is only right while no param was reshaped or
+      // given other memory since FlattenParams, which this checks cheaply.
+      Dtype* data = learnable_params_[i]->mutable_cpu_data();
+      const Dtype* diff = learnable_params_[i]->cpu_diff();
+      CHECK(data == flat_params_->data() + offset &&
+          diff == flat_params_->diff() + offset)
+          << "Param " << i << " no longer uses the memory of FlattenParams.";
+      offset += learnable_params_[i]->count();
+    }
+    caffe_axpy<Dtype>(offset, Dtype(-1), flat_params_->diff(),
+        flat_params_->data());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::FlattenParams() {
+  if (root_net_ && root_net_->flat_params_ && Caffe::mode() == Caffe::CPU) {
+    // The net of a CPU worker solver reads the weights of the root net, and
+    // only keeps diffs of its own.
+    flat_params_.reset(new CPUParams<Dtype>(learnable_params_,
+        *root_net_->flat_params_));
+  } else {
+    flat_params_.reset(new CPUParams<Dtype>(learnable_params_));
+  }
+  flat_params_->configure(learnable_params_);
+}
+
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  if (flat_params_ && Caffe::mode() == Caffe::CPU) {
+    size_t offset = 0;
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      Dtype* diff = learnable_params_[i]->mutable_cpu_diff();
+      CHECK(diff == flat_params_->diff() + offset)
+          << "Param " << i << " no longer uses the memory of FlattenParams.";
+      offset += learnable_params_[i]->count();
+    }
+    caffe_set(offset, static_cast<Dtype>(0), flat_params_->diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
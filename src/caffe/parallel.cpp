@@ -4,6 +4,8 @@
 #include <glog/logging.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -73,6 +75,57 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
       diff_() {
 }
 
+template<typename Dtype>
+Params<Dtype>::Params(const vector<Blob<Dtype>*>& params)
+    : size_(total_size<Dtype>(params)),
+      data_(),
+      diff_() {
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(const vector<Blob<Dtype>*>& params)
+    : Params<Dtype>(params),
+      own_data_(true) {
+  void* data;
+  CaffeMallocHost(&data, size_ * sizeof(Dtype), &data_use_cuda_);
+  data_ = static_cast<Dtype*>(data);
+  apply_buffers(params, data_, size_, copy);
+
+  void* diff;
+  CaffeMallocHost(&diff, size_ * sizeof(Dtype), &diff_use_cuda_);
+  diff_ = static_cast<Dtype*>(diff);
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(const vector<Blob<Dtype>*>& params,
+                            const CPUParams<Dtype>& root)
+    : Params<Dtype>(params),
+      own_data_(false),
+      data_use_cuda_(false) {
+  CHECK_EQ(size_, root.size()) << "The nets have different params.";
+  data_ = root.data();
+
+  void* diff;
+  CaffeMallocHost(&diff, size_ * sizeof(Dtype), &diff_use_cuda_);
+  diff_ = static_cast<Dtype*>(diff);
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  if (own_data_) {
+    CaffeFreeHost(data_, data_use_cuda_);
+  }
+  CaffeFreeHost(diff_, diff_use_cuda_);
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::configure(const vector<Blob<Dtype>*>& params) const {
+  apply_buffers(params, data_, size_, replace_cpu);
+  apply_buffers(params, diff_, size_, replace_cpu_diff);
+}
+
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
     : Params<Dtype>(root_solver) {
@@ -409,7 +462,9 @@ void P2PSync<Dtype>::Prepare(const vector<int>& gpus,
         }
         if (parent) {
           param.set_device_id(pairs[i].device());
+          Caffe::set_solver_rank(i);
           syncs->at(i).reset(new P2PSync<Dtype>(solver_, parent, param));
+          Caffe::set_solver_rank(0);
           parent->children_.push_back((P2PSync<Dtype>*) syncs->at(i).get());
         }
       }
@@ -436,8 +491,277 @@ void P2PSync<Dtype>::Run(const vector<int>& gpus) {
   }
 }
 
+template<typename Dtype>
+CPUSync<Dtype>::CPUSync(shared_ptr<Solver<Dtype> > root_solver,
+                        CPUSync<Dtype>* root, int rank)
+    : root_(root ? root : this),
+      rank_(rank),
+      initial_iter_(root_solver->iter()),
+      solver_(),
+      size_(0),
+      backward_passes_(0),
+      marked_(),
+      barrier_(),
+      diffs_(),
+      buckets_(),
+      bucket_layers_(),
+      bucket_marks_(),
+      buckets_reduced_(0),
+      reducer_(),
+      state_ids_(),
+      states_(),
+      workers_() {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU) << "CPUSync only trains on the CPU.";
+  const shared_ptr<CPUParams<Dtype> >& root_params =
+      root_solver->net()->flat_params();
+  CHECK(root_params) << "The train net of the root solver is not flattened.";
+  size_ = root_params->size();
+  if (root == NULL) {
+    solver_ = root_solver;
+  } else {
+    Caffe::set_root_solver(false);
+    Caffe::set_solver_rank(rank);
+    solver_.reset(new WorkerSolver<Dtype>(root_solver->param(),
+        root_solver.get()));
+    Caffe::set_solver_rank(0);
+    Caffe::set_root_solver(true);
+    // The worker net reads the weights of the root net from its flattened
+    // params, and computes its gradients into its own diffs.
+    CHECK(solver_->net()->flat_params());
+    CHECK_EQ(root_params->data(), solver_->net()->flat_params()->data());
+  }
+  // Layers such as BatchNorm write their params in Forward, which workers
+  // may not do on the weights of the root. Each worker keeps a copy of
+  // those params instead, averaged by the root after every iteration.
+  const Net<Dtype>& net = *solver_->net();
+  set<int> state_ids;
+  for (int i = 0; i < net.params().size(); ++i) {
+    const int layer_id = net.param_layer_indices()[i].first;
+    if (!net.layers()[layer_id]->ForwardIsRepeatable()) {
+      state_ids.insert(net.learnable_param_ids()[i]);
+    }
+  }
+  state_ids_.assign(state_ids.begin(), state_ids.end());
+  if (root != NULL) {
+    const vector<Blob<Dtype>*>& params = net.learnable_params();
+    for (int k = 0; k < state_ids_.size(); ++k) {
+      Blob<Dtype>* param = params[state_ids_[k]];
+      shared_ptr<Blob<Dtype> > state(new Blob<Dtype>(param->shape()));
+      caffe_copy(state->count(), param->cpu_data(),
+          state->mutable_cpu_data());
+      param->data()->set_cpu_data(state->mutable_cpu_data());
+      states_.push_back(state);
+    }
+  }
+  solver_->add_callback(this);
+  solver_->net()->add_after_backward(this);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::InitBuckets() {
+  const Net<Dtype>& net = *solver_->net();
+  const vector<Blob<Dtype>*>& params = net.learnable_params();
+  // The gradient of a param is complete after the backward of the lowest
+  // layer sharing it.
+  vector<int> param_layers(params.size(), net.layers().size());
+  for (int i = 0; i < net.params().size(); ++i) {
+    const int id = net.learnable_param_ids()[i];
+    param_layers[id] = std::min(param_layers[id],
+        net.param_layer_indices()[i].first);
+  }
+  const int bucket_size = solver_->param().reduce_bucket_size();
+  buckets_.clear();
+  bucket_layers_.clear();
+  size_t offset = 0;
+  for (int i = 0; i < params.size(); ++i) {
+    if (buckets_.empty() || (bucket_size > 0 &&
+        buckets_.back().second - buckets_.back().first >=
+        static_cast<size_t>(bucket_size))) {
+      buckets_.push_back(std::make_pair(offset, offset));
+      bucket_layers_.push_back(param_layers[i]);
+    }
+    offset += params[i]->count();
+    buckets_.back().second = offset;
+    bucket_layers_.back() = std::min(bucket_layers_.back(), param_layers[i]);
+  }
+  if (buckets_.empty()) {
+    // The net has no learnable params.
+    buckets_.push_back(std::make_pair(size_t(0), size_));
+    bucket_layers_.push_back(0);
+  }
+  bucket_marks_.assign(buckets_.size(), 0);
+  buckets_reduced_ = 0;
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::InternalThreadEntry() {
+  CHECK(Caffe::root_solver());
+  Caffe::set_root_solver(false);
+  // Give each worker a random state of its own, as P2PSync does.
+  if (solver_->param().random_seed() >= 0) {
+    Caffe::set_random_seed(solver_->param().random_seed() + rank_);
+  }
+  try {
+    solver_->Step(solver_->param().max_iter() - initial_iter_);
+  } catch (boost::thread_interrupted&) {
+    // The root solver stopped early, while this worker waited for it.
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Reducer::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      const int bucket = ready_.pop();
+      root_->ReduceBucket(bucket);
+      boost::mutex::scoped_lock lock(root_->mutex_);
+      ++root_->buckets_reduced_;
+      root_->reduced_.notify_all();
+    }
+  } catch (boost::thread_interrupted&) {
+    // Stopped by Run once training is done.
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_start() {
+  backward_passes_ = 0;
+  marked_.assign(root_->buckets_.size(), false);
+  // Wait for the root solver to update the weights.
+  root_->barrier_->wait();
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::run(int layer) {
+  // With iter_size, the gradients are only complete in the last pass.
+  if (backward_passes_ < solver_->param().iter_size() - 1) {
+    if (layer == 0) {
+      ++backward_passes_;
+    }
+    return;
+  }
+  MarkReady(layer);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::MarkReady(int layer) {
+  const int num_workers = root_->diffs_.size();
+  for (int b = root_->buckets_.size() - 1; b >= 0; --b) {
+    if (marked_[b] || root_->bucket_layers_[b] < layer) {
+      continue;
+    }
+    marked_[b] = true;
+    boost::mutex::scoped_lock lock(root_->mutex_);
+    if (++root_->bucket_marks_[b] == num_workers) {
+      root_->reducer_->ready_.push(b);
+    }
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::ReduceBucket(int bucket) {
+  const vector<Dtype*>& diffs = diffs_;
+  const int num_workers = diffs.size();
+  const size_t begin = buckets_[bucket].first;
+  const int count = buckets_[bucket].second - begin;
+  // Every element is added up in rank order, whatever the timing of the
+  // workers.
+  Dtype* dst = diffs[0] + begin;
+  for (int i = 1; i < num_workers; ++i) {
+    caffe_axpy<Dtype>(count, Dtype(1), diffs[i] + begin, dst);
+  }
+  // Loss functions divide gradients by the batch size, so to compensate
+  // for split batch, divide by the number of workers.
+  caffe_scal<Dtype>(count, Dtype(1.0 / num_workers), dst);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_gradients_ready() {
+  // Mark the buckets left, if the backward pass skipped layers.
+  MarkReady(-1);
+  {
+    boost::mutex::scoped_lock lock(root_->mutex_);
+    const int num_buckets = root_->buckets_.size();
+    while (root_->buckets_reduced_ < num_buckets) {
+      root_->reduced_.wait(lock);
+    }
+  }
+  // No worker may clear its diffs before all buckets are reduced, nor mark
+  // buckets of the next iteration before the root resets the counts.
+  root_->barrier_->wait();
+  if (rank_ == 0) {
+    bucket_marks_.assign(buckets_.size(), 0);
+    buckets_reduced_ = 0;
+    // The workers wait for the update of the root before their next
+    // Forward, so their states may be written until then.
+    ReduceStates();
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::ReduceStates() {
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  const int num_workers = workers_.size() + 1;
+  for (int k = 0; k < state_ids_.size(); ++k) {
+    Blob<Dtype>* param = params[state_ids_[k]];
+    const int count = param->count();
+    Dtype* dst = param->mutable_cpu_data();
+    for (int i = 0; i < workers_.size(); ++i) {
+      caffe_axpy<Dtype>(count, Dtype(1), workers_[i]->states_[k]->cpu_data(),
+          dst);
+    }
+    caffe_scal<Dtype>(count, Dtype(1.0 / num_workers), dst);
+    for (int i = 0; i < workers_.size(); ++i) {
+      caffe_copy(count, dst, workers_[i]->states_[k]->mutable_cpu_data());
+    }
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Run(int num_workers) {
+  CHECK(root_ == this) << "Run the root of the workers.";
+  CHECK_GE(num_workers, 1);
+  CHECK_EQ(Caffe::solver_count(), num_workers)
+      << "Set the solver count before creating the root solver.";
+  InitBuckets();
+  LOG(INFO) << "Summing gradients in " << buckets_.size() << " buckets";
+  vector<shared_ptr<CPUSync<Dtype> > > workers(num_workers);
+  diffs_.assign(1, solver_->net()->flat_params()->diff());
+  workers_.clear();
+  // The workers are created in rank order on this thread, so that each gets
+  // the same data reader queue and random seeds in every run.
+  for (int i = 1; i < num_workers; ++i) {
+    workers[i].reset(new CPUSync<Dtype>(solver_, this, i));
+    diffs_.push_back(workers[i]->solver()->net()->flat_params()->diff());
+    workers_.push_back(workers[i].get());
+  }
+  barrier_.reset(new boost::barrier(num_workers));
+
+  const int cpu_threads = Caffe::cpu_threads();
+  Caffe::set_cpu_threads(std::max(1, cpu_threads / num_workers));
+  LOG(INFO) << "Starting Optimization on " << num_workers
+            << " CPU workers with " << Caffe::cpu_threads() << " threads each";
+  reducer_.reset(new Reducer(this));
+  reducer_->StartInternalThread();
+  for (int i = 1; i < num_workers; ++i) {
+    workers[i]->StartInternalThread();
+  }
+
+  // Run root solver on current thread
+  solver_->Solve();
+
+  for (int i = 1; i < num_workers; ++i) {
+    workers[i]->StopInternalThread();
+  }
+  workers_.clear();
+  reducer_.reset();
+  Caffe::set_cpu_threads(cpu_threads);
+}
+
 INSTANTIATE_CLASS(Params);
+INSTANTIATE_CLASS(CPUParams);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(P2PSync);
+INSTANTIATE_CLASS(CPUSync);
 
 }  // namespace caffe
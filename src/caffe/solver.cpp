@@ -1,12 +1,16 @@
+#include <boost/thread.hpp>
 #include <cstdio>
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "caffe/layers/base_data_layer.hpp"
 #include "caffe/solver.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -31,14 +35,18 @@ SolverAction::Enum Solver<Dtype>::GetRequestedAction() {
 template <typename Dtype>
 Solver<Dtype>::Solver(const SolverParameter& param, const Solver* root_solver)
     : net_(), callbacks_(), root_solver_(root_solver),
-      requested_early_exit_(false) {
+      requested_early_exit_(false), tested_iter_(0),
+      async_test_pending_(false), snapshot_in_flight_iter_(-1),
+      telemetry_iter_(0) {
   Init(param);
 }
 
 template <typename Dtype>
 Solver<Dtype>::Solver(const string& param_file, const Solver* root_solver)
     : net_(), callbacks_(), root_solver_(root_solver),
-      requested_early_exit_(false) {
+      requested_early_exit_(false), tested_iter_(0),
+      async_test_pending_(false), snapshot_in_flight_iter_(-1),
+      telemetry_iter_(0) {
   SolverParameter param;
   ReadSolverParamsFromTextFileOrDie(param_file, &param);
   CheckType(&param);
@@ -122,6 +130,7 @@ void Solver<Dtype>::InitTrainNet() {
   } else {
     net_.reset(new Net<Dtype>(net_param, root_solver_->net_.get()));
   }
+  net_->FlattenParams();
 }
 
 template <typename Dtype>
@@ -194,6 +203,11 @@ void Solver<Dtype>::InitTestNets() {
       net_state.MergeFrom(param_.test_state(i));
     }
     net_params[i].mutable_state()->CopyFrom(net_state);
+    // Test nets share the weights of the train net before every test, which
+    // half precision weights cannot.
+    CHECK(!net_params[i].half_precision_params())
+        << "half_precision_params is only supported for deployed nets, not "
+        << "for the test nets of a solver (" << sources[i] << ").";
     LOG(INFO)
         << "Creating test net (#" << i << ") specified by " << sources[i];
     if (Caffe::root_solver()) {
@@ -213,6 +227,11 @@ void Solver<Dtype>::Step(int iters) {
   int average_loss = this->param_.average_loss();
   losses_.clear();
   smoothed_loss_ = 0;
+  const bool telemetry = param_.telemetry_interval() > 0 &&
+      Caffe::root_solver();
+  if (telemetry) {
+    StartTelemetry();
+  }
 
   while (iter_ < stop_iter) {
     // zero-init the params
@@ -220,16 +239,20 @@ void Solver<Dtype>::Step(int iters) {
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
         && (iter_ > 0 || param_.test_initialization())
         && Caffe::root_solver()) {
+      if (telemetry) { stage_timer_->Start(); }
       TestAll();
+      if (telemetry) { stage_ms_.test += stage_timer_->MilliSeconds(); }
       if (requested_early_exit_) {
         // Break out of the while loop because stop was requested while testing.
         break;
       }
     }
 
+    if (telemetry) { stage_timer_->Start(); }
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_start();
     }
+    if (telemetry) { stage_ms_.sync += stage_timer_->MilliSeconds(); }
     const bool display = param_.display() && iter_ % param_.display() == 0;
     net_->set_debug_info(display && param_.debug_info());
     // accumulate the loss and gradient
@@ -263,10 +286,20 @@ void Solver<Dtype>::Step(int iters) {
         }
       }
     }
+    if (param_.prefetch_stats_interval() && Caffe::root_solver() &&
+        iter_ % param_.prefetch_stats_interval() == 0) {
+      DisplayPrefetchStats();
+    }
+    if (telemetry) { stage_timer_->Start(); }
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
     }
+    if (telemetry) {
+      stage_ms_.sync += stage_timer_->MilliSeconds();
+      stage_timer_->Start();
+    }
     ApplyUpdate();
+    if (telemetry) { stage_ms_.update += stage_timer_->MilliSeconds(); }
 
     // Increment the internal iter_ counter -- its value should always indicate
     // the number of times the weights have been updated.
@@ -279,7 +312,12 @@ void Solver<Dtype>::Step(int iters) {
          && iter_ % param_.snapshot() == 0
          && Caffe::root_solver()) ||
          (request == SolverAction::SNAPSHOT)) {
+      if (telemetry) { stage_timer_->Start(); }
       Snapshot();
+      if (telemetry) { stage_ms_.snapshot += stage_timer_->MilliSeconds(); }
+    }
+    if (telemetry && iter_ % param_.telemetry_interval() == 0) {
+      WriteTelemetry();
     }
     if (SolverAction::STOP == request) {
       requested_early_exit_ = true;
@@ -287,6 +325,9 @@ void Solver<Dtype>::Step(int iters) {
       break;
     }
   }
+  if (telemetry) {
+    net_->set_layer_timing(false);
+  }
 }
 
 template <typename Dtype>
@@ -335,48 +376,115 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
     TestAll();
   }
+  WaitForAsyncTest();
   LOG(INFO) << "Optimization Done.";
 }
 
 template <typename Dtype>
 void Solver<Dtype>::TestAll() {
+  if (param_.test_async()) {
+    StartAsyncTest();
+    return;
+  }
+  tested_iter_ = iter_;
   for (int test_net_id = 0;
        test_net_id < test_nets_.size() && !requested_early_exit_;
        ++test_net_id) {
-    if (param_.eval_type() == "classification") {
-      TestClassification(test_net_id);
-    } else if (param_.eval_type() == "detection") {
-      TestDetection(test_net_id);
-    } else {
-      LOG(FATAL) << "Unknown evaluation type: " << param_.eval_type();
+    CHECK_NOTNULL(test_nets_[test_net_id].get())->
+        ShareTrainedLayersWith(net_.get());
+    Test(test_net_id);
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::Test(const int test_net_id) {
+  if (param_.eval_type() == "classification") {
+    TestClassification(test_net_id);
+  } else if (param_.eval_type() == "detection") {
+    TestDetection(test_net_id);
+  } else {
+    LOG(FATAL) << "Unknown evaluation type: " << param_.eval_type();
+  }
+}
+
+template <typename Dtype>
+bool Solver<Dtype>::TestInterrupted() {
+  if (param_.test_async()) {
+    // Requests are handled by the training loop; the background pass only
+    // stops when its thread is stopped.
+    return boost::this_thread::interruption_requested();
+  }
+  SolverAction::Enum request = GetRequestedAction();
+  // Check to see if stoppage of testing/training has been requested.
+  while (request != SolverAction::NONE) {
+      if (SolverAction::SNAPSHOT == request) {
+        Snapshot();
+      } else if (SolverAction::STOP == request) {
+        requested_early_exit_ = true;
+      }
+      request = GetRequestedAction();
+  }
+  return requested_early_exit_;
+}
+
+template <typename Dtype>
+void Solver<Dtype>::StartAsyncTest() {
+  CHECK(Caffe::root_solver());
+  if (!test_thread_) {
+    test_thread_.reset(new TestThread(this));
+    test_thread_->StartInternalThread();
+  }
+  WaitForAsyncTest();
+  for (int i = 0; i < test_nets_.size(); ++i) {
+    CHECK_NOTNULL(test_nets_[i].get())->CopyTrainedLayersFrom(net_.get());
+  }
+  tested_iter_ = iter_;
+  async_test_pending_ = true;
+  test_thread_->requests_.push(iter_);
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForAsyncTest() {
+  if (!async_test_pending_) {
+    return;
+  }
+  test_thread_->done_.pop("Waiting for the test pass of iteration "
+      + format_int(tested_iter_));
+  async_test_pending_ = false;
+}
+
+template <typename Dtype>
+void Solver<Dtype>::TestThread::InternalThreadEntry() {
+  const int cpu_threads = solver_->param_.test_async_cpu_threads();
+  if (cpu_threads > 0) {
+    Caffe::set_cpu_threads(cpu_threads);
+  }
+  try {
+    while (!must_stop()) {
+      const int iter = requests_.pop();
+      for (int i = 0; i < solver_->test_nets_.size() && !must_stop(); ++i) {
+        solver_->Test(i);
+      }
+      done_.push(iter);
     }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
   }
 }
 
 template <typename Dtype>
 void Solver<Dtype>::TestClassification(const int test_net_id) {
   CHECK(Caffe::root_solver());
-  LOG(INFO) << "Iteration " << iter_
+  LOG(INFO) << "Iteration " << tested_iter_
             << ", Testing net (#" << test_net_id << ")";
-  CHECK_NOTNULL(test_nets_[test_net_id].get())->
-      ShareTrainedLayersWith(net_.get());
   vector<Dtype> test_score;
   vector<int> test_score_output_id;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   Dtype loss = 0;
+  bool interrupted = false;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
-    SolverAction::Enum request = GetRequestedAction();
-    // Check to see if stoppage of testing/training has been requested.
-    while (request != SolverAction::NONE) {
-        if (SolverAction::SNAPSHOT == request) {
-          Snapshot();
-        } else if (SolverAction::STOP == request) {
-          requested_early_exit_ = true;
-        }
-        request = GetRequestedAction();
-    }
-    if (requested_early_exit_) {
-      // break out of test loop.
+    if (TestInterrupted()) {
+      interrupted = true;
       break;
     }
 
@@ -404,7 +512,7 @@ void Solver<Dtype>::TestClassification(const int test_net_id) {
       }
     }
   }
-  if (requested_early_exit_) {
+  if (interrupted) {
     LOG(INFO)     << "Test interrupted.";
     return;
   }
@@ -431,28 +539,16 @@ void Solver<Dtype>::TestClassification(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::TestDetection(const int test_net_id) {
   CHECK(Caffe::root_solver());
-  LOG(INFO) << "Iteration " << iter_
+  LOG(INFO) << "Iteration " << tested_iter_
             << ", Testing net (#" << test_net_id << ")";
-  CHECK_NOTNULL(test_nets_[test_net_id].get())->
-      ShareTrainedLayersWith(net_.get());
-  map<int, map<int, vector<pair<float, int> > > > all_true_pos;
-  map<int, map<int, vector<pair<float, int> > > > all_false_pos;
+  map<int, map<int, APAccumulator> > all_detections;
   map<int, map<int, int> > all_num_pos;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   Dtype loss = 0;
+  bool interrupted = false;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
-    SolverAction::Enum request = GetRequestedAction();
-    // Check to see if stoppage of testing/training has been requested.
-    while (request != SolverAction::NONE) {
-        if (SolverAction::SNAPSHOT == request) {
-          Snapshot();
-        } else if (SolverAction::STOP == request) {
-          requested_early_exit_ = true;
-        }
-        request = GetRequestedAction();
-    }
-    if (requested_early_exit_) {
-      // break out of test loop.
+    if (TestInterrupted()) {
+      interrupted = true;
       break;
     }
 
@@ -485,13 +581,19 @@ void Solver<Dtype>::TestDetection(const int test_net_id) {
             // a difficult gt bbox and we don't evaluate on difficult gt bbox.
             continue;
           }
-          all_true_pos[j][label].push_back(std::make_pair(score, tp));
-          all_false_pos[j][label].push_back(std::make_pair(score, fp));
+          CHECK_EQ(tp, 1 - fp);
+          map<int, APAccumulator>& detections = all_detections[j];
+          map<int, APAccumulator>::iterator it = detections.find(label);
+          if (it == detections.end()) {
+            it = detections.insert(std::make_pair(label,
+                APAccumulator(param_.ap_num_bins()))).first;
+          }
+          it->second.AddDetection(score, tp);
         }
       }
     }
   }
-  if (requested_early_exit_) {
+  if (interrupted) {
     LOG(INFO)     << "Test interrupted.";
     return;
   }
@@ -499,43 +601,28 @@ void Solver<Dtype>::TestDetection(const int test_net_id) {
     loss /= param_.test_iter(test_net_id);
     LOG(INFO) << "Test loss: " << loss;
   }
-  for (int i = 0; i < all_true_pos.size(); ++i) {
-    if (all_true_pos.find(i) == all_true_pos.end()) {
-      LOG(FATAL) << "Missing output_blob true_pos: " << i;
-    }
-    const map<int, vector<pair<float, int> > >& true_pos =
-        all_true_pos.find(i)->second;
-    if (all_false_pos.find(i) == all_false_pos.end()) {
-      LOG(FATAL) << "Missing output_blob false_pos: " << i;
+  for (int i = 0; i < all_detections.size(); ++i) {
+    if (all_detections.find(i) == all_detections.end()) {
+      LOG(FATAL) << "Missing output_blob detections: " << i;
     }
-    const map<int, vector<pair<float, int> > >& false_pos =
-        all_false_pos.find(i)->second;
+    const map<int, APAccumulator>& detections = all_detections.find(i)->second;
     if (all_num_pos.find(i) == all_num_pos.end()) {
       LOG(FATAL) << "Missing output_blob num_pos: " << i;
     }
     const map<int, int>& num_pos = all_num_pos.find(i)->second;
     map<int, float> APs;
     float mAP = 0.;
-    // Sort true_pos and false_pos with descend scores.
     for (map<int, int>::const_iterator it = num_pos.begin();
          it != num_pos.end(); ++it) {
       int label = it->first;
       int label_num_pos = it->second;
-      if (true_pos.find(label) == true_pos.end()) {
-        LOG(WARNING) << "Missing true_pos for label: " << label;
+      if (detections.find(label) == detections.end()) {
+        LOG(WARNING) << "Missing detections for label: " << label;
         continue;
       }
-      const vector<pair<float, int> >& label_true_pos =
-          true_pos.find(label)->second;
-      if (false_pos.find(label) == false_pos.end()) {
-        LOG(WARNING) << "Missing false_pos for label: " << label;
-        continue;
-      }
-      const vector<pair<float, int> >& label_false_pos =
-          false_pos.find(label)->second;
       vector<float> prec, rec;
-      ComputeAP(label_true_pos, label_num_pos, label_false_pos,
-                param_.ap_version(), &prec, &rec, &(APs[label]));
+      detections.find(label)->second.ComputeAP(label_num_pos,
+          param_.ap_version(), &prec, &rec, &(APs[label]));
       mAP += APs[label];
       if (param_.show_per_class_result()) {
         LOG(INFO) << "class" << label << ": " << APs[label];
@@ -552,6 +639,12 @@ void Solver<Dtype>::TestDetection(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  // At most one snapshot is in flight.
+  WaitForSnapshot();
+  if (param_.snapshot_async()) {
+    pending_snapshot_.reset(new PendingSnapshot());
+    pending_snapshot_->iter = iter_;
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -565,6 +658,54 @@ void Solver<Dtype>::Snapshot() {
   }
 
   SnapshotSolverState(model_filename);
+  if (pending_snapshot_ && pending_snapshot_->protos.size()) {
+    if (!snapshot_thread_) {
+      snapshot_thread_.reset(new SnapshotThread());
+      snapshot_thread_->StartInternalThread();
+    }
+    snapshot_in_flight_iter_ = iter_;
+    snapshot_thread_->requests_.push(pending_snapshot_);
+  }
+  pending_snapshot_.reset();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshot() {
+  if (snapshot_in_flight_iter_ < 0) {
+    return;
+  }
+  snapshot_thread_->done_.pop("Waiting for the snapshot of iteration "
+      + format_int(snapshot_in_flight_iter_));
+  snapshot_in_flight_iter_ = -1;
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshotProto(
+    const shared_ptr<google::protobuf::Message>& proto,
+    const string& filename) {
+  if (pending_snapshot_) {
+    pending_snapshot_->protos.push_back(proto);
+    pending_snapshot_->filenames.push_back(filename);
+  } else {
+    WriteProtoToBinaryFileAtomic(*proto, filename);
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::SnapshotThread::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      shared_ptr<PendingSnapshot> snapshot = requests_.pop();
+      for (int i = 0; i < snapshot->protos.size(); ++i) {
+        WriteProtoToBinaryFileAtomic(*snapshot->protos[i],
+            snapshot->filenames[i]);
+      }
+      LOG(INFO) << "Snapshot of iteration " << snapshot->iter << " written";
+      done_.push(snapshot->iter);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
 }
 
 template <typename Dtype>
@@ -595,9 +736,9 @@ template <typename Dtype>
 string Solver<Dtype>::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
-  NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
-  WriteProtoToBinaryFile(net_param, model_filename);
+  shared_ptr<NetParameter> net_param(new NetParameter());
+  net_->ToProto(net_param.get(), param_.snapshot_diff());
+  WriteSnapshotProto(net_param, model_filename);
   return model_filename;
 }
 
@@ -605,7 +746,10 @@ template <typename Dtype>
 string Solver<Dtype>::SnapshotToHDF5() {
   string model_filename = SnapshotFilename(".caffemodel.h5");
   LOG(INFO) << "Snapshotting to HDF5 file " << model_filename;
-  net_->ToHDF5(model_filename, param_.snapshot_diff());
+  // HDF5 files are written on the training thread, as the HDF5 library may
+  // not be thread safe.
+  net_->ToHDF5(model_filename + ".tmp", param_.snapshot_diff());
+  CommitTempFile(model_filename + ".tmp", model_filename);
   return model_filename;
 }
 
@@ -621,6 +765,119 @@ void Solver<Dtype>::Restore(const char* state_file) {
   }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::StartTelemetry() {
+  if (!telemetry_file_) {
+    const string filename = param_.snapshot_prefix() + "_telemetry.jsonl";
+    telemetry_file_.reset(new std::ofstream(filename.c_str(),
+        std::ios::out | std::ios::app));
+    CHECK(telemetry_file_->good()) << "Cannot write telemetry to " << filename;
+    LOG(INFO) << "Writing telemetry to " << filename;
+  }
+  net_->set_layer_timing(true);
+  stage_ms_ = StageTimes();
+  telemetry_iter_ = iter_;
+  stage_timer_.reset(new Timer());
+  telemetry_timer_.reset(new Timer());
+  telemetry_timer_->Start();
+}
+
+// JSON has no literal for NaN or infinity, so write those as null.
+static string JsonNumber(double value) {
+  if (isnan(value) || isinf(value)) {
+    return "null";
+  }
+  ostringstream number;
+  number << value;
+  return number.str();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteTelemetry() {
+  const int iters = iter_ - telemetry_iter_;
+  if (iters == 0) {
+    return;
+  }
+  const double wall_ms = telemetry_timer_->MilliSeconds();
+  // Layers without bottoms wait for data, and loss layers, such as the
+  // matching and mining of MultiBoxLoss, are told apart from the others.
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  double data_ms = 0;
+  double forward_ms = 0;
+  double backward_ms = 0;
+  double loss_ms = 0;
+  int batch_size = 0;
+  for (int i = 0; i < layers.size(); ++i) {
+    const double layer_forward_ms = net_->layer_forward_ms()[i];
+    const double layer_backward_ms = net_->layer_backward_ms()[i];
+    const vector<Blob<Dtype>*>& top = net_->top_vecs()[i];
+    bool loss = false;
+    for (int j = 0; j < top.size(); ++j) {
+      loss = loss || layers[i]->loss(j) != Dtype(0);
+    }
+    if (net_->bottom_vecs()[i].empty()) {
+      data_ms += layer_forward_ms;
+      backward_ms += layer_backward_ms;
+      if (batch_size == 0 && top.size() > 0 && top[0]->num_axes() > 0) {
+        batch_size = top[0]->shape(0);
+      }
+    } else if (loss) {
+      loss_ms += layer_forward_ms + layer_backward_ms;
+    } else {
+      forward_ms += layer_forward_ms;
+      backward_ms += layer_backward_ms;
+    }
+  }
+  // Every solver trains on a batch per pass.
+  const double images = static_cast<double>(batch_size) *
+      param_.iter_size() * Caffe::solver_count() * iters;
+  const double images_per_sec = wall_ms > 0 ? images * 1000 / wall_ms : 0;
+  ostringstream record;
+  record << "{\"iter\": " << iter_
+         << ", \"images_per_sec\": " << JsonNumber(images_per_sec)
+         << ", \"loss\": " << JsonNumber(smoothed_loss_)
+         << ", \"iter_ms\": " << JsonNumber(wall_ms / iters)
+         << ", \"data_ms\": " << JsonNumber(data_ms / iters)
+         << ", \"forward_ms\": " << JsonNumber(forward_ms / iters)
+         << ", \"backward_ms\": " << JsonNumber(backward_ms / iters)
+         << ", \"loss_ms\": " << JsonNumber(loss_ms / iters)
+         << ", \"sync_ms\": " << JsonNumber(stage_ms_.sync / iters)
+         << ", \"update_ms\": " << JsonNumber(stage_ms_.update / iters)
+         << ", \"test_ms\": " << JsonNumber(stage_ms_.test / iters)
+         << ", \"snapshot_ms\": " << JsonNumber(stage_ms_.snapshot / iters)
+         << "}";
+  *telemetry_file_ << record.str() << std::endl;
+  net_->ClearLayerTimes();
+  stage_ms_ = StageTimes();
+  telemetry_iter_ = iter_;
+  telemetry_timer_->Start();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::DisplayPrefetchStats() {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    BasePrefetchingDataLayer<Dtype>* data_layer =
+        dynamic_cast<BasePrefetchingDataLayer<Dtype>*>(layers[i].get());
+    if (!data_layer) {
+      continue;
+    }
+    const PrefetchStats stats = data_layer->prefetch_stats(true);
+    if (stats.batches == 0) {
+      continue;
+    }
+    LOG(INFO) << "Prefetch " << net_->layer_names()[i] << ": "
+        << stats.batches << " batches, waited "
+        << stats.wait_time / stats.batches << " ms/batch, queue "
+        << static_cast<float>(stats.full_queue_sum) / stats.batches
+        << "/" << layers[i]->layer_param().data_param().prefetch()
+        << ", load " << stats.load_time / std::max(stats.loaded, 1)
+        << " ms/batch (read " << stats.read_time / std::max(stats.loaded, 1)
+        << ", transform " << stats.transform_time / std::max(stats.loaded, 1)
+        << ")";
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::UpdateSmoothedLoss(Dtype loss, int start_iter,
     int average_loss) {
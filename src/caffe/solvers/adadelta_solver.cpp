@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -106,6 +107,29 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::ComputeFusedUpdate(
+    const FusedUpdateChunk<Dtype>& chunk) {
+  const Dtype delta = this->param_.delta();
+  const Dtype momentum = this->param_.momentum();
+  for (int i = 0; i < chunk.count; ++i) {
+    const Dtype g = chunk.gradient(i);
+    // update history of gradients
+    const Dtype h = (Dtype(1) - momentum) * (g * g) +
+        momentum * chunk.history[i];
+    chunk.history[i] = h;
+    // jointly compute the RMS of both for update and gradient history
+    const Dtype update = g * std::sqrt((chunk.history2[i] + delta) /
+        (h + delta));
+    // update history of updates
+    chunk.history2[i] = (Dtype(1) - momentum) * (update * update) +
+        momentum * chunk.history2[i];
+    // apply learning rate
+    chunk.diff[i] = chunk.local_rate * update;
+    chunk.data[i] -= chunk.diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
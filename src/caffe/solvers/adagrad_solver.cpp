@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -64,6 +65,20 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::ComputeFusedUpdate(
+    const FusedUpdateChunk<Dtype>& chunk) {
+  const Dtype delta = this->param_.delta();
+  for (int i = 0; i < chunk.count; ++i) {
+    const Dtype g = chunk.gradient(i);
+    const Dtype h = chunk.history[i] + g * g;
+    chunk.history[i] = h;
+    const Dtype update = chunk.local_rate * (g / (std::sqrt(h) + delta));
+    chunk.diff[i] = update;
+    chunk.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
@@ -88,6 +88,28 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::ComputeFusedUpdate(
+    const FusedUpdateChunk<Dtype>& chunk) {
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  const Dtype eps_hat = this->param_.delta();
+  const Dtype corrected_local_rate = chunk.local_rate * correction;
+  for (int i = 0; i < chunk.count; ++i) {
+    const Dtype g = chunk.gradient(i);
+    const Dtype m = (Dtype(1) - beta1) * g + beta1 * chunk.history[i];
+    const Dtype v = (Dtype(1) - beta2) * (g * g) + beta2 * chunk.history2[i];
+    chunk.history[i] = m;
+    chunk.history2[i] = v;
+    const Dtype update = corrected_local_rate * (m / (std::sqrt(v) + eps_hat));
+    chunk.diff[i] = update;
+    chunk.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
@@ -56,6 +56,21 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::ComputeFusedUpdate(
+    const FusedUpdateChunk<Dtype>& chunk) {
+  const Dtype momentum = this->param_.momentum();
+  for (int i = 0; i < chunk.count; ++i) {
+    const Dtype h_old = chunk.history[i];
+    const Dtype h = chunk.local_rate * chunk.gradient(i) + momentum * h_old;
+    chunk.history[i] = h;
+    // step back then over step
+    const Dtype update = (Dtype(1) + momentum) * h - momentum * h_old;
+    chunk.diff[i] = update;
+    chunk.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -64,6 +65,22 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void RMSPropSolver<Dtype>::ComputeFusedUpdate(
+    const FusedUpdateChunk<Dtype>& chunk) {
+  const Dtype delta = this->param_.delta();
+  const Dtype rms_decay = this->param_.rms_decay();
+  for (int i = 0; i < chunk.count; ++i) {
+    const Dtype g = chunk.gradient(i);
+    const Dtype h = Dtype(1 - rms_decay) * (g * g) +
+        rms_decay * chunk.history[i];
+    chunk.history[i] = h;
+    const Dtype update = chunk.local_rate * (g / (std::sqrt(h) + delta));
+    chunk.diff[i] = update;
+    chunk.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(RMSPropSolver);
 REGISTER_SOLVER_CLASS(RMSProp);
 
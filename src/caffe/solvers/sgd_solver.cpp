@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <limits>
 #include <string>
 #include <vector>
 
+#include "caffe/parallel.hpp"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -114,9 +116,24 @@ void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  // With the diffs in one array, both passes run over it at once.
+  Dtype* flat_diff = NULL;
+  int flat_count = 0;
+  if (this->net_->flat_params() && Caffe::mode() == Caffe::CPU) {
+    flat_diff = this->net_->flat_params()->diff();
+    for (int i = 0; i < net_params.size(); ++i) {
+      CHECK(net_params[i]->mutable_cpu_diff() == flat_diff + flat_count)
+          << "Param " << i << " no longer uses the memory of FlattenParams.";
+      flat_count += net_params[i]->count();
+    }
+  }
   Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+  if (flat_diff) {
+    sumsq_diff = caffe_cpu_dot(flat_count, flat_diff, flat_diff);
+  } else {
+    for (int i = 0; i < net_params.size(); ++i) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -124,8 +141,12 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
+    if (flat_diff) {
+      caffe_scal(flat_count, scale_factor, flat_diff);
+    } else {
+      for (int i = 0; i < net_params.size(); ++i) {
+        net_params[i]->scale_diff(scale_factor);
+      }
     }
   }
 }
@@ -138,6 +159,10 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
   ClipGradients();
+  if (Caffe::mode() == Caffe::CPU && this->param_.fused_update()) {
+    ApplyFusedUpdate(rate);
+    return;
+  }
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
     Normalize(param_id);
@@ -147,6 +172,60 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+// The number of elements updated by one thread at a time. Large blobs are
+// split across threads, and the chunk stays in the cache from reading the
+// gradient to writing the data.
+static const int kFusedUpdateChunkSize = 16384;
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ApplyFusedUpdate(Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<float>& net_params_lr = this->net_->params_lr();
+  const vector<float>& net_params_weight_decay =
+      this->net_->params_weight_decay();
+  const Dtype weight_decay = this->param_.weight_decay();
+  const string& regularization_type = this->param_.regularization_type();
+  if (regularization_type != "L2" && regularization_type != "L1") {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+  const int num_params = net_params.size();
+  const bool has_history2 = history_.size() >= 2 * num_params;
+  // The pointers are taken here rather than by the threads, as the first
+  // access allocates the memory of the history.
+  vector<FusedUpdateChunk<Dtype> > chunks;
+  for (int param_id = 0; param_id < num_params; ++param_id) {
+    const int count = net_params[param_id]->count();
+    const Dtype local_decay =
+        weight_decay * net_params_weight_decay[param_id];
+    FusedUpdateChunk<Dtype> chunk;
+    chunk.param_id = param_id;
+    chunk.data = net_params[param_id]->mutable_cpu_data();
+    chunk.diff = net_params[param_id]->mutable_cpu_diff();
+    chunk.history = history_[param_id]->mutable_cpu_data();
+    chunk.history2 = has_history2 ?
+        history_[num_params + param_id]->mutable_cpu_data() : NULL;
+    chunk.normalization = Dtype(1.) / this->param_.iter_size();
+    chunk.l2_decay = regularization_type == "L2" ? local_decay : Dtype(0);
+    chunk.l1_decay = regularization_type == "L1" ? local_decay : Dtype(0);
+    chunk.local_rate = rate * net_params_lr[param_id];
+    for (int offset = 0; offset < count; offset += kFusedUpdateChunkSize) {
+      chunks.push_back(chunk);
+      chunks.back().count = std::min(kFusedUpdateChunkSize, count - offset);
+      chunks.back().data += offset;
+      chunks.back().diff += offset;
+      chunks.back().history += offset;
+      if (has_history2) {
+        chunks.back().history2 += offset;
+      }
+    }
+  }
+  const int num_chunks = chunks.size();
+  #pragma omp parallel for schedule(dynamic) if (num_chunks > 1)
+  for (int i = 0; i < num_chunks; ++i) {
+    ComputeFusedUpdate(chunks[i]);
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -274,6 +353,19 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::ComputeFusedUpdate(
+    const FusedUpdateChunk<Dtype>& chunk) {
+  const Dtype momentum = this->param_.momentum();
+  for (int i = 0; i < chunk.count; ++i) {
+    const Dtype h = chunk.local_rate * chunk.gradient(i) +
+        momentum * chunk.history[i];
+    chunk.history[i] = h;
+    chunk.diff[i] = h;
+    chunk.data[i] -= h;
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
@@ -291,22 +383,22 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
     const string& model_filename) {
-  SolverState state;
-  state.set_iter(this->iter_);
-  state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
-  state.set_iter_last_event(this->iter_last_event_);
-  state.set_minimum_loss(this->minimum_loss_);
-  state.clear_history();
+  shared_ptr<SolverState> state(new SolverState());
+  state->set_iter(this->iter_);
+  state->set_learned_net(model_filename);
+  state->set_current_step(this->current_step_);
+  state->set_iter_last_event(this->iter_last_event_);
+  state->set_minimum_loss(this->minimum_loss_);
+  state->clear_history();
   for (int i = 0; i < history_.size(); ++i) {
     // Add history
-    BlobProto* history_blob = state.add_history();
+    BlobProto* history_blob = state->add_history();
     history_[i]->ToProto(history_blob);
   }
   string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  this->WriteSnapshotProto(state, snapshot_filename);
 }
 
 template <typename Dtype>
@@ -315,7 +407,8 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   string snapshot_filename =
       Solver<Dtype>::SnapshotFilename(".solverstate.h5");
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
-  hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
+  const string temp_filename = snapshot_filename + ".tmp";
+  hid_t file_hid = H5Fcreate(temp_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
       << "Couldn't open " << snapshot_filename << " to save solver state.";
@@ -335,6 +428,7 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   }
   H5Gclose(history_hid);
   H5Fclose(file_hid);
+  CommitTempFile(temp_filename, snapshot_filename);
 }
 
 template <typename Dtype>
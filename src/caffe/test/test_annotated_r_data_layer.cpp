@@ -0,0 +1,221 @@
+#ifdef USE_OPENCV
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/annotated_r_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+template <typename TypeParam>
+class AnnotatedRDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  AnnotatedRDataLayerTest()
+      : backend_(DataParameter_DB_LEVELDB),
+        blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()),
+        num_(6),
+        channels_(2),
+        height_(3),
+        width_(4) {}
+
+  virtual void SetUp() {
+    size_ = channels_ * height_ * width_;
+    filename_.reset(new string());
+    cache_file_.reset(new string());
+    MakeTempDir(cache_file_.get());
+    *cache_file_ += "/cache";
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+  }
+
+  virtual ~AnnotatedRDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  // Fill the DB with num_ raw images. Pixel j of record i is
+  // first_pixel + i * size_ + j, and record i has i rboxes of group label i.
+  void Fill(DataParameter_DB backend, int first_pixel = 0) {
+    backend_ = backend;
+    GetTempDirname(filename_.get());
+    LOG(INFO) << "Using temporary dataset " << *filename_;
+    scoped_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(*filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < num_; ++i) {
+      AnnotatedDatumR anno_datum;
+      Datum* datum = anno_datum.mutable_datum();
+      datum->set_channels(channels_);
+      datum->set_height(height_);
+      datum->set_width(width_);
+      std::string* data = datum->mutable_data();
+      for (int j = 0; j < size_; ++j) {
+        data->push_back(static_cast<uint8_t>(first_pixel + i * size_ + j));
+      }
+      anno_datum.set_type(AnnotatedDatumR_AnnotationType_RBOX);
+      if (i > 0) {
+        AnnotationGroupR* anno_group = anno_datum.add_annotation_group();
+        anno_group->set_group_label(i);
+        for (int a = 0; a < i; ++a) {
+          NormalizedRBox* rbox = anno_group->add_annotation()->mutable_rbox();
+          rbox->set_xcenter(0.1 * a);
+          rbox->set_ycenter(0.1 * i);
+          rbox->set_angle(10 * a);
+          rbox->set_width(0.05 * (a + 1));
+          rbox->set_height(0.02 * (i + 1));
+        }
+      }
+      stringstream ss;
+      ss << i;
+      string out;
+      CHECK(anno_datum.SerializeToString(&out));
+      txn->Put(ss.str(), out);
+    }
+    txn->Commit();
+    db->Close();
+  }
+
+  LayerParameter LayerParam(Phase phase, int batch_size, bool cache) {
+    LayerParameter param;
+    param.set_phase(phase);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    if (cache) {
+      AnnotatedRDataParameter* anno_data_param =
+          param.mutable_annotated_r_data_param();
+      anno_data_param->set_cache_decoded(true);
+      anno_data_param->set_cache_file(*cache_file_);
+    }
+    return param;
+  }
+
+  // Reads one batch of all records, and returns the data and label tops.
+  void ReadAll(bool cache, vector<Dtype>* data, vector<Dtype>* label) {
+    AnnotatedRDataLayer<Dtype> layer(LayerParam(TEST, num_, cache));
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    data->assign(blob_top_data_->cpu_data(),
+        blob_top_data_->cpu_data() + blob_top_data_->count());
+    label->assign(blob_top_label_->cpu_data(),
+        blob_top_label_->cpu_data() + blob_top_label_->count());
+  }
+
+  void TestCacheMatchesDB() {
+    vector<Dtype> db_data, db_label;
+    ReadAll(false, &db_data, &db_label);
+    ASSERT_EQ(num_ * size_, static_cast<int>(db_data.size()));
+    for (int j = 0; j < db_data.size(); ++j) {
+      EXPECT_EQ(j, db_data[j]);
+    }
+    // The rboxes of all records, 7 values each.
+    ASSERT_EQ(num_ * (num_ - 1) / 2 * 7, static_cast<int>(db_label.size()));
+
+    // Decode the source and write the cache file, then map it back in.
+    for (int run = 0; run < 2; ++run) {
+      vector<Dtype> cache_data, cache_label;
+      ReadAll(true, &cache_data, &cache_label);
+      EXPECT_TRUE(std::ifstream(cache_file_->c_str()).good());
+      ASSERT_EQ(db_data.size(), cache_data.size());
+      for (int j = 0; j < db_data.size(); ++j) {
+        EXPECT_EQ(db_data[j], cache_data[j]) << "run " << run << " j " << j;
+      }
+      ASSERT_EQ(db_label.size(), cache_label.size());
+      for (int j = 0; j < db_label.size(); ++j) {
+        EXPECT_EQ(db_label[j], cache_label[j]) << "run " << run << " j " << j;
+      }
+    }
+  }
+
+  void TestCacheRebuiltForNewSource() {
+    vector<Dtype> data, label;
+    ReadAll(true, &data, &label);
+    // The cache file of the first source is not mapped for the second.
+    Fill(backend_, 100);
+    vector<Dtype> db_data, cache_data;
+    ReadAll(false, &db_data, &label);
+    ReadAll(true, &cache_data, &label);
+    ASSERT_EQ(db_data.size(), cache_data.size());
+    for (int j = 0; j < db_data.size(); ++j) {
+      EXPECT_EQ(db_data[j], cache_data[j]) << "j " << j;
+    }
+    EXPECT_EQ(0, data[0]);
+    EXPECT_EQ(100, cache_data[0]);
+  }
+
+  void TestCacheSolverStride() {
+    // The second of two solvers gets the records 1, 3 and 5.
+    Caffe::set_solver_count(2);
+    Caffe::set_solver_rank(1);
+    AnnotatedRDataLayer<Dtype> layer(LayerParam(TRAIN, num_ / 2, true));
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    Caffe::set_solver_rank(0);
+    Caffe::set_solver_count(1);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < num_ / 2; ++i) {
+        EXPECT_EQ((2 * i + 1) * size_, blob_top_data_->cpu_data()[i * size_])
+            << "iter " << iter << " i " << i;
+      }
+      EXPECT_EQ(1 + 3 + 5, blob_top_label_->height());
+    }
+  }
+
+  DataParameter_DB backend_;
+  shared_ptr<string> filename_;
+  shared_ptr<string> cache_file_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  int num_;
+  int channels_;
+  int height_;
+  int width_;
+  int size_;
+};
+
+TYPED_TEST_CASE(AnnotatedRDataLayerTest, TestDtypesAndDevices);
+
+#ifdef USE_LEVELDB
+TYPED_TEST(AnnotatedRDataLayerTest, TestCacheMatchesDBLevelDB) {
+  this->Fill(DataParameter_DB_LEVELDB);
+  this->TestCacheMatchesDB();
+}
+#endif  // USE_LEVELDB
+
+#ifdef USE_LMDB
+TYPED_TEST(AnnotatedRDataLayerTest, TestCacheMatchesDBLMDB) {
+  this->Fill(DataParameter_DB_LMDB);
+  this->TestCacheMatchesDB();
+}
+
+TYPED_TEST(AnnotatedRDataLayerTest, TestCacheRebuiltForNewSourceLMDB) {
+  this->Fill(DataParameter_DB_LMDB);
+  this->TestCacheRebuiltForNewSource();
+}
+
+TYPED_TEST(AnnotatedRDataLayerTest, TestCacheSolverStrideLMDB) {
+  this->Fill(DataParameter_DB_LMDB);
+  this->TestCacheSolverStride();
+}
+#endif  // USE_LMDB
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -1554,6 +1554,70 @@ TEST_F(CPUBBoxUtilTest, TestComputeAP) {
   }
 }
 
+TEST_F(CPUBBoxUtilTest, TestAPAccumulator) {
+  const float scores[] = {1.0, 1.0, 0.9, 0.9, 0.8, 0.7, 0.7, 0.6, 0.5, 0.4,
+                          0.4};
+  const int tps[] = {0, 1, 1, 0, 1, 0, 1, 0, 0, 0, 1};
+  const int num = 11;
+  const char* ap_versions[] = {"Integral", "MaxIntegral", "11point"};
+  vector<pair<float, int> > tp;
+  vector<pair<float, int> > fp;
+  APAccumulator exact;
+  for (int i = 0; i < num; ++i) {
+    tp.push_back(std::make_pair(scores[i], tps[i]));
+    fp.push_back(std::make_pair(scores[i], 1 - tps[i]));
+    exact.AddDetection(scores[i], tps[i]);
+  }
+  EXPECT_EQ(num, exact.num_detections());
+
+  float eps = 1e-5;
+  vector<float> prec, rec, expected_prec, expected_rec;
+  float ap, expected_ap;
+  for (int v = 0; v < 3; ++v) {
+    ComputeAP(tp, 5, fp, ap_versions[v], &expected_prec, &expected_rec,
+              &expected_ap);
+    exact.ComputeAP(5, ap_versions[v], &prec, &rec, &ap);
+    EXPECT_NEAR(expected_ap, ap, eps);
+    ASSERT_EQ(expected_prec.size(), prec.size());
+    ASSERT_EQ(expected_rec.size(), rec.size());
+    for (int i = 0; i < prec.size(); ++i) {
+      EXPECT_NEAR(expected_prec[i], prec[i], eps);
+      EXPECT_NEAR(expected_rec[i], rec[i], eps);
+    }
+  }
+
+  // With 20 bins, the tied detections fall into the same bin, and the curve
+  // has a point per distinct score.
+  APAccumulator binned(20);
+  for (int i = 0; i < num; ++i) {
+    binned.AddDetection(scores[i], tps[i]);
+  }
+  EXPECT_EQ(num, binned.num_detections());
+  binned.ComputeAP(5, "Integral", &prec, &rec, &ap);
+  const float binned_prec[] = {1.0/2.0, 2.0/4.0, 3.0/5.0, 4.0/7.0, 4.0/8.0,
+                               4.0/9.0, 5.0/11.0};
+  const float binned_rec[] = {0.2, 0.4, 0.6, 0.8, 0.8, 0.8, 1.0};
+  ASSERT_EQ(7, prec.size());
+  ASSERT_EQ(7, rec.size());
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_NEAR(binned_prec[i], prec[i], eps);
+    EXPECT_NEAR(binned_rec[i], rec[i], eps);
+  }
+  EXPECT_NEAR(0.2 * (1.0/2.0 + 2.0/4.0 + 3.0/5.0 + 4.0/7.0 + 5.0/11.0), ap,
+              eps);
+
+  // A single bin gives the precision and recall of all detections.
+  APAccumulator one_bin(1);
+  for (int i = 0; i < num; ++i) {
+    one_bin.AddDetection(scores[i], tps[i]);
+  }
+  one_bin.ComputeAP(5, "Integral", &prec, &rec, &ap);
+  ASSERT_EQ(1, prec.size());
+  EXPECT_NEAR(5.0/11.0, prec[0], eps);
+  EXPECT_NEAR(1.0, rec[0], eps);
+  EXPECT_NEAR(5.0/11.0, ap, eps);
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void FillBBoxes(Dtype* gt_bboxes, Dtype* pred_bboxes) {
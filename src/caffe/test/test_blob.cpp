@@ -59,6 +59,32 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestStoreDataInHalf) {
+  Blob<TypeParam>* blob = this->blob_preshaped_;
+  const int count = blob->count();
+  for (int i = 0; i < count; ++i) {
+    blob->mutable_cpu_data()[i] = TypeParam(i - 60) / 4;
+  }
+  EXPECT_FALSE(blob->data_in_half());
+  blob->StoreDataInHalf();
+  EXPECT_TRUE(blob->data_in_half());
+  // Quarters up to 15 are exact in half precision.
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(TypeParam(i - 60) / 4, blob->cpu_data()[i]);
+  }
+  // Writes to either representation show in the other.
+  blob->mutable_cpu_data()[1] = 3;
+  EXPECT_EQ(0x4200, blob->cpu_half_data()[1]);
+  blob->mutable_cpu_half_data()[2] = 0x3c00;
+  EXPECT_EQ(1, blob->cpu_data()[2]);
+  EXPECT_EQ(3, blob->cpu_data()[1]);
+  // Growing the blob keeps it in half.
+  blob->Reshape(4, 3, 4, 5);
+  EXPECT_TRUE(blob->data_in_half());
+  EXPECT_TRUE(blob->mutable_cpu_half_data());
+  EXPECT_TRUE(blob->cpu_data());
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
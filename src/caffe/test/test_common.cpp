@@ -1,3 +1,7 @@
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
@@ -27,6 +31,17 @@ TEST_F(CommonTest, TestBrewMode) {
   EXPECT_EQ(Caffe::mode(), Caffe::GPU);
 }
 
+TEST_F(CommonTest, TestCpuThreads) {
+  const int threads = Caffe::cpu_threads();
+  EXPECT_GE(threads, 1);
+  Caffe::set_cpu_threads(3);
+  EXPECT_EQ(3, Caffe::cpu_threads());
+#ifdef _OPENMP
+  EXPECT_EQ(3, omp_get_max_threads());
+#endif
+  Caffe::set_cpu_threads(threads);
+}
+
 TEST_F(CommonTest, TestRandSeedCPU) {
   SyncedMemory data_a(10 * sizeof(int));
   SyncedMemory data_b(10 * sizeof(int));
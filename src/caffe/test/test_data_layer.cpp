@@ -67,7 +67,9 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
-  void TestRead() {
+  // Reads batches of the 5 records, the i-th of which is record order[i],
+  // or record i if order is NULL.
+  void TestRead(int reader_threads = 1, const int* order = NULL) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -75,6 +77,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_reader_threads(reader_threads);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -94,17 +97,110 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     for (int iter = 0; iter < 100; ++iter) {
       layer.Forward(blob_bottom_vec_, blob_top_vec_);
       for (int i = 0; i < 5; ++i) {
-        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        const int record = order ? order[i] : i;
+        EXPECT_EQ(record, blob_top_label_->cpu_data()[i]);
       }
       for (int i = 0; i < 5; ++i) {
+        const int record = order ? order[i] : i;
         for (int j = 0; j < 24; ++j) {
-          EXPECT_EQ(scale * i, blob_top_data_->cpu_data()[i * 24 + j])
+          EXPECT_EQ(scale * record, blob_top_data_->cpu_data()[i * 24 + j])
               << "debug: iter " << iter << " i " << i << " j " << j;
         }
       }
     }
   }
 
+  void TestPrefetchStats(int prefetch) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_prefetch(prefetch);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+      }
+    }
+    PrefetchStats stats = layer.prefetch_stats(true);
+    EXPECT_EQ(stats.batches, 10);
+    EXPECT_GE(stats.loaded, 10);
+    EXPECT_LE(stats.full_queue_sum, 10 * prefetch);
+    EXPECT_GE(stats.wait_time, 0);
+    stats = layer.prefetch_stats(false);
+    EXPECT_EQ(stats.batches, 0);
+    EXPECT_EQ(stats.full_queue_sum, 0);
+  }
+
+  // Every batch holds the whole db, so with shuffle_keys each batch must be a
+  // permutation of the labels and the order should change across epochs.
+  void TestReadShuffleKeys() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle_keys(true);
+
+    Caffe::set_random_seed(seed_);
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    bool order_changed = false;
+    for (int iter = 0; iter < 20; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      vector<bool> seen(5, false);
+      for (int i = 0; i < 5; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        ASSERT_GE(label, 0);
+        ASSERT_LT(label, 5);
+        EXPECT_FALSE(seen[label]) << "debug: iter " << iter << " i " << i;
+        seen[label] = true;
+        order_changed |= label != i;
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24 + j]);
+        }
+      }
+    }
+    EXPECT_TRUE(order_changed);
+  }
+
+  // Records drawn from a shuffle buffer must still match their labels.
+  void TestReadShuffleBuffer() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle_buffer(3);
+
+    Caffe::set_random_seed(seed_);
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    vector<int> counts(5, 0);
+    for (int iter = 0; iter < 20; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        ASSERT_GE(label, 0);
+        ASSERT_LT(label, 5);
+        ++counts[label];
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24 + j]);
+        }
+      }
+    }
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_GT(counts[i], 0);
+    }
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -396,6 +492,34 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadMultiReaderLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  // The readers of keys {0}, {1, 2} and {3, 4} take turns, and then deal
+  // the records left over.
+  const int order[] = {0, 1, 3, 2, 4};
+  this->TestRead(3, order);
+}
+
+TYPED_TEST(DataLayerTest, TestPrefetchStatsLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestPrefetchStats(1);
+  this->TestPrefetchStats(6);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffleKeysLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadShuffleKeys();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffleBufferLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadShuffleBuffer();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -93,6 +93,30 @@ TYPED_TEST(DBTest, TestSeekToFirst) {
   EXPECT_EQ(datum.width(), 480);
 }
 
+TYPED_TEST(DBTest, TestSeek) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ_RANDOM);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  cursor->Seek("fish-bike.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  Datum datum;
+  datum.ParseFromString(cursor->value());
+  EXPECT_EQ(datum.height(), 323);
+  EXPECT_EQ(datum.width(), 481);
+  cursor->Seek("cat.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "cat.jpg");
+  cursor->Next();
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  // Keys that are not in the source find the next key, if any.
+  cursor->Seek("dog.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  cursor->Seek("zebra.jpg");
+  EXPECT_FALSE(cursor->valid());
+}
+
 TYPED_TEST(DBTest, TestKeyValue) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::READ);
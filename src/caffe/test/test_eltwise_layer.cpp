@@ -206,4 +206,43 @@ TYPED_TEST(EltwiseLayerTest, TestMaxGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(EltwiseLayerTest, TestForwardThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // Large enough for the elements to be computed in parallel.
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+    this->blob_bottom_vec_[i]->Reshape(4, 16, 24, 24);
+    filler.Fill(this->blob_bottom_vec_[i]);
+  }
+  const int threads = Caffe::cpu_threads();
+  const EltwiseParameter_EltwiseOp ops[] = {
+    EltwiseParameter_EltwiseOp_PROD, EltwiseParameter_EltwiseOp_SUM,
+    EltwiseParameter_EltwiseOp_MAX
+  };
+  for (int op = 0; op < 3; ++op) {
+    LayerParameter layer_param;
+    EltwiseParameter* eltwise_param = layer_param.mutable_eltwise_param();
+    eltwise_param->set_operation(ops[op]);
+    if (ops[op] == EltwiseParameter_EltwiseOp_SUM) {
+      eltwise_param->add_coeff(1);
+      eltwise_param->add_coeff(-0.5);
+      eltwise_param->add_coeff(2);
+    }
+    EltwiseLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    Caffe::set_cpu_threads(1);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> expected;
+    expected.CopyFrom(*this->blob_top_, false, true);
+    Caffe::set_cpu_threads(4);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+    }
+  }
+  Caffe::set_cpu_threads(threads);
+}
+
 }  // namespace caffe
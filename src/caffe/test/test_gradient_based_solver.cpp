@@ -26,7 +26,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), fused_update_(true), regularization_type_("L2"),
+      cpu_workers_(1), reduce_bucket_size_(262144) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -37,11 +38,17 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   string snapshot_prefix_;
   shared_ptr<SGDSolver<Dtype> > solver_;
   shared_ptr<P2PSync<Dtype> > sync_;
+  shared_ptr<CPUSync<Dtype> > cpu_sync_;
   int seed_;
   // Dimensions are determined by generate_sample_data.py
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  bool fused_update_;
+  string regularization_type_;
+  // The number of CPU workers TestLeastSquaresUpdate runs on in CPU mode.
+  int cpu_workers_;
+  int reduce_bucket_size_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -176,12 +183,18 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
     }
+    proto << "regularization_type: '" << regularization_type_ << "' ";
+    proto << "fused_update: " << fused_update_ << " ";
+    proto << "reduce_bucket_size: " << reduce_bucket_size_ << " ";
     MakeTempDir(&snapshot_prefix_);
     proto << "snapshot_prefix: '" << snapshot_prefix_ << "/' ";
     if (snapshot) {
       proto << "snapshot: " << num_iters << " ";
     }
     Caffe::set_random_seed(this->seed_);
+    if (Caffe::mode() == Caffe::CPU) {
+      Caffe::set_solver_count(devices);
+    }
     this->InitSolverFromProtoString(proto.str());
     if (from_snapshot != NULL) {
       this->solver_->Restore(from_snapshot);
@@ -191,6 +204,11 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     }
     if (devices == 1) {
       this->solver_->Solve();
+    } else if (Caffe::mode() == Caffe::CPU) {
+      LOG(INFO) << "Multi-worker CPU test on " << devices << " workers";
+      this->cpu_sync_.reset(new CPUSync<Dtype>(this->solver_));
+      this->cpu_sync_->Run(devices);
+      Caffe::set_solver_count(1);
     } else {
       LOG(INFO) << "Multi-GPU test on " << devices << " devices";
       vector<int> gpus;
@@ -435,6 +453,72 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     EXPECT_NEAR(expected_bias, accum_bias, error_margin);
   }
 
+  // Check that the fused CPU update matches the separate Normalize,
+  // Regularize and ComputeUpdateValue passes.
+  void CheckFusedUpdate(const Dtype kLearningRate, const Dtype kWeightDecay,
+      const Dtype kMomentum, const int kNumIters, const int kIterSize) {
+    const double kPrecision = 1e-4;
+    const double kMinPrecision = 1e-6;
+    // The fused update only exists on the CPU path; in GPU mode both runs
+    // would take the same GPU update and the comparison would prove nothing.
+    if (Caffe::mode() != Caffe::CPU) {
+      LOG(INFO) << "Skipping fused update check outside CPU mode.";
+      return;
+    }
+    // Solve with the separate passes and save parameters and history.
+    fused_update_ = false;
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters, kIterSize);
+    const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+    vector<shared_ptr<Blob<Dtype> > > param_copies(params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      param_copies[i].reset(new Blob<Dtype>());
+      param_copies[i]->CopyFrom(*params[i], false, true);
+      param_copies[i]->CopyFrom(*params[i], true, true);
+    }
+    const vector<shared_ptr<Blob<Dtype> > >& history = solver_->history();
+    vector<shared_ptr<Blob<Dtype> > > history_copies(history.size());
+    for (int i = 0; i < history.size(); ++i) {
+      history_copies[i].reset(new Blob<Dtype>());
+      history_copies[i]->CopyFrom(*history[i], false, true);
+    }
+    // Solve again with the fused update.
+    fused_update_ = true;
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters, kIterSize);
+    const vector<Blob<Dtype>*>& fused_params =
+        solver_->net()->learnable_params();
+    ASSERT_EQ(param_copies.size(), fused_params.size());
+    for (int i = 0; i < fused_params.size(); ++i) {
+      ASSERT_EQ(param_copies[i]->count(), fused_params[i]->count());
+      for (int j = 0; j < fused_params[i]->count(); ++j) {
+        const Dtype expected_data = param_copies[i]->cpu_data()[j];
+        const Dtype fused_data = fused_params[i]->cpu_data()[j];
+        EXPECT_NEAR(expected_data, fused_data, std::max(kMinPrecision,
+            kPrecision * std::min(fabs(expected_data), fabs(fused_data))))
+            << "param " << i << " data differed at dim " << j;
+        const Dtype expected_diff = param_copies[i]->cpu_diff()[j];
+        const Dtype fused_diff = fused_params[i]->cpu_diff()[j];
+        EXPECT_NEAR(expected_diff, fused_diff, std::max(kMinPrecision,
+            kPrecision * std::min(fabs(expected_diff), fabs(fused_diff))))
+            << "param " << i << " diff differed at dim " << j;
+      }
+    }
+    const vector<shared_ptr<Blob<Dtype> > >& fused_history =
+        solver_->history();
+    ASSERT_EQ(history_copies.size(), fused_history.size());
+    for (int i = 0; i < fused_history.size(); ++i) {
+      for (int j = 0; j < fused_history[i]->count(); ++j) {
+        const Dtype expected_history = history_copies[i]->cpu_data()[j];
+        const Dtype fused_history_value = fused_history[i]->cpu_data()[j];
+        EXPECT_NEAR(expected_history, fused_history_value,
+            std::max(kMinPrecision, kPrecision *
+            std::min(fabs(expected_history), fabs(fused_history_value))))
+            << "history blob " << i << " data differed at dim " << j;
+      }
+    }
+  }
+
   // Test that the correct update is computed for a regularized least squares
   // problem:
   //
@@ -456,7 +540,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     const int kNum = num_;
     const int kIterSize = 1;
     // Test over all numbers of devices.
-    int available_devices = 1;
+    int available_devices = Caffe::mode() == Caffe::CPU ? cpu_workers_ : 1;
 #ifndef CPU_ONLY
     if (Caffe::mode() == Caffe::GPU) {
       CUDA_CHECK(cudaGetDeviceCount(&available_devices));
@@ -636,6 +720,36 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverything) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingCPUWorkers) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.5;
+  const int kNumIters = 4;
+  this->cpu_workers_ = 3;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateCPUWorkersBuckets) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.5;
+  const int kNumIters = 4;
+  // The weights and the bias of the inner product are summed apart, as soon
+  // as the backward pass of each worker is done with them.
+  this->cpu_workers_ = 2;
+  this->reduce_bucket_size_ = 1;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+  if (Caffe::mode() == Caffe::CPU) {
+    EXPECT_EQ(2, static_cast<int>(this->cpu_sync_->buckets().size()));
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -671,6 +785,41 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(SGDSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(SGDSolverTest, TestFusedUpdateL1) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 1;
+  this->regularization_type_ = "L1";
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(SGDSolverTest, TestFusedUpdateShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->share_ = true;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(SGDSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -776,6 +925,17 @@ TYPED_TEST(AdaGradSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(AdaGradSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.0;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdaGradSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -910,6 +1070,17 @@ TYPED_TEST(NesterovSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(NesterovSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(NesterovSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1039,6 +1210,17 @@ TYPED_TEST(AdaDeltaSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(AdaDeltaSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.95;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdaDeltaSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.1;
@@ -1141,6 +1323,17 @@ TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(AdamSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(AdamSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1244,6 +1437,17 @@ TYPED_TEST(RMSPropSolverTest, TestLeastSquaresUpdateWithEverythingAccumShare) {
       kIterSize);
 }
 
+TYPED_TEST(RMSPropSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.0;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 TYPED_TEST(RMSPropSolverTest, TestSnapshot) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -0,0 +1,143 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/layers/int8_conv_layer.hpp"
+#include "caffe/layers/int8_inner_product_layer.hpp"
+#include "caffe/util/int8_math.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class Int8LayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  Int8LayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 4, 9, 8)),
+        blob_top_(new Blob<Dtype>()),
+        blob_ref_top_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    // The bottom range is the calibrated [-1, 1].
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    blob_ref_top_vec_.push_back(blob_ref_top_);
+  }
+  virtual ~Int8LayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_ref_top_;
+  }
+
+  // Runs the float and the INT8 version of a layer with the same weights.
+  void ForwardBoth(LayerParameter layer_param) {
+    layer_param.set_phase(TEST);
+    shared_ptr<Layer<Dtype> > ref_layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    ref_layer->SetUp(blob_bottom_vec_, blob_ref_top_vec_);
+    ref_layer->Forward(blob_bottom_vec_, blob_ref_top_vec_);
+    layer_param.mutable_quantization_param()->set_bottom_max(1);
+    layer_ = LayerRegistry<Dtype>::CreateLayer(layer_param);
+    layer_->SetUp(blob_bottom_vec_, blob_top_vec_);
+    for (int i = 0; i < ref_layer->blobs().size(); ++i) {
+      layer_->blobs()[i]->CopyFrom(*ref_layer->blobs()[i]);
+    }
+    layer_->Forward(blob_bottom_vec_, blob_top_vec_);
+    ASSERT_EQ(blob_ref_top_->shape(), blob_top_->shape());
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_ref_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  vector<Blob<Dtype>*> blob_ref_top_vec_;
+  shared_ptr<Layer<Dtype> > layer_;
+};
+
+TYPED_TEST_CASE(Int8LayerTest, TestDtypes);
+
+TYPED_TEST(Int8LayerTest, TestGemm) {
+  // Sizes around the vector widths of the AVX2 and VNNI kernels.
+  const int sizes[][3] = {{1, 1, 1}, {3, 5, 15}, {4, 9, 33}, {7, 70, 100}};
+  for (int s = 0; s < 4; ++s) {
+    const int M = sizes[s][0];
+    const int N = sizes[s][1];
+    const int K = sizes[s][2];
+    vector<int8_t> A(M * K);
+    vector<int8_t> B(N * K);
+    vector<int32_t> C(M * N);
+    for (int i = 0; i < A.size(); ++i) {
+      A[i] = static_cast<int8_t>(caffe_rng_rand() % 255 - 127);
+    }
+    for (int i = 0; i < B.size(); ++i) {
+      B[i] = static_cast<int8_t>(caffe_rng_rand() % 255 - 127);
+    }
+    caffe_cpu_gemm_s8(M, N, K, &A[0], &B[0], &C[0]);
+    for (int m = 0; m < M; ++m) {
+      for (int n = 0; n < N; ++n) {
+        int32_t expected = 0;
+        for (int k = 0; k < K; ++k) {
+          expected += A[m * K + k] * B[n * K + k];
+        }
+        EXPECT_EQ(expected, C[m * N + n]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(Int8LayerTest, TestConvolution) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->ForwardBoth(layer_param);
+  EXPECT_TRUE(dynamic_cast<Int8ConvolutionLayer<Dtype>*>(this->layer_.get()));
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_ref_top_->cpu_data()[i],
+                this->blob_top_->cpu_data()[i], 0.2);
+  }
+}
+
+TYPED_TEST(Int8LayerTest, TestInnerProduct) {
+  typedef TypeParam Dtype;
+  for (int transpose = 0; transpose <= 1; ++transpose) {
+    LayerParameter layer_param;
+    layer_param.set_type("InnerProduct");
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(10);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    this->ForwardBoth(layer_param);
+    EXPECT_TRUE(
+        dynamic_cast<Int8InnerProductLayer<Dtype>*>(this->layer_.get()));
+    // The patches have 288 values, so allow for more rounding error.
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(this->blob_ref_top_->cpu_data()[i],
+                  this->blob_top_->cpu_data()[i], 0.6);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -1,12 +1,16 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
 #include <cmath>  // for std::fabs
+#include <map>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/gemm.hpp"
+#include "caffe/util/half_math.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -119,6 +123,140 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestHalfConversion) {
+  // Every finite half converts to float and back unchanged.
+  vector<uint16_t> halves;
+  for (int h = 0; h < 0x10000; ++h) {
+    if ((h & 0x7c00) != 0x7c00) { halves.push_back(h); }
+  }
+  const int num_halves = halves.size();
+  vector<TypeParam> values(num_halves);
+  vector<uint16_t> round_trip(num_halves);
+  caffe_cpu_half2float(num_halves, &halves[0], &values[0]);
+  caffe_cpu_float2half(num_halves, &values[0], &round_trip[0]);
+  for (int i = 0; i < num_halves; ++i) {
+    EXPECT_EQ(halves[i], round_trip[i]);
+  }
+  EXPECT_EQ(1, caffe_half_to_float(0x3c00));
+  EXPECT_EQ(-2, caffe_half_to_float(0xc000));
+  // Rounding to nearest, ties to even, with overflow to infinity and
+  // underflow through the subnormals.
+  EXPECT_EQ(0x3c00, caffe_float_to_half(1 + 1.f / 2048));
+  EXPECT_EQ(0x3c02, caffe_float_to_half(1 + 3.f / 2048));
+  EXPECT_EQ(0x3c01, caffe_float_to_half(1 + 1.5f / 2048));
+  EXPECT_EQ(0x7bff, caffe_float_to_half(65519));
+  EXPECT_EQ(0x7c00, caffe_float_to_half(65520));
+  EXPECT_EQ(0xfc00, caffe_float_to_half(-1e10));
+  EXPECT_EQ(0x0001, caffe_float_to_half(std::ldexp(1.f, -24)));
+  EXPECT_EQ(0x0000, caffe_float_to_half(std::ldexp(1.f, -25)));
+  EXPECT_EQ(0x0001, caffe_float_to_half(std::ldexp(1.5f, -25)));
+  // The vectorized conversion agrees with the scalar one.
+  const int n = this->blob_bottom_->count();
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  vector<uint16_t> y(n);
+  caffe_cpu_float2half(n, x, &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(caffe_float_to_half(x[i]), y[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestGemmPacked) {
+  // Sizes that leave partial blocks and tiles in every dimension.
+  const int M = 37, N = 45, K = 300;
+  Blob<TypeParam> A(1, 1, M, K);
+  Blob<TypeParam> B(1, 1, K, N);
+  Blob<TypeParam> C(1, 1, M, N);
+  Blob<TypeParam> C_packed(1, 1, M, N);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(&A);
+  filler.Fill(&B);
+  const CBLAS_TRANSPOSE trans[2] = {CblasNoTrans, CblasTrans};
+  const TypeParam betas[2] = {0, 0.5};
+  for (int ta = 0; ta < 2; ++ta) {
+    for (int tb = 0; tb < 2; ++tb) {
+      for (int b = 0; b < 2; ++b) {
+        filler.Fill(&C);
+        caffe_copy(C.count(), C.cpu_data(), C_packed.mutable_cpu_data());
+        caffe_cpu_gemm_on<TypeParam>(GEMM_BLAS, trans[ta], trans[tb], M, N,
+            K, 1.5, A.cpu_data(), B.cpu_data(), betas[b],
+            C.mutable_cpu_data());
+        caffe_cpu_gemm_on<TypeParam>(GEMM_PACKED, trans[ta], trans[tb], M, N,
+            K, 1.5, A.cpu_data(), B.cpu_data(), betas[b],
+            C_packed.mutable_cpu_data());
+        for (int i = 0; i < C.count(); ++i) {
+          EXPECT_NEAR(C.cpu_data()[i], C_packed.cpu_data()[i], 1e-3);
+        }
+      }
+    }
+  }
+  // caffe_cpu_gemm follows the backend set for the shape.
+  std::map<GemmShape, int> calls;
+  caffe_record_gemm_shapes(&calls);
+  caffe_set_gemm_backend(GemmShape(CblasNoTrans, CblasNoTrans, M, N, K),
+      GEMM_PACKED);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1.,
+      A.cpu_data(), B.cpu_data(), 0., C.mutable_cpu_data());
+  caffe_record_gemm_shapes(NULL);
+  caffe_clear_gemm_shape_backends();
+  EXPECT_EQ(1, calls.size());
+  EXPECT_EQ(1, calls[GemmShape(CblasNoTrans, CblasNoTrans, M, N, K)]);
+  caffe_cpu_gemm_on<TypeParam>(GEMM_PACKED, CblasNoTrans, CblasNoTrans, M, N,
+      K, 1., A.cpu_data(), B.cpu_data(), 0., C_packed.mutable_cpu_data());
+  for (int i = 0; i < C.count(); ++i) {
+    EXPECT_EQ(C_packed.cpu_data()[i], C.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestGemmHalf) {
+  const int M = 37, N = 45, K = 300;
+  Blob<TypeParam> A(1, 1, M, K);
+  Blob<TypeParam> B(1, 1, K, N);
+  Blob<TypeParam> C_init(1, 1, M, N);
+  Blob<TypeParam> C(1, 1, M, N);
+  Blob<TypeParam> C_half(1, 1, M, N);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(&A);
+  filler.Fill(&B);
+  filler.Fill(&C_init);
+  // Round the operands to half, so that both GEMMs multiply the same values.
+  Blob<TypeParam> A_half, B_half;
+  A_half.CopyFrom(A, false, true);
+  A_half.StoreDataInHalf();
+  A.CopyFrom(A_half);
+  B_half.CopyFrom(B, false, true);
+  B_half.StoreDataInHalf();
+  B.CopyFrom(B_half);
+  const CBLAS_TRANSPOSE trans[2] = {CblasNoTrans, CblasTrans};
+  for (int ta = 0; ta < 2; ++ta) {
+    for (int tb = 0; tb < 2; ++tb) {
+      C.CopyFrom(C_init);
+      caffe_cpu_gemm_on<TypeParam>(GEMM_BLAS, trans[ta], trans[tb], M, N,
+          K, 1.5, A.cpu_data(), B.cpu_data(), 0.5, C.mutable_cpu_data());
+      for (int half = 0; half < 3; ++half) {
+        C_half.CopyFrom(C_init);
+        if (half == 0) {
+          caffe_cpu_gemm_half<TypeParam>(trans[ta], trans[tb], M, N, K, 1.5,
+              A_half.cpu_half_data(), B.cpu_data(), 0.5,
+              C_half.mutable_cpu_data());
+        } else if (half == 1) {
+          caffe_cpu_gemm_half<TypeParam>(trans[ta], trans[tb], M, N, K, 1.5,
+              A.cpu_data(), B_half.cpu_half_data(), 0.5,
+              C_half.mutable_cpu_data());
+        } else {
+          caffe_cpu_gemm_half<TypeParam>(trans[ta], trans[tb], M, N, K, 1.5,
+              A_half.cpu_half_data(), B_half.cpu_half_data(), 0.5,
+              C_half.mutable_cpu_data());
+        }
+        for (int i = 0; i < C.count(); ++i) {
+          EXPECT_NEAR(C.cpu_data()[i], C_half.cpu_data()[i], 1e-3);
+        }
+      }
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
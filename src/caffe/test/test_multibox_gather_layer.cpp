@@ -0,0 +1,115 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/concat_layer.hpp"
+#include "caffe/layers/flatten_layer.hpp"
+#include "caffe/layers/multibox_gather_layer.hpp"
+#include "caffe/layers/permute_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class MultiBoxGatherLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  MultiBoxGatherLayerTest()
+      : blob_bottom_0_(new Blob<Dtype>(2, 8, 5, 4)),
+        blob_bottom_1_(new Blob<Dtype>(2, 3, 3, 2)),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_0_);
+    filler.Fill(this->blob_bottom_1_);
+    blob_bottom_vec_.push_back(blob_bottom_0_);
+    blob_bottom_vec_.push_back(blob_bottom_1_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~MultiBoxGatherLayerTest() {
+    delete blob_bottom_0_;
+    delete blob_bottom_1_;
+    delete blob_top_;
+  }
+
+  Blob<Dtype>* const blob_bottom_0_;
+  Blob<Dtype>* const blob_bottom_1_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(MultiBoxGatherLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(MultiBoxGatherLayerTest, TestSetup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MultiBoxGatherLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num_axes(), 2);
+  EXPECT_EQ(this->blob_top_->shape(0), 2);
+  EXPECT_EQ(this->blob_top_->shape(1), 8 * 5 * 4 + 3 * 3 * 2);
+}
+
+TYPED_TEST(MultiBoxGatherLayerTest, TestForwardMatchesPermuteConcat) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MultiBoxGatherLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  // Reference: Permute (0, 2, 3, 1) + Flatten (axis 1) per bottom, then
+  // Concat along axis 1.
+  LayerParameter permute_param;
+  permute_param.mutable_permute_param()->add_order(0);
+  permute_param.mutable_permute_param()->add_order(2);
+  permute_param.mutable_permute_param()->add_order(3);
+  permute_param.mutable_permute_param()->add_order(1);
+  LayerParameter flatten_param;
+  flatten_param.mutable_flatten_param()->set_axis(1);
+  vector<shared_ptr<Blob<Dtype> > > permuted(2), flat(2);
+  vector<Blob<Dtype>*> concat_bottom;
+  for (int i = 0; i < 2; ++i) {
+    permuted[i].reset(new Blob<Dtype>());
+    flat[i].reset(new Blob<Dtype>());
+    vector<Blob<Dtype>*> bottom(1, this->blob_bottom_vec_[i]);
+    vector<Blob<Dtype>*> mid(1, permuted[i].get());
+    vector<Blob<Dtype>*> top(1, flat[i].get());
+    PermuteLayer<Dtype> permute(permute_param);
+    permute.SetUp(bottom, mid);
+    permute.Forward(bottom, mid);
+    FlattenLayer<Dtype> flatten(flatten_param);
+    flatten.SetUp(mid, top);
+    flatten.Forward(mid, top);
+    concat_bottom.push_back(flat[i].get());
+  }
+  Blob<Dtype> expected;
+  vector<Blob<Dtype>*> expected_vec(1, &expected);
+  LayerParameter concat_param;
+  ConcatLayer<Dtype> concat(concat_param);
+  concat.SetUp(concat_bottom, expected_vec);
+  concat.Forward(concat_bottom, expected_vec);
+
+  ASSERT_EQ(expected.count(), this->blob_top_->count());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(MultiBoxGatherLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MultiBoxGatherLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -9,6 +12,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/parallel.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -629,6 +633,316 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitConvBatchNormNet() {
+    const string& proto =
+        "name: 'ConvBatchNormNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 8 dim: 8 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    bias_term: false "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bn1' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'scale1' "
+        "  type: 'Scale' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "  scale_param { "
+        "    bias_term: true "
+        "    filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "  relu_param { "
+        "    negative_slope: 0.1 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 5 "
+        "    kernel_size: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'constant' "
+        "      value: 0.2 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  // Gives the BatchNorm layer of InitConvBatchNormNet non-trivial statistics
+  // and fills the input uniformly in [-1, 1].
+  virtual void FillConvBatchNormNet() {
+    FillerParameter filler_param;
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    UniformFiller<Dtype> filler(filler_param);
+    const vector<shared_ptr<Blob<Dtype> > >& bn_blobs =
+        net_->layer_by_name("bn1")->blobs();
+    filler.Fill(bn_blobs[0].get());
+    filler.Fill(bn_blobs[1].get());
+    bn_blobs[2]->mutable_cpu_data()[0] = 2;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> data_filler(filler_param);
+    data_filler.Fill(net_->blob_by_name("data").get());
+  }
+
+  virtual void InitResidualTestNet() {
+    const string& proto =
+        "name: 'ResidualTestNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 8 dim: 8 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv3' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv2' "
+        "  top: 'conv3' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'conv1' "
+        "  bottom: 'conv3' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'flat' "
+        "  type: 'Flatten' "
+        "  bottom: 'sum' "
+        "  top: 'flat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flat' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitResidualTrainNet(const bool share_memory,
+      const bool recompute) {
+    string proto =
+        "name: 'ResidualTrainNetwork' "
+        "state { phase: TRAIN } ";
+    if (share_memory) {
+      proto += "share_training_memory: true ";
+    }
+    const string recompute_param = recompute ? "  recompute: true " : "";
+    proto +=
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'target' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 8 dim: 8 } "
+        "  shape: { dim: 2 dim: 10 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' " + recompute_param +
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'relu2' " + recompute_param +
+        "} "
+        "layer { "
+        "  name: 'conv3' "
+        "  type: 'Convolution' "
+        "  bottom: 'relu2' "
+        "  top: 'conv3' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'conv1' "
+        "  bottom: 'conv3' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'flat' "
+        "  type: 'Flatten' "
+        "  bottom: 'sum' "
+        "  top: 'flat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flat' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -1297,6 +1611,58 @@ TYPED_TEST(NetTest, TestSharedWeightsUpdate) {
   }
 }
 
+TYPED_TEST(NetTest, TestFlattenParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  const bool reshape = true;
+  const bool copy_diff = false;
+  vector<shared_ptr<Blob<Dtype> > > param_copies(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    param_copies[i].reset(new Blob<Dtype>());
+    param_copies[i]->CopyFrom(*params[i], copy_diff, reshape);
+  }
+  EXPECT_TRUE(this->net_->flat_params() == NULL);
+  this->net_->FlattenParams();
+  ASSERT_TRUE(this->net_->flat_params() != NULL);
+  // Check that the params keep their values, and lie one after the other.
+  const Dtype* flat_data = this->net_->flat_params()->data();
+  const Dtype* flat_diff = this->net_->flat_params()->diff();
+  int offset = 0;
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(flat_data + offset, params[i]->cpu_data());
+    EXPECT_EQ(flat_diff + offset, params[i]->cpu_diff());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(param_copies[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+    offset += params[i]->count();
+  }
+  EXPECT_EQ(offset, static_cast<int>(this->net_->flat_params()->size()));
+  // Check that shared weights still share the same memory locations.
+  Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+  EXPECT_EQ(ip1_weights->cpu_diff(), ip2_weights->cpu_diff());
+  // Check that the update over the flat arrays is the one of each blob.
+  this->net_->ClearParamDiffs();
+  this->net_->Forward();
+  this->net_->Backward();
+  for (int i = 0; i < params.size(); ++i) {
+    param_copies[i]->CopyFrom(*params[i], copy_diff, reshape);
+    param_copies[i]->CopyFrom(*params[i], !copy_diff, reshape);
+    caffe_axpy(params[i]->count(), Dtype(-1), param_copies[i]->cpu_diff(),
+               param_copies[i]->mutable_cpu_data());
+  }
+  this->net_->Update();
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(flat_data, this->net_->flat_params()->data());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(param_copies[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSharedWeightsResume) {
   typedef typename TypeParam::Dtype Dtype;
 
@@ -2446,6 +2812,217 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestFuseLayersForInference) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitConvBatchNormNet();
+  this->FillConvBatchNormNet();
+
+  Blob<Dtype>* output_blob = this->net_->output_blobs()[0];
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*output_blob, false, true);
+
+  EXPECT_EQ(4, this->net_->FuseLayersForInference());
+  EXPECT_FALSE(this->net_->layer_fused(1));
+  EXPECT_TRUE(this->net_->layer_fused(2));
+  EXPECT_TRUE(this->net_->layer_fused(3));
+  EXPECT_TRUE(this->net_->layer_fused(4));
+  EXPECT_FALSE(this->net_->layer_fused(5));
+  EXPECT_TRUE(this->net_->layer_fused(6));
+  // conv1 gained the folded bias.
+  EXPECT_EQ(2, this->net_->layer_by_name("conv1")->blobs().size());
+  // Nothing is left to fuse.
+  EXPECT_EQ(0, this->net_->FuseLayersForInference());
+
+  caffe_set(output_blob->count(), Dtype(0), output_blob->mutable_cpu_data());
+  this->net_->Forward();
+  ASSERT_EQ(expected.count(), output_blob->count());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], output_blob->cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(NetTest, TestShareActivationMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitResidualTestNet();
+  FillerParameter filler_param;
+  filler_param.set_min(-1);
+  filler_param.set_max(1);
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->blob_by_name("data").get());
+
+  Blob<Dtype>* output_blob = this->net_->output_blobs()[0];
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*output_blob, false, true);
+  size_t unshared_bytes = 0;
+  for (int i = 0; i < this->net_->blobs().size(); ++i) {
+    unshared_bytes += this->net_->blobs()[i]->count() * sizeof(Dtype);
+  }
+
+  const size_t shared_bytes = this->net_->ShareActivationMemory();
+  EXPECT_LT(shared_bytes, unshared_bytes);
+  // conv2 is dead once conv3 ran, so sum (and flat) can reuse its memory,
+  // while conv1 lives on in the residual branch.
+  EXPECT_EQ(this->net_->blob_by_name("conv2")->data(),
+            this->net_->blob_by_name("sum")->data());
+  EXPECT_NE(this->net_->blob_by_name("conv1")->data(),
+            this->net_->blob_by_name("conv2")->data());
+  EXPECT_NE(this->net_->blob_by_name("conv1")->data(),
+            this->net_->blob_by_name("conv3")->data());
+
+  for (int iter = 0; iter < 2; ++iter) {
+    caffe_set(output_blob->count(), Dtype(0), output_blob->mutable_cpu_data());
+    this->net_->Forward();
+    ASSERT_EQ(expected.count(), output_blob->count());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], output_blob->cpu_data()[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestShareTrainingMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_min(-1);
+  filler_param.set_max(1);
+  UniformFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data, target;
+  vector<Dtype> losses;
+  vector<shared_ptr<Blob<Dtype> > > param_diffs[2];
+  size_t bytes[2];
+  // Train the net without and with shared memory and recomputation.
+  for (int k = 0; k < 2; ++k) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitResidualTrainNet(k == 1, k == 1);
+    if (k == 0) {
+      data.ReshapeLike(*this->net_->blob_by_name("data"));
+      target.ReshapeLike(*this->net_->blob_by_name("target"));
+      filler.Fill(&data);
+      filler.Fill(&target);
+    }
+    set<const SyncedMemory*> memory;
+    bytes[k] = 0;
+    for (int i = 0; i < this->net_->blobs().size(); ++i) {
+      const Blob<Dtype>& blob = *this->net_->blobs()[i];
+      if (memory.insert(blob.data().get()).second) {
+        bytes[k] += blob.data()->size();
+      }
+      if (memory.insert(blob.diff().get()).second) {
+        bytes[k] += blob.diff()->size();
+      }
+    }
+    // Twice, as the second pass runs on memory left over by the first.
+    for (int iter = 0; iter < 2; ++iter) {
+      this->net_->blob_by_name("data")->CopyFrom(data);
+      this->net_->blob_by_name("target")->CopyFrom(target);
+      this->net_->ClearParamDiffs();
+      losses.push_back(this->net_->ForwardBackward());
+    }
+    const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+    for (int i = 0; i < params.size(); ++i) {
+      param_diffs[k].push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      param_diffs[k].back()->CopyFrom(*params[i], true, true);
+    }
+  }
+  EXPECT_LT(bytes[1], bytes[0]);
+  ASSERT_EQ(4, static_cast<int>(losses.size()));
+  for (int iter = 0; iter < 2; ++iter) {
+    EXPECT_NEAR(losses[iter], losses[2 + iter], 1e-4);
+  }
+  ASSERT_EQ(param_diffs[0].size(), param_diffs[1].size());
+  for (int i = 0; i < param_diffs[0].size(); ++i) {
+    const Blob<Dtype>& expected = *param_diffs[0][i];
+    const Blob<Dtype>& actual = *param_diffs[1][i];
+    ASSERT_EQ(expected.count(), actual.count());
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_NEAR(expected.cpu_diff()[j], actual.cpu_diff()[j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestStoreParamsInHalf) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  Caffe::set_random_seed(this->seed_);
+  this->InitConvBatchNormNet();
+  this->FillConvBatchNormNet();
+
+  Blob<Dtype>* output_blob = this->net_->output_blobs()[0];
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*output_blob, false, true);
+  const Blob<Dtype>* bn_mean =
+      this->net_->layer_by_name("bn1")->blobs()[0].get();
+  const Dtype* bn_mean_data = bn_mean->cpu_data();
+
+  EXPECT_FALSE(this->net_->params_in_half());
+  this->net_->StoreParamsInHalf();
+  EXPECT_TRUE(this->net_->params_in_half());
+  // The filters of both convolutions are read in half by the GEMM, while
+  // the BatchNorm statistics and the bias keep their float data.
+  EXPECT_TRUE(this->net_->layer_by_name("conv1")->blobs()[0]->data_in_half());
+  EXPECT_TRUE(this->net_->layer_by_name("conv2")->blobs()[0]->data_in_half());
+  EXPECT_FALSE(this->net_->layer_by_name("conv2")->blobs()[1]->data_in_half());
+  EXPECT_FALSE(bn_mean->data_in_half());
+  EXPECT_EQ(bn_mean_data, bn_mean->cpu_data());
+
+  for (int iter = 0; iter < 2; ++iter) {
+    caffe_set(output_blob->count(), Dtype(0), output_blob->mutable_cpu_data());
+    this->net_->Forward();
+    ASSERT_EQ(expected.count(), output_blob->count());
+    // Half precision keeps 11 significant bits.
+    for (int i = 0; i < expected.count(); ++i) {
+      const Dtype value = expected.cpu_data()[i];
+      EXPECT_NEAR(value, output_blob->cpu_data()[i],
+          1e-2 * std::max(Dtype(1), std::fabs(value)));
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestStoreActivationsInHalf) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  Caffe::set_random_seed(this->seed_);
+  this->InitConvBatchNormNet();
+  this->FillConvBatchNormNet();
+
+  Blob<Dtype>* output_blob = this->net_->output_blobs()[0];
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*output_blob, false, true);
+
+  size_t float_bytes = 0;
+  for (int i = 0; i < this->net_->blobs().size(); ++i) {
+    float_bytes += this->net_->blobs()[i]->count() * sizeof(Dtype);
+  }
+
+  // Fusing lets conv1 compute its blob out of place, so conv2 can read it in
+  // half. The net input and output stay in float.
+  this->net_->FuseLayersForInference();
+  EXPECT_FALSE(this->net_->activations_in_half());
+  EXPECT_LT(this->net_->StoreActivationsInHalf(), float_bytes);
+  EXPECT_TRUE(this->net_->activations_in_half());
+  EXPECT_TRUE(this->net_->blob_by_name("conv1")->data_in_half());
+  EXPECT_FALSE(this->net_->blob_by_name("data")->data_in_half());
+  EXPECT_FALSE(output_blob->data_in_half());
+  this->net_->ShareActivationMemory();
+
+  for (int iter = 0; iter < 2; ++iter) {
+    caffe_set(output_blob->count(), Dtype(0), output_blob->mutable_cpu_data());
+    this->net_->Forward();
+    ASSERT_EQ(expected.count(), output_blob->count());
+    // Half precision keeps 11 significant bits.
+    for (int i = 0; i < expected.count(); ++i) {
+      const Dtype value = expected.cpu_data()[i];
+      EXPECT_NEAR(value, output_blob->cpu_data()[i],
+          1e-2 * std::max(Dtype(1), std::fabs(value)));
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
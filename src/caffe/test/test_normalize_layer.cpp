@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <vector>
@@ -225,6 +226,39 @@ TYPED_TEST(NormalizeLayerTest, TestForwardEltWiseScaleChannel) {
   }
 }
 
+TYPED_TEST(NormalizeLayerTest, TestForwardHalf) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  Blob<Dtype> half_bottom;
+  half_bottom.CopyFrom(*this->blob_bottom_, false, true);
+  half_bottom.StoreDataInHalf();
+  Blob<Dtype> half_top;
+  vector<Blob<Dtype>*> half_bottom_vec(1, &half_bottom);
+  vector<Blob<Dtype>*> half_top_vec(1, &half_top);
+  for (int across_spatial = 0; across_spatial < 2; ++across_spatial) {
+    LayerParameter layer_param;
+    NormalizeParameter* norm_param = layer_param.mutable_norm_param();
+    norm_param->set_across_spatial(across_spatial);
+    norm_param->set_channel_shared(false);
+    norm_param->mutable_scale_filler()->set_type("gaussian");
+    NormalizeLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Reshape(half_bottom_vec, half_top_vec);
+    if (!half_top.data_in_half()) { half_top.StoreDataInHalf(); }
+    layer.Forward(half_bottom_vec, half_top_vec);
+    // Half precision keeps 11 significant bits.
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      const Dtype value = this->blob_top_->cpu_data()[i];
+      EXPECT_NEAR(value, half_top.cpu_data()[i],
+          2e-3 * std::max(Dtype(1), std::fabs(value)));
+    }
+  }
+}
+
 TYPED_TEST(NormalizeLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -242,6 +243,93 @@ TYPED_TEST(PermuteLayerTest, TestTwoPermute) {
   }
 }
 
+TYPED_TEST(PermuteLayerTest, TestForwardBackwardAllOrders) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Large enough to span several transpose tiles with ragged edges, and with
+  // a unit axis so that some orders only become transposes once it is
+  // ignored.
+  Blob<Dtype> bottom(2, 37, 1, 42);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  int order[4] = {0, 1, 2, 3};
+  do {
+    LayerParameter layer_param;
+    PermuteParameter* permute_param = layer_param.mutable_permute_param();
+    for (int i = 0; i < 4; ++i) {
+      permute_param->add_order(order[i]);
+    }
+    // A fresh top for every order: the identity shares the bottom data.
+    Blob<Dtype> top_blob;
+    Blob<Dtype>* top = &top_blob;
+    vector<Blob<Dtype>*> top_vec(1, top);
+    PermuteLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom_vec, top_vec);
+    layer.Forward(bottom_vec, top_vec);
+    for (int i = 0; i < top->count(); ++i) {
+      int index[4];
+      int rest = i;
+      for (int j = 3; j >= 0; --j) {
+        index[order[j]] = rest % top->shape(j);
+        rest /= top->shape(j);
+      }
+      EXPECT_EQ(top->cpu_data()[i],
+          bottom.data_at(index[0], index[1], index[2], index[3]));
+    }
+    // Backward is the inverse permutation of the diff.
+    caffe_copy(top->count(), top->cpu_data(), top->mutable_cpu_diff());
+    vector<bool> propagate_down(1, true);
+    layer.Backward(top_vec, propagate_down, bottom_vec);
+    for (int i = 0; i < bottom.count(); ++i) {
+      EXPECT_EQ(bottom.cpu_diff()[i], bottom.cpu_data()[i]);
+    }
+  } while (std::next_permutation(order, order + 4));
+}
+
+TYPED_TEST(PermuteLayerTest, TestForwardHalf) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  Blob<Dtype> bottom(2, 37, 1, 42);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  // Permuting only moves values, so the float and half blobs of values
+  // that half precision holds exactly give the same result.
+  Blob<Dtype> half_bottom;
+  half_bottom.CopyFrom(bottom, false, true);
+  half_bottom.StoreDataInHalf();
+  bottom.CopyFrom(half_bottom);
+  int order[4] = {0, 1, 2, 3};
+  do {
+    LayerParameter layer_param;
+    PermuteParameter* permute_param = layer_param.mutable_permute_param();
+    for (int i = 0; i < 4; ++i) {
+      permute_param->add_order(order[i]);
+    }
+    PermuteLayer<Dtype> layer(layer_param);
+    for (int k = 0; k < 4; ++k) {
+      Blob<Dtype> top;
+      vector<Blob<Dtype>*> bottom_vec(1, k % 2 ? &half_bottom : &bottom);
+      vector<Blob<Dtype>*> top_vec(1, &top);
+      layer.SetUp(bottom_vec, top_vec);
+      if (!layer.AcceptsHalfBottom(0)) { break; }
+      if (k / 2) { top.StoreDataInHalf(); }
+      layer.Forward(bottom_vec, top_vec);
+      for (int i = 0; i < top.count(); ++i) {
+        int index[4];
+        int rest = i;
+        for (int j = 3; j >= 0; --j) {
+          index[order[j]] = rest % top.shape(j);
+          rest /= top.shape(j);
+        }
+        EXPECT_EQ(top.cpu_data()[i],
+            bottom.data_at(index[0], index[1], index[2], index[3]));
+      }
+    }
+  } while (std::next_permutation(order, order + 4));
+}
+
 TYPED_TEST(PermuteLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
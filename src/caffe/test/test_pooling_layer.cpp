@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -609,6 +610,89 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // Large enough for the planes to be pooled in parallel.
+  this->blob_bottom_->Reshape(4, 16, 24, 24);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  const int threads = Caffe::cpu_threads();
+  for (int pool = 0; pool < 2; ++pool) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pad(1);
+    pooling_param->set_pool(pool == 0 ? PoolingParameter_PoolMethod_MAX :
+                            PoolingParameter_PoolMethod_AVE);
+    if (pool == 1) { this->blob_top_vec_.resize(1); }
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    Caffe::set_cpu_threads(1);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    vector<Blob<Dtype>*> expected(this->blob_top_vec_.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      expected[i] = new Blob<Dtype>();
+      expected[i]->CopyFrom(*this->blob_top_vec_[i], false, true);
+    }
+    Caffe::set_cpu_threads(4);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < expected.size(); ++i) {
+      for (int j = 0; j < expected[i]->count(); ++j) {
+        EXPECT_EQ(expected[i]->cpu_data()[j],
+                  this->blob_top_vec_[i]->cpu_data()[j]);
+      }
+      delete expected[i];
+    }
+  }
+  Caffe::set_cpu_threads(threads);
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardHalf) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  this->blob_bottom_->Reshape(4, 16, 24, 24);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  Blob<Dtype> half_bottom;
+  half_bottom.CopyFrom(*this->blob_bottom_, false, true);
+  half_bottom.StoreDataInHalf();
+  vector<Blob<Dtype>*> half_bottom_vec(1, &half_bottom);
+  for (int pool = 0; pool < 2; ++pool) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pool(pool == 0 ? PoolingParameter_PoolMethod_MAX :
+                            PoolingParameter_PoolMethod_AVE);
+    PoolingLayer<Dtype> layer(layer_param);
+    EXPECT_TRUE(layer.AcceptsHalfBottom(0));
+    EXPECT_TRUE(layer.AcceptsHalfTop(0));
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> expected;
+    expected.CopyFrom(*this->blob_top_, false, true);
+    // Pool the half bottom into a half top.
+    Blob<Dtype> half_top;
+    vector<Blob<Dtype>*> half_top_vec(1, &half_top);
+    layer.Reshape(half_bottom_vec, half_top_vec);
+    half_top.StoreDataInHalf();
+    layer.Forward(half_bottom_vec, half_top_vec);
+    ASSERT_TRUE(half_top.data_in_half());
+    ASSERT_EQ(expected.count(), half_top.count());
+    // Half precision keeps 11 significant bits.
+    for (int i = 0; i < expected.count(); ++i) {
+      const Dtype value = expected.cpu_data()[i];
+      EXPECT_NEAR(value, half_top.cpu_data()[i],
+          2e-3 * std::max(Dtype(1), std::fabs(value)));
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -0,0 +1,132 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/rdetection_evaluate_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+static const float eps = 1e-6;
+
+template <typename Dtype>
+class RDetectionEvaluateLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  RDetectionEvaluateLayerTest()
+      : num_classes_(3),
+        background_label_id_(0),
+        overlap_threshold_(0.5),
+        blob_bottom_det_(new Blob<Dtype>(1, 1, 8, 8)),
+        blob_bottom_gt_(new Blob<Dtype>(1, 1, 3, 7)),
+        blob_top_(new Blob<Dtype>()) {
+    this->FillData();
+    blob_bottom_vec_.push_back(blob_bottom_det_);
+    blob_bottom_vec_.push_back(blob_bottom_gt_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+
+  virtual ~RDetectionEvaluateLayerTest() {
+    delete blob_bottom_det_;
+    delete blob_bottom_gt_;
+    delete blob_top_;
+  }
+
+  void FillData() {
+    // [image_id, label, xcenter, ycenter, angle, width, height]
+    const Dtype gt[] = {
+      0, 1, 0.2, 0.2, 0, 0.2, 0.2,
+      0, 1, 0.7, 0.7, 30, 0.2, 0.1,
+      1, 2, 0.5, 0.5, 0, 0.4, 0.2};
+    // [image_id, label, confidence, xcenter, ycenter, angle, width, height]
+    const Dtype det[] = {
+      // Same box as the second ground truth.
+      0, 1, 0.9, 0.7, 0.7, 30, 0.2, 0.1,
+      // The same box again, rotated by 90 degrees with its sides swapped.
+      0, 1, 0.7, 0.7, 0.7, -60, 0.1, 0.2,
+      // Shifted first ground truth, IoU 0.6.
+      0, 1, 0.3, 0.25, 0.2, 0, 0.2, 0.2,
+      // Rotated by 90 degrees, IoU 1/3 although the centers agree.
+      1, 2, 0.8, 0.5, 0.5, 90, 0.4, 0.2,
+      // Rotated by 45 degrees, IoU 0.52.
+      1, 2, 0.1, 0.5, 0.5, 45, 0.4, 0.2,
+      1, 1, 0.2, 0.5, 0.5, 0, 0.4, 0.2,
+      2, 1, 0.2, 0.5, 0.5, 0, 0.4, 0.2,
+      // Fake result of an image without detections.
+      -1, -1, -1, -1, -1, -1, -1, -1};
+    caffe_copy(blob_bottom_gt_->count(), gt,
+        blob_bottom_gt_->mutable_cpu_data());
+    caffe_copy(blob_bottom_det_->count(), det,
+        blob_bottom_det_->mutable_cpu_data());
+  }
+
+  void CheckEqual(const Blob<Dtype>& blob, const int num, const Dtype* values) {
+    CHECK_LT(num, blob.height());
+    const Dtype* blob_data = blob.cpu_data() + num * blob.width();
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_NEAR(blob_data[i], values[i], eps);
+    }
+  }
+
+  int num_classes_;
+  int background_label_id_;
+  float overlap_threshold_;
+
+  Blob<Dtype>* const blob_bottom_det_;
+  Blob<Dtype>* const blob_bottom_gt_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(RDetectionEvaluateLayerTest, TestDtypes);
+
+TYPED_TEST(RDetectionEvaluateLayerTest, TestSetup) {
+  LayerParameter layer_param;
+  RDetectionEvaluateParameter* rdetection_evaluate_param =
+      layer_param.mutable_rdetection_evaluate_param();
+  rdetection_evaluate_param->set_num_classes(this->num_classes_);
+  rdetection_evaluate_param->set_background_label_id(
+      this->background_label_id_);
+  rdetection_evaluate_param->set_overlap_threshold(this->overlap_threshold_);
+  RDetectionEvaluateLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 1);
+  EXPECT_EQ(this->blob_top_->channels(), 1);
+  // Two rows of ground truth counts, and no row for the fake result.
+  EXPECT_EQ(this->blob_top_->height(), 9);
+  EXPECT_EQ(this->blob_top_->width(), 5);
+}
+
+TYPED_TEST(RDetectionEvaluateLayerTest, TestForward) {
+  LayerParameter layer_param;
+  RDetectionEvaluateParameter* rdetection_evaluate_param =
+      layer_param.mutable_rdetection_evaluate_param();
+  rdetection_evaluate_param->set_num_classes(this->num_classes_);
+  rdetection_evaluate_param->set_background_label_id(
+      this->background_label_id_);
+  rdetection_evaluate_param->set_overlap_threshold(this->overlap_threshold_);
+  RDetectionEvaluateLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  // [image_id, label, confidence, true_pos, false_pos]
+  const TypeParam expected[] = {
+    -1, 1, 2, -1, -1,
+    -1, 2, 1, -1, -1,
+    0, 1, 0.9, 1, 0,
+    0, 1, 0.7, 0, 1,
+    0, 1, 0.3, 1, 0,
+    1, 1, 0.2, 0, 1,
+    1, 2, 0.8, 0, 1,
+    1, 2, 0.1, 1, 0,
+    2, 1, 0.2, 0, 1};
+  ASSERT_EQ(this->blob_top_->height(), 9);
+  for (int i = 0; i < 9; ++i) {
+    this->CheckEqual(*(this->blob_top_), i, expected + i * 5);
+  }
+}
+
+}  // namespace caffe
@@ -1,3 +1,5 @@
+#include <boost/filesystem.hpp>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <utility>
 #include <vector>
@@ -6,9 +8,11 @@
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
+#include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/solver.hpp"
+#include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -38,6 +42,70 @@ class SolverTest : public MultiDeviceTest<TypeParam> {
     solver_.reset(new SGDSolver<Dtype>(param));
   }
 
+  // Returns a solver that trains a DummyData, InnerProduct and
+  // SoftmaxWithLoss net, with the given solver fields prepended. If
+  // batch_norm, a BatchNorm layer named 'bn' sits before the InnerProduct.
+  string SolverProto(const string& solver_fields, bool batch_norm = false) {
+    ostringstream proto;
+    proto << solver_fields <<
+       "net_param { "
+       "  name: 'TestNetwork' "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'DummyData' "
+       "    dummy_data_param { "
+       "      shape { "
+       "        dim: 5 "
+       "        dim: 2 "
+       "        dim: 3 "
+       "        dim: 4 "
+       "      } "
+       "      data_filler { "
+       "        type: 'gaussian' "
+       "      } "
+       "      shape { "
+       "        dim: 5 "
+       "      } "
+       "    } "
+       "    top: 'data' "
+       "    top: 'label' "
+       "  } ";
+    if (batch_norm) {
+      proto <<
+         "  layer { "
+         "    name: 'bn' "
+         "    type: 'BatchNorm' "
+         "    batch_norm_param { "
+         "      moving_average_fraction: 0.5 "
+         "    } "
+         "    bottom: 'data' "
+         "    top: 'bn' "
+         "  } ";
+    }
+    proto <<
+       "  layer { "
+       "    name: 'innerprod' "
+       "    type: 'InnerProduct' "
+       "    inner_product_param { "
+       "      num_output: 10 "
+       "      weight_filler { "
+       "        type: 'gaussian' "
+       "      } "
+       "    } "
+       "    bottom: '" << (batch_norm ? "bn" : "data") << "' "
+       "    top: 'innerprod' "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'SoftmaxWithLoss' "
+       "    bottom: 'innerprod' "
+       "    bottom: 'label' "
+       "    top: 'loss' "
+       "  } "
+       "} ";
+    return proto.str();
+  }
+
   shared_ptr<Solver<Dtype> > solver_;
 };
 
@@ -106,4 +174,124 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestAsyncTest) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitSolverFromProtoString(this->SolverProto(
+     "test_interval: 1 "
+     "test_iter: 3 "
+     "test_async: true "
+     "max_iter: 3 "
+     "base_lr: 0.1 "
+     "lr_policy: 'fixed' "
+     "snapshot_after_train: false "));
+  this->solver_->Solve();
+  // The test net was given a copy of the final weights, in its own memory.
+  const Blob<Dtype>* train_weights =
+      this->solver_->net()->layer_by_name("innerprod")->blobs()[0].get();
+  const Blob<Dtype>* test_weights = this->solver_->test_nets()[0]->
+      layer_by_name("innerprod")->blobs()[0].get();
+  ASSERT_EQ(train_weights->count(), test_weights->count());
+  EXPECT_NE(train_weights->cpu_data(), test_weights->cpu_data());
+  for (int i = 0; i < train_weights->count(); ++i) {
+    EXPECT_EQ(train_weights->cpu_data()[i], test_weights->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(SolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  string snapshot_prefix;
+  MakeTempDir(&snapshot_prefix);
+  snapshot_prefix += "/snapshot";
+  ostringstream fields;
+  fields <<
+     "max_iter: 4 "
+     "base_lr: 0.1 "
+     "lr_policy: 'fixed' "
+     "snapshot: 2 "
+     "snapshot_async: true "
+     "snapshot_prefix: '" << snapshot_prefix << "' ";
+  this->InitSolverFromProtoString(this->SolverProto(fields.str()));
+  this->solver_->Solve();
+  this->solver_->WaitForSnapshot();
+  // Both snapshots were committed, with no temporary file left behind.
+  const string model_filename = snapshot_prefix + "_iter_4.caffemodel";
+  EXPECT_TRUE(boost::filesystem::exists(snapshot_prefix +
+      "_iter_2.caffemodel"));
+  EXPECT_TRUE(boost::filesystem::exists(model_filename));
+  EXPECT_TRUE(boost::filesystem::exists(snapshot_prefix +
+      "_iter_4.solverstate"));
+  EXPECT_FALSE(boost::filesystem::exists(model_filename + ".tmp"));
+  NetParameter net_param;
+  ReadProtoFromBinaryFileOrDie(model_filename, &net_param);
+  const Blob<Dtype>* weights =
+      this->solver_->net()->layer_by_name("innerprod")->blobs()[0].get();
+  Blob<Dtype> snapshot_weights;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    if (net_param.layer(i).name() == "innerprod") {
+      snapshot_weights.FromProto(net_param.layer(i).blobs(0));
+    }
+  }
+  ASSERT_EQ(weights->count(), snapshot_weights.count());
+  for (int i = 0; i < weights->count(); ++i) {
+    EXPECT_EQ(weights->cpu_data()[i], snapshot_weights.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(SolverTest, TestTelemetry) {
+  string snapshot_prefix;
+  MakeTempDir(&snapshot_prefix);
+  snapshot_prefix += "/snapshot";
+  ostringstream fields;
+  fields <<
+     "max_iter: 4 "
+     "base_lr: 0.1 "
+     "lr_policy: 'fixed' "
+     "iter_size: 2 "
+     "telemetry_interval: 2 "
+     "snapshot_after_train: false "
+     "snapshot_prefix: '" << snapshot_prefix << "' ";
+  this->InitSolverFromProtoString(this->SolverProto(fields.str()));
+  this->solver_->Solve();
+  // The layers are only timed while the solver steps.
+  EXPECT_EQ(0., this->solver_->net()->layer_forward_ms()[1]);
+  std::ifstream telemetry((snapshot_prefix + "_telemetry.jsonl").c_str());
+  ASSERT_TRUE(telemetry.good());
+  vector<string> records;
+  string record;
+  while (std::getline(telemetry, record)) {
+    records.push_back(record);
+  }
+  ASSERT_EQ(2, static_cast<int>(records.size()));
+  EXPECT_EQ(0, static_cast<int>(
+      records[0].find("{\"iter\": 2, \"images_per_sec\": ")));
+  EXPECT_EQ(0, static_cast<int>(
+      records[1].find("{\"iter\": 4, \"images_per_sec\": ")));
+  for (int i = 0; i < records.size(); ++i) {
+    EXPECT_NE(string::npos, records[i].find("\"loss_ms\": "));
+    EXPECT_NE(string::npos, records[i].find("\"snapshot_ms\": 0}"));
+  }
+}
+
+TYPED_TEST(SolverTest, TestCPUSyncBatchNormStats) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  Caffe::set_solver_count(2);
+  this->InitSolverFromProtoString(this->SolverProto(
+     "max_iter: 3 "
+     "base_lr: 0.1 "
+     "lr_policy: 'fixed' "
+     "snapshot_after_train: false ", true));
+  CPUSync<Dtype> sync(this->solver_);
+  sync.Run(2);
+  Caffe::set_solver_count(1);
+  // Each worker updates its own copy of the statistics once per iteration,
+  // and the copies are averaged, so the scale factor of the moving averages
+  // is that of a single solver: 1, 1.5 and 1.75.
+  const Blob<Dtype>& scale_factor =
+      *this->solver_->net()->layer_by_name("bn")->blobs()[2];
+  EXPECT_FLOAT_EQ(1.75, scale_factor.cpu_data()[0]);
+}
+
 }  // namespace caffe
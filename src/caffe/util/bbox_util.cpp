@@ -1993,34 +1993,21 @@ void CumSum(const vector<pair<float, int> >& pairs, vector<int>* cumsum) {
   }
 }
 
-void ComputeAP(const vector<pair<float, int> >& tp, const int num_pos,
-               const vector<pair<float, int> >& fp, const string ap_version,
-               vector<float>* prec, vector<float>* rec, float* ap) {
+// Compute precision, recall and average precision from the cumsums of true
+// and false positives in descend order of scores.
+static void ComputeAPFromCumSum(const vector<int>& tp_cumsum,
+    const vector<int>& fp_cumsum, const int num_pos, const string& ap_version,
+    vector<float>* prec, vector<float>* rec, float* ap) {
   const float eps = 1e-6;
-  CHECK_EQ(tp.size(), fp.size()) << "tp must have same size as fp.";
-  const int num = tp.size();
-  // Make sure that tp and fp have complement value.
-  for (int i = 0; i < num; ++i) {
-    CHECK_LE(fabs(tp[i].first - fp[i].first), eps);
-    CHECK_EQ(tp[i].second, 1 - fp[i].second);
-  }
+  CHECK_EQ(tp_cumsum.size(), fp_cumsum.size());
+  const int num = tp_cumsum.size();
   prec->clear();
   rec->clear();
   *ap = 0;
-  if (tp.size() == 0 || num_pos == 0) {
+  if (num == 0 || num_pos == 0) {
     return;
   }
 
-  // Compute cumsum of tp.
-  vector<int> tp_cumsum;
-  CumSum(tp, &tp_cumsum);
-  CHECK_EQ(tp_cumsum.size(), num);
-
-  // Compute cumsum of fp.
-  vector<int> fp_cumsum;
-  CumSum(fp, &fp_cumsum);
-  CHECK_EQ(fp_cumsum.size(), num);
-
   // Compute precision.
   for (int i = 0; i < num; ++i) {
     prec->push_back(static_cast<float>(tp_cumsum[i]) /
@@ -2081,6 +2068,90 @@ void ComputeAP(const vector<pair<float, int> >& tp, const int num_pos,
   }
 }
 
+void ComputeAP(const vector<pair<float, int> >& tp, const int num_pos,
+               const vector<pair<float, int> >& fp, const string ap_version,
+               vector<float>* prec, vector<float>* rec, float* ap) {
+  const float eps = 1e-6;
+  CHECK_EQ(tp.size(), fp.size()) << "tp must have same size as fp.";
+  const int num = tp.size();
+  // Make sure that tp and fp have complement value.
+  for (int i = 0; i < num; ++i) {
+    CHECK_LE(fabs(tp[i].first - fp[i].first), eps);
+    CHECK_EQ(tp[i].second, 1 - fp[i].second);
+  }
+
+  // Compute cumsum of tp.
+  vector<int> tp_cumsum;
+  CumSum(tp, &tp_cumsum);
+  CHECK_EQ(tp_cumsum.size(), num);
+
+  // Compute cumsum of fp.
+  vector<int> fp_cumsum;
+  CumSum(fp, &fp_cumsum);
+  CHECK_EQ(fp_cumsum.size(), num);
+
+  ComputeAPFromCumSum(tp_cumsum, fp_cumsum, num_pos, ap_version, prec, rec,
+                      ap);
+}
+
+APAccumulator::APAccumulator(const int num_bins)
+    : num_bins_(num_bins), num_detections_(0) {
+  CHECK_GE(num_bins_, 0);
+  bin_tp_.assign(num_bins_, 0);
+  bin_fp_.assign(num_bins_, 0);
+}
+
+void APAccumulator::AddDetection(const float score, const int tp) {
+  CHECK(tp == 0 || tp == 1) << "tp must be 0 or 1.";
+  ++num_detections_;
+  if (num_bins_ == 0) {
+    detections_.push_back(std::make_pair(score, tp));
+    return;
+  }
+  const int bin = std::min(std::max(static_cast<int>(score * num_bins_), 0),
+                           num_bins_ - 1);
+  if (tp) {
+    ++bin_tp_[bin];
+  } else {
+    ++bin_fp_[bin];
+  }
+}
+
+void APAccumulator::ComputeAP(const int num_pos, const string& ap_version,
+    vector<float>* prec, vector<float>* rec, float* ap) const {
+  vector<int> tp_cumsum;
+  vector<int> fp_cumsum;
+  int tp_sum = 0;
+  int fp_sum = 0;
+  if (num_bins_ == 0) {
+    // One stable sort of the detections orders the true and false positives
+    // as CumSum orders each.
+    vector<pair<float, int> > detections = detections_;
+    std::stable_sort(detections.begin(), detections.end(),
+                     SortScorePairDescend<int>);
+    tp_cumsum.resize(detections.size());
+    fp_cumsum.resize(detections.size());
+    for (int i = 0; i < detections.size(); ++i) {
+      tp_sum += detections[i].second;
+      fp_sum += 1 - detections[i].second;
+      tp_cumsum[i] = tp_sum;
+      fp_cumsum[i] = fp_sum;
+    }
+  } else {
+    for (int b = num_bins_ - 1; b >= 0; --b) {
+      if (bin_tp_[b] == 0 && bin_fp_[b] == 0) {
+        continue;
+      }
+      tp_sum += bin_tp_[b];
+      fp_sum += bin_fp_[b];
+      tp_cumsum.push_back(tp_sum);
+      fp_cumsum.push_back(fp_sum);
+    }
+  }
+  ComputeAPFromCumSum(tp_cumsum, fp_cumsum, num_pos, ap_version, prec, rec,
+                      ap);
+}
+
 #ifdef USE_OPENCV
 cv::Scalar HSV2RGB(const float h, const float s, const float v) {
   const int h_i = static_cast<int>(h * 6);
@@ -11,7 +11,7 @@ void LevelDB::Open(const string& source, Mode mode) {
   options.write_buffer_size = 268435456;
   options.max_open_files = 100;
   options.error_if_exists = mode == NEW;
-  options.create_if_missing = mode != READ;
+  options.create_if_missing = mode != READ && mode != READ_RANDOM;
   leveldb::Status status = leveldb::DB::Open(options, source, &db_);
   CHECK(status.ok()) << "Failed to open leveldb " << source
                      << std::endl << status.ToString();
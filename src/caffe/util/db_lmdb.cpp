@@ -13,9 +13,12 @@ void LMDB::Open(const string& source, Mode mode) {
     CHECK_EQ(mkdir(source.c_str(), 0744), 0) << "mkdir " << source << " failed";
   }
   int flags = 0;
-  if (mode == READ) {
+  if (mode == READ || mode == READ_RANDOM) {
     flags = MDB_RDONLY | MDB_NOTLS;
   }
+  if (mode == READ_RANDOM) {
+    flags |= MDB_NORDAHEAD;
+  }
   int rc = mdb_env_open(mdb_env_, source.c_str(), flags, 0664);
 #ifndef ALLOW_LMDB_NOLOCK
   MDB_CHECK(rc);
@@ -0,0 +1,388 @@
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/gemm.hpp"
+#include "caffe/util/half_math.hpp"
+
+namespace caffe {
+
+static GemmBackend default_gemm_backend_ = GEMM_BLAS;
+static std::map<GemmShape, GemmBackend> gemm_shape_backends_;
+static std::map<GemmShape, int>* gemm_shape_recorder_ = NULL;
+static boost::mutex gemm_shape_recorder_mutex_;
+
+const char* GemmBackendName(const GemmBackend backend) {
+  switch (backend) {
+  case GEMM_BLAS:
+    return "BLAS";
+  case GEMM_PACKED:
+    return "PACKED";
+  default:
+    LOG(FATAL) << "Unknown GEMM backend " << backend;
+  }
+  return "";
+}
+
+bool GemmBackendFromName(const string& name, GemmBackend* backend) {
+  for (int b = 0; b < kNumGemmBackends; ++b) {
+    if (boost::iequals(name, GemmBackendName(static_cast<GemmBackend>(b)))) {
+      *backend = static_cast<GemmBackend>(b);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GemmShape::operator<(const GemmShape& other) const {
+  if (M != other.M) { return M < other.M; }
+  if (N != other.N) { return N < other.N; }
+  if (K != other.K) { return K < other.K; }
+  if (trans_a != other.trans_a) { return trans_a < other.trans_a; }
+  return trans_b < other.trans_b;
+}
+
+void caffe_set_gemm_backend(const GemmBackend backend) {
+  default_gemm_backend_ = backend;
+}
+
+void caffe_set_gemm_backend(const GemmShape& shape,
+    const GemmBackend backend) {
+  gemm_shape_backends_[shape] = backend;
+}
+
+void caffe_clear_gemm_shape_backends() {
+  gemm_shape_backends_.clear();
+}
+
+GemmBackend caffe_gemm_backend(const GemmShape& shape) {
+  {
+    // The recorder may be set by another thread at any time. The lock is
+    // uncontended unless shapes are being recorded, and cheap next to a GEMM.
+    boost::mutex::scoped_lock lock(gemm_shape_recorder_mutex_);
+    if (gemm_shape_recorder_ != NULL) {
+      ++(*gemm_shape_recorder_)[shape];
+    }
+  }
+  if (gemm_shape_backends_.empty()) {
+    return default_gemm_backend_;
+  }
+  std::map<GemmShape, GemmBackend>::const_iterator it =
+      gemm_shape_backends_.find(shape);
+  return it == gemm_shape_backends_.end() ? default_gemm_backend_ : it->second;
+}
+
+void caffe_record_gemm_shapes(std::map<GemmShape, int>* calls) {
+  boost::mutex::scoped_lock lock(gemm_shape_recorder_mutex_);
+  gemm_shape_recorder_ = calls;
+}
+
+// One shape per line: "trans_a trans_b M N K backend", with the transposes
+// as N or T.
+void ReadGemmBackendsFromFile(const string& filename) {
+  std::ifstream file(filename.c_str());
+  CHECK(file.good()) << "Cannot read GEMM backends from " << filename;
+  string trans_a, trans_b, name;
+  int M, N, K;
+  int num_shapes = 0;
+  while (file >> trans_a >> trans_b >> M >> N >> K >> name) {
+    GemmBackend backend;
+    CHECK(GemmBackendFromName(name, &backend))
+        << "Unknown GEMM backend " << name << " in " << filename;
+    const GemmShape shape(trans_a == "T" ? CblasTrans : CblasNoTrans,
+        trans_b == "T" ? CblasTrans : CblasNoTrans, M, N, K);
+    caffe_set_gemm_backend(shape, backend);
+    ++num_shapes;
+  }
+  CHECK(file.eof()) << "Malformed GEMM backends file " << filename;
+  LOG(INFO) << "Read the GEMM backends of " << num_shapes << " shapes from "
+      << filename;
+}
+
+void WriteGemmBackendsToFile(const string& filename,
+    const std::map<GemmShape, GemmBackend>& backends) {
+  std::ofstream file(filename.c_str());
+  CHECK(file.good()) << "Cannot write GEMM backends to " << filename;
+  for (std::map<GemmShape, GemmBackend>::const_iterator it = backends.begin();
+       it != backends.end(); ++it) {
+    file << (it->first.trans_a ? "T" : "N") << " "
+        << (it->first.trans_b ? "T" : "N") << " " << it->first.M << " "
+        << it->first.N << " " << it->first.K << " "
+        << GemmBackendName(it->second) << "\n";
+  }
+  file.close();
+  CHECK(!file.fail()) << "Failed writing " << filename;
+}
+
+// The packed GEMM follows the usual blocking: op(B) is packed by kBlockK x
+// kBlockN panels and op(A) by kBlockM x kBlockK blocks, both split into
+// micro-panels of NR columns and MR rows, so that a micro-kernel computes an
+// MR x NR tile of C from memory that stays in cache.
+static const int kBlockM = 144;
+static const int kBlockK = 256;
+static const int kBlockN = 2048;
+
+// C += alpha * (a * b) for an MR x NR tile, where a holds kc columns of MR
+// values and b kc rows of NR values.
+template <typename Dtype, int MR, int NR>
+static void GenericKernel(const int kc, const Dtype* a, const Dtype* b,
+    const Dtype alpha, Dtype* c, const int ldc) {
+  Dtype ab[MR * NR];
+  memset(ab, 0, sizeof(ab));  // NOLINT(caffe/alt_fn)
+  for (int p = 0; p < kc; ++p) {
+    for (int i = 0; i < MR; ++i) {
+      for (int j = 0; j < NR; ++j) {
+        ab[i * NR + j] += a[i] * b[j];
+      }
+    }
+    a += MR;
+    b += NR;
+  }
+  for (int i = 0; i < MR; ++i) {
+    for (int j = 0; j < NR; ++j) {
+      c[i * ldc + j] += alpha * ab[i * NR + j];
+    }
+  }
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+// A 6 x 16 kernel keeping the tile in 12 of the 16 AVX registers.
+static void KernelF32x6x16(const int kc, const float* a, const float* b,
+    const float alpha, float* c, const int ldc) {
+  __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+  __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+  __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+  __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+  __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+  __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+  for (int p = 0; p < kc; ++p) {
+    const __m256 b0 = _mm256_loadu_ps(b);
+    const __m256 b1 = _mm256_loadu_ps(b + 8);
+    __m256 ai = _mm256_broadcast_ss(a);
+    c00 = _mm256_fmadd_ps(ai, b0, c00);
+    c01 = _mm256_fmadd_ps(ai, b1, c01);
+    ai = _mm256_broadcast_ss(a + 1);
+    c10 = _mm256_fmadd_ps(ai, b0, c10);
+    c11 = _mm256_fmadd_ps(ai, b1, c11);
+    ai = _mm256_broadcast_ss(a + 2);
+    c20 = _mm256_fmadd_ps(ai, b0, c20);
+    c21 = _mm256_fmadd_ps(ai, b1, c21);
+    ai = _mm256_broadcast_ss(a + 3);
+    c30 = _mm256_fmadd_ps(ai, b0, c30);
+    c31 = _mm256_fmadd_ps(ai, b1, c31);
+    ai = _mm256_broadcast_ss(a + 4);
+    c40 = _mm256_fmadd_ps(ai, b0, c40);
+    c41 = _mm256_fmadd_ps(ai, b1, c41);
+    ai = _mm256_broadcast_ss(a + 5);
+    c50 = _mm256_fmadd_ps(ai, b0, c50);
+    c51 = _mm256_fmadd_ps(ai, b1, c51);
+    a += 6;
+    b += 16;
+  }
+  const __m256 va = _mm256_set1_ps(alpha);
+  const __m256 rows[6][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                             {c30, c31}, {c40, c41}, {c50, c51}};
+  for (int i = 0; i < 6; ++i) {
+    float* ci = c + i * ldc;
+    _mm256_storeu_ps(ci,
+        _mm256_fmadd_ps(va, rows[i][0], _mm256_loadu_ps(ci)));
+    _mm256_storeu_ps(ci + 8,
+        _mm256_fmadd_ps(va, rows[i][1], _mm256_loadu_ps(ci + 8)));
+  }
+}
+#endif
+
+// The micro-kernel and its tile size for every type.
+template <typename Dtype>
+struct PackedGemmKernel {
+  enum { MR = 4, NR = 8 };
+  static void Run(const int kc, const Dtype* a, const Dtype* b,
+      const Dtype alpha, Dtype* c, const int ldc) {
+    GenericKernel<Dtype, MR, NR>(kc, a, b, alpha, c, ldc);
+  }
+};
+
+#if defined(__AVX2__) && defined(__FMA__)
+template <>
+struct PackedGemmKernel<float> {
+  enum { MR = 6, NR = 16 };
+  static void Run(const int kc, const float* a, const float* b,
+      const float alpha, float* c, const int ldc) {
+    KernelF32x6x16(kc, a, b, alpha, c, ldc);
+  }
+};
+#endif
+
+// Packs the rows [i, i + MR) and columns [p, p + kc) of op(A) column by
+// column, padding the rows past M with zeros. A half precision A is
+// converted on the way.
+template <typename Dtype, int MR, typename AType>
+static void PackA(const bool trans, const AType* A, const int lda,
+    const int M, const int i, const int p, const int kc, Dtype* packed) {
+  const int rows = std::min(MR, M - i);
+  for (int k = 0; k < kc; ++k) {
+    for (int r = 0; r < MR; ++r) {
+      packed[k * MR + r] = r >= rows ? Dtype(0) : caffe_half_cast<Dtype>(
+          trans ? A[(p + k) * lda + i + r] : A[(i + r) * lda + p + k]);
+    }
+  }
+}
+
+// Packs the rows [p, p + kc) and columns [j, j + NR) of op(B) row by row,
+// padding the columns past N with zeros. A half precision B is converted
+// on the way.
+template <typename Dtype, int NR, typename BType>
+static void PackB(const bool trans, const BType* B, const int ldb,
+    const int N, const int p, const int kc, const int j, Dtype* packed) {
+  const int cols = std::min(NR, N - j);
+  for (int k = 0; k < kc; ++k) {
+    for (int c = 0; c < NR; ++c) {
+      packed[k * NR + c] = c >= cols ? Dtype(0) : caffe_half_cast<Dtype>(
+          trans ? B[(j + c) * ldb + p + k] : B[(p + k) * ldb + j + c]);
+    }
+  }
+}
+
+template <typename Dtype, typename AType, typename BType>
+static void PackedGemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const AType* A, const BType* B, const Dtype beta,
+    Dtype* C) {
+  const int MR = PackedGemmKernel<Dtype>::MR;
+  const int NR = PackedGemmKernel<Dtype>::NR;
+  const bool trans_a = TransA == CblasTrans;
+  const bool trans_b = TransB == CblasTrans;
+  const int lda = trans_a ? M : K;
+  const int ldb = trans_b ? K : N;
+  const int count = M * N;
+  if (beta == 0) {
+    memset(C, 0, sizeof(Dtype) * count);  // NOLINT(caffe/alt_fn)
+  } else if (beta != 1) {
+    for (int i = 0; i < count; ++i) { C[i] *= beta; }
+  }
+  if (count == 0 || K == 0 || alpha == 0) {
+    return;
+  }
+  const int block_m = std::min(kBlockM, (M + MR - 1) / MR * MR);
+  const int block_n = std::min(kBlockN, (N + NR - 1) / NR * NR);
+  const int block_k = std::min(kBlockK, K);
+  std::vector<Dtype> packed_a(block_m * block_k);
+  std::vector<Dtype> packed_b(block_k * block_n);
+  #pragma omp parallel if (static_cast<double>(count) * K > 262144)
+  {
+    // The partial tiles at the bottom and right edges of C.
+    Dtype edge[MR * NR];
+    for (int jc = 0; jc < N; jc += kBlockN) {
+      const int nc = std::min(kBlockN, N - jc);
+      const int num_jr = (nc + NR - 1) / NR;
+      for (int pc = 0; pc < K; pc += kBlockK) {
+        const int kc = std::min(kBlockK, K - pc);
+        #pragma omp for
+        for (int jr = 0; jr < num_jr; ++jr) {
+          PackB<Dtype, NR>(trans_b, B, ldb, N, pc, kc, jc + jr * NR,
+              &packed_b[jr * NR * kc]);
+        }
+        for (int ic = 0; ic < M; ic += kBlockM) {
+          const int mc = std::min(kBlockM, M - ic);
+          const int num_ir = (mc + MR - 1) / MR;
+          #pragma omp for
+          for (int ir = 0; ir < num_ir; ++ir) {
+            PackA<Dtype, MR>(trans_a, A, lda, M, ic + ir * MR, pc, kc,
+                &packed_a[ir * MR * kc]);
+          }
+          // Threads take runs of tiles down the same columns, which share
+          // their micro-panel of B.
+          #pragma omp for schedule(static)
+          for (int t = 0; t < num_jr * num_ir; ++t) {
+            const int jr = t / num_ir;
+            const int ir = t % num_ir;
+            const Dtype* a = &packed_a[ir * MR * kc];
+            const Dtype* b = &packed_b[jr * NR * kc];
+            Dtype* c = C + (ic + ir * MR) * N + jc + jr * NR;
+            const int rows = std::min(MR, mc - ir * MR);
+            const int cols = std::min(NR, nc - jr * NR);
+            if (rows == MR && cols == NR) {
+              PackedGemmKernel<Dtype>::Run(kc, a, b, alpha, c, N);
+              continue;
+            }
+            memset(edge, 0, sizeof(edge));  // NOLINT(caffe/alt_fn)
+            PackedGemmKernel<Dtype>::Run(kc, a, b, alpha, edge, NR);
+            for (int r = 0; r < rows; ++r) {
+              for (int col = 0; col < cols; ++col) {
+                c[r * N + col] += edge[r * NR + col];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <>
+void caffe_cpu_gemm_on<float>(const GemmBackend backend,
+    const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const float alpha, const float* A,
+    const float* B, const float beta, float* C) {
+  if (backend == GEMM_PACKED) {
+    PackedGemm(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+    return;
+  }
+  int lda = (TransA == CblasNoTrans) ? K : M;
+  int ldb = (TransB == CblasNoTrans) ? N : K;
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, N);
+}
+
+template <>
+void caffe_cpu_gemm_on<double>(const GemmBackend backend,
+    const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const double alpha,
+    const double* A, const double* B, const double beta, double* C) {
+  if (backend == GEMM_PACKED) {
+    PackedGemm(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+    return;
+  }
+  int lda = (TransA == CblasNoTrans) ? K : M;
+  int ldb = (TransB == CblasNoTrans) ? N : K;
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, N);
+}
+
+template <typename Dtype, typename AType, typename BType>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const AType* A, const BType* B, const Dtype beta,
+    Dtype* C) {
+  PackedGemm(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+}
+
+#define INSTANTIATE_GEMM_HALF(Dtype) \
+  template void caffe_cpu_gemm_half<Dtype, uint16_t, Dtype>( \
+      const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB, \
+      const int M, const int N, const int K, const Dtype alpha, \
+      const uint16_t* A, const Dtype* B, const Dtype beta, Dtype* C); \
+  template void caffe_cpu_gemm_half<Dtype, Dtype, uint16_t>( \
+      const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB, \
+      const int M, const int N, const int K, const Dtype alpha, \
+      const Dtype* A, const uint16_t* B, const Dtype beta, Dtype* C); \
+  template void caffe_cpu_gemm_half<Dtype, uint16_t, uint16_t>( \
+      const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB, \
+      const int M, const int N, const int K, const Dtype alpha, \
+      const uint16_t* A, const uint16_t* B, const Dtype beta, Dtype* C)
+
+INSTANTIATE_GEMM_HALF(float);
+INSTANTIATE_GEMM_HALF(double);
+
+}  // namespace caffe
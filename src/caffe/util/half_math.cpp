@@ -0,0 +1,119 @@
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include <cstring>
+
+#include "caffe/util/half_math.hpp"
+
+namespace caffe {
+
+uint16_t caffe_float_to_half(const float x) {
+  uint32_t f;
+  memcpy(&f, &x, sizeof(f));
+  const uint16_t sign = (f >> 16) & 0x8000;
+  const uint32_t abs = f & 0x7fffffff;
+  if (abs >= 0x7f800000) {
+    // Infinity, or a quiet NaN.
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  }
+  if (abs >= 0x477ff000) {
+    // Rounds to 65520 or more, beyond the largest half 65504.
+    return sign | 0x7c00;
+  }
+  uint32_t h;
+  uint32_t rest;
+  uint32_t halfway;
+  if (abs >= 0x38800000) {
+    // Normal half: rebias the exponent and drop 13 mantissa bits.
+    h = (abs >> 13) - (112 << 10);
+    rest = abs & 0x1fff;
+    halfway = 0x1000;
+  } else if (abs >= 0x33000000) {
+    // Subnormal half, in units of 2^-24.
+    const uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+    const int shift = 126 - static_cast<int>(abs >> 23);
+    h = mantissa >> shift;
+    rest = mantissa & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+  } else {
+    // At most half of the smallest subnormal rounds to zero.
+    return sign;
+  }
+  // A carry out of the mantissa correctly moves to the next exponent.
+  if (rest > halfway || (rest == halfway && (h & 1))) {
+    ++h;
+  }
+  return sign | static_cast<uint16_t>(h);
+}
+
+float caffe_half_to_float(const uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  uint32_t f;
+  if (exponent == 0x1f) {
+    // Infinity, or a NaN made quiet.
+    f = sign | 0x7f800000 | (mantissa != 0 ? 0x400000 : 0) | (mantissa << 13);
+  } else if (exponent != 0) {
+    f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    f = sign;
+  } else {
+    // Normalize the subnormal half.
+    exponent = 113;
+    while ((mantissa & 0x400) == 0) {
+      mantissa <<= 1;
+      --exponent;
+    }
+    f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+  float x;
+  memcpy(&x, &f, sizeof(x));
+  return x;
+}
+
+template <>
+void caffe_cpu_float2half<float>(const int n, const float* x, uint16_t* y) {
+  int i = 0;
+#if defined(__F16C__)
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+#endif
+  for (; i < n; ++i) {
+    y[i] = caffe_float_to_half(x[i]);
+  }
+}
+
+template <>
+void caffe_cpu_float2half<double>(const int n, const double* x, uint16_t* y) {
+  // Converts through float, as the F16C instructions do not take doubles.
+  for (int i = 0; i < n; ++i) {
+    y[i] = caffe_float_to_half(static_cast<float>(x[i]));
+  }
+}
+
+template <>
+void caffe_cpu_half2float<float>(const int n, const uint16_t* x, float* y) {
+  int i = 0;
+#if defined(__F16C__)
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_cvtph_ps(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(x + i))));
+  }
+#endif
+  for (; i < n; ++i) {
+    y[i] = caffe_half_to_float(x[i]);
+  }
+}
+
+template <>
+void caffe_cpu_half2float<double>(const int n, const uint16_t* x, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = caffe_half_to_float(x[i]);
+  }
+}
+
+}  // namespace caffe
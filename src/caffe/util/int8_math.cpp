@@ -0,0 +1,188 @@
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/util/int8_math.hpp"
+
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+#define CAFFE_DPBUSD(acc, u, s) _mm256_dpbusd_epi32(acc, u, s)
+#elif defined(__AVXVNNI__)
+#define CAFFE_DPBUSD(acc, u, s) _mm256_dpbusd_avx_epi32(acc, u, s)
+#endif
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_quantize_s8(const int n, const Dtype* x, const Dtype scale,
+    int8_t* y) {
+  for (int i = 0; i < n; ++i) {
+    const Dtype v = std::min(std::max(x[i] * scale, Dtype(-127)), Dtype(127));
+    y[i] = static_cast<int8_t>(v >= 0 ? v + Dtype(0.5) : v - Dtype(0.5));
+  }
+}
+
+template void caffe_cpu_quantize_s8<float>(const int n, const float* x,
+    const float scale, int8_t* y);
+template void caffe_cpu_quantize_s8<double>(const int n, const double* x,
+    const double scale, int8_t* y);
+
+template <typename Dtype>
+void caffe_cpu_quantize_rows_s8(const int rows, const int cols,
+    const Dtype* x, int8_t* y, Dtype* scale) {
+  for (int r = 0; r < rows; ++r) {
+    Dtype max_abs = 0;
+    for (int c = 0; c < cols; ++c) {
+      max_abs = std::max(max_abs, static_cast<Dtype>(std::fabs(x[c])));
+    }
+    scale[r] = max_abs > 0 ? Dtype(127) / max_abs : Dtype(1);
+    caffe_cpu_quantize_s8(cols, x, scale[r], y);
+    x += cols;
+    y += cols;
+  }
+}
+
+template void caffe_cpu_quantize_rows_s8<float>(const int rows,
+    const int cols, const float* x, int8_t* y, float* scale);
+template void caffe_cpu_quantize_rows_s8<double>(const int rows,
+    const int cols, const double* x, int8_t* y, double* scale);
+
+#if defined(__AVX2__)
+static inline int32_t HorizontalSum(__m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+#endif
+
+#if defined(CAFFE_DPBUSD)
+static const int kVectorK = 32;
+#elif defined(__AVX2__)
+static const int kVectorK = 16;
+#else
+static const int kVectorK = 1;
+#endif
+
+// Dot products of a with the R consecutive rows of b, written to c. a_sum is
+// the sum of a over the part of K handled by the VNNI loop, which needs it to
+// undo the offset that makes b unsigned.
+template <int R>
+static inline void DotS8(const int8_t* a, const int8_t* b, const int K,
+    const int32_t a_sum, int32_t* c) {
+  int k = 0;
+#if defined(CAFFE_DPBUSD)
+  __m256i acc[R];
+  for (int r = 0; r < R; ++r) { acc[r] = _mm256_setzero_si256(); }
+  const __m256i offset = _mm256_set1_epi8(-128);
+  for (; k + kVectorK <= K; k += kVectorK) {
+    const __m256i va = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(a + k));
+    for (int r = 0; r < R; ++r) {
+      const __m256i vb = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(b + r * K + k));
+      // b + 128 as unsigned times signed a, summed in groups of four.
+      acc[r] = CAFFE_DPBUSD(acc[r], _mm256_xor_si256(vb, offset), va);
+    }
+  }
+  for (int r = 0; r < R; ++r) {
+    c[r] = HorizontalSum(acc[r]) - 128 * a_sum;
+  }
+#elif defined(__AVX2__)
+  __m256i acc[R];
+  for (int r = 0; r < R; ++r) { acc[r] = _mm256_setzero_si256(); }
+  for (; k + kVectorK <= K; k += kVectorK) {
+    const __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(a + k)));
+    for (int r = 0; r < R; ++r) {
+      const __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(b + r * K + k)));
+      acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(va, vb));
+    }
+  }
+  for (int r = 0; r < R; ++r) {
+    c[r] = HorizontalSum(acc[r]);
+  }
+#else
+  for (int r = 0; r < R; ++r) { c[r] = 0; }
+#endif
+  for (; k < K; ++k) {
+    for (int r = 0; r < R; ++r) {
+      c[r] += static_cast<int32_t>(a[k]) * b[r * K + k];
+    }
+  }
+}
+
+void caffe_cpu_gemm_s8(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C) {
+  const int vector_k = K / kVectorK * kVectorK;
+  std::vector<int32_t> a_sums(M, 0);
+  for (int m = 0; m < M; ++m) {
+    for (int k = 0; k < vector_k; ++k) {
+      a_sums[m] += A[m * K + k];
+    }
+  }
+  // Work on blocks of B rows small enough to stay in cache while all rows
+  // of A pass over them.
+  const int kBlockN = 64;
+  const int num_blocks = (N + kBlockN - 1) / kBlockN;
+  #pragma omp parallel for schedule(static) if (M * N > 1024)
+  for (int t = 0; t < num_blocks * M; ++t) {
+    const int m = t % M;
+    const int n_end = std::min(N, (t / M + 1) * kBlockN);
+    const int8_t* a = A + m * K;
+    int32_t* c = C + m * N;
+    int n = t / M * kBlockN;
+    for (; n + 4 <= n_end; n += 4) {
+      DotS8<4>(a, B + n * K, K, a_sums[m], c + n);
+    }
+    for (; n < n_end; ++n) {
+      DotS8<1>(a, B + n * K, K, a_sums[m], c + n);
+    }
+  }
+}
+
+// Function uses casting from int to unsigned to compare if value of
+// parameter a is greater or equal to zero and lower than value of
+// parameter b, as in im2col.cpp.
+static inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
+  return static_cast<unsigned>(a) < static_cast<unsigned>(b);
+}
+
+void im2row_s8_cpu(const int8_t* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    int8_t* data_row) {
+  const int output_h = (height + 2 * pad_h -
+      (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+      (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int row_size = channels * kernel_h * kernel_w;
+  #pragma omp parallel for if (output_h * row_size > 4096)
+  for (int output_row = 0; output_row < output_h; ++output_row) {
+    int8_t* row = data_row + output_row * output_w * row_size;
+    for (int output_col = 0; output_col < output_w; ++output_col) {
+      for (int channel = 0; channel < channels; ++channel) {
+        const int8_t* image = data_im + channel * height * width;
+        for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+          const int input_row = -pad_h + kernel_row * dilation_h +
+              output_row * stride_h;
+          for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+            const int input_col = -pad_w + kernel_col * dilation_w +
+                output_col * stride_w;
+            *(row++) = is_a_ge_zero_and_a_lt_b(input_row, height) &&
+                is_a_ge_zero_and_a_lt_b(input_col, width) ?
+                image[input_row * width + input_col] : 0;
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace caffe
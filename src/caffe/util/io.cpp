@@ -16,8 +16,10 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <fstream>  // NOLINT(readability/streams)
 #include <map>
 #include <string>
@@ -78,6 +80,26 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+void CommitTempFile(const string& temp_filename, const string& filename) {
+  int fd = open(temp_filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << temp_filename;
+  CHECK_EQ(fsync(fd), 0) << "Couldn't flush " << temp_filename;
+  close(fd);
+  CHECK_EQ(rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Couldn't rename " << temp_filename << " to " << filename;
+}
+
+void WriteProtoToBinaryFileAtomic(const Message& proto,
+    const string& filename) {
+  const string temp_filename = filename + ".tmp";
+  {
+    fstream output(temp_filename.c_str(), ios::out | ios::trunc | ios::binary);
+    CHECK(proto.SerializeToOstream(&output))
+        << "Couldn't write " << temp_filename;
+  }
+  CommitTempFile(temp_filename, filename);
+}
+
 #ifdef USE_OPENCV
 cv::Mat ReadImageToCVMat(const string& filename, const int height,
     const int width, const int min_dim, const int max_dim,
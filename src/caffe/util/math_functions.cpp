@@ -1,9 +1,12 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
+#include <boost/thread.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
+#include "caffe/util/gemm.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 
@@ -14,10 +17,8 @@ void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
     const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
     const float alpha, const float* A, const float* B, const float beta,
     float* C) {
-  int lda = (TransA == CblasNoTrans) ? K : M;
-  int ldb = (TransB == CblasNoTrans) ? N : K;
-  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
-      ldb, beta, C, N);
+  caffe_cpu_gemm_on(caffe_gemm_backend(GemmShape(TransA, TransB, M, N, K)),
+      TransA, TransB, M, N, K, alpha, A, B, beta, C);
 }
 
 template<>
@@ -25,10 +26,38 @@ void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
     const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
     const double alpha, const double* A, const double* B, const double beta,
     double* C) {
-  int lda = (TransA == CblasNoTrans) ? K : M;
-  int ldb = (TransB == CblasNoTrans) ? N : K;
-  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
-      ldb, beta, C, N);
+  caffe_cpu_gemm_on(caffe_gemm_backend(GemmShape(TransA, TransB, M, N, K)),
+      TransA, TransB, M, N, K, alpha, A, B, beta, C);
+}
+
+int caffe_cpu_blas_threads() {
+#if defined(USE_MKL)
+  return mkl_get_max_threads();
+#elif defined(USE_OPENBLAS)
+  return openblas_get_num_threads();
+#elif defined(__APPLE__)
+  // vecLib threads internally with no way to ask how far.
+  return std::max(1u, boost::thread::hardware_concurrency());
+#else
+  return 1;
+#endif
+}
+
+bool caffe_cpu_blas_has_local_threads() {
+#ifdef USE_MKL
+  return true;
+#else
+  return false;
+#endif
+}
+
+int caffe_set_cpu_blas_threads_local(const int threads) {
+#ifdef USE_MKL
+  return mkl_set_num_threads_local(threads);
+#else
+  LOG(FATAL) << "The BLAS has no per-thread limit on its threads.";
+  return 0;
+#endif
 }
 
 template <>
@@ -0,0 +1,350 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/rbox_data_cache.hpp"
+
+namespace caffe {
+
+using boost::weak_ptr;
+
+map<string, weak_ptr<RBoxDataCache> > RBoxDataCache::caches_;
+static boost::mutex caches_mutex_;
+
+static const char kCacheMagic[8] = {'R', 'B', 'O', 'X', 'C', 'A', 'C', 'H'};
+static const uint64_t kCacheVersion = 2;
+
+// Decodes one serialized AnnotatedDatumR into HWC pixels and rbox rows.
+static void DecodeRecord(const string& value, const bool force_color,
+    const bool force_gray, vector<uint8_t>* pixels,
+    RBoxDataCache::Record* record, vector<float>* rows) {
+  AnnotatedDatumR anno_datum;
+  CHECK(anno_datum.ParseFromString(value));
+  const Datum& datum = anno_datum.datum();
+  if (datum.encoded()) {
+#ifdef USE_OPENCV
+    cv::Mat cv_img;
+    if (force_color || force_gray) {
+      cv_img = DecodeDatumToCVMat(datum, force_color);
+    } else {
+      cv_img = DecodeDatumToCVMatNative(datum);
+    }
+    CHECK(cv_img.data) << "Could not decode datum.";
+    CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
+    record->channels = cv_img.channels();
+    record->height = cv_img.rows;
+    record->width = cv_img.cols;
+    const size_t row_bytes = cv_img.cols * cv_img.channels();
+    pixels->resize(row_bytes * cv_img.rows);
+    for (int h = 0; h < cv_img.rows; ++h) {
+      memcpy(&(*pixels)[h * row_bytes], cv_img.ptr<uchar>(h), row_bytes);
+    }
+#else
+    LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+  } else {
+    const string& data = datum.data();
+    const int channels = datum.channels();
+    const int height = datum.height();
+    const int width = datum.width();
+    CHECK_EQ(data.size(), channels * height * width)
+        << "The decoded cache only supports uint8 data.";
+    record->channels = channels;
+    record->height = height;
+    record->width = width;
+    pixels->resize(data.size());
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < height; ++h) {
+        for (int w = 0; w < width; ++w) {
+          (*pixels)[(h * width + w) * channels + c] =
+              static_cast<uint8_t>(data[(c * height + h) * width + w]);
+        }
+      }
+    }
+  }
+  rows->clear();
+  for (int g = 0; g < anno_datum.annotation_group_size(); ++g) {
+    const AnnotationGroupR& anno_group = anno_datum.annotation_group(g);
+    for (int a = 0; a < anno_group.annotation_size(); ++a) {
+      const NormalizedRBox& rbox = anno_group.annotation(a).rbox();
+      rows->push_back(anno_group.group_label());
+      rows->push_back(rbox.xcenter());
+      rows->push_back(rbox.ycenter());
+      rows->push_back(rbox.angle());
+      rows->push_back(rbox.width());
+      rows->push_back(rbox.height());
+    }
+  }
+  record->num_rboxes = rows->size() / RBoxDataCache::kRBoxRowSize;
+}
+
+// FNV-1a hash of a string.
+static uint64_t HashString(const string& str) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < str.size(); ++i) {
+    hash = (hash ^ static_cast<uint8_t>(str[i])) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+RBoxDataCache::RBoxDataCache()
+    : arena_(NULL), arena_size_(0), arena_capacity_(0), file_backed_(false),
+      header_(NULL), records_(NULL), rboxes_(NULL), images_(NULL) {
+}
+
+RBoxDataCache::~RBoxDataCache() {
+  if (arena_ != NULL) {
+    munmap(arena_, arena_capacity_);
+  }
+}
+
+shared_ptr<RBoxDataCache> RBoxDataCache::Get(const DataParameter& data_param,
+    const TransformationParameter& transform_param,
+    const string& cache_file) {
+  CHECK(!(transform_param.force_color() && transform_param.force_gray()))
+      << "cannot set both force_color and force_gray";
+  boost::mutex::scoped_lock lock(caches_mutex_);
+  std::ostringstream key;
+  key << data_param.source() << ":" << cache_file << ":"
+      << transform_param.force_color() << transform_param.force_gray();
+  shared_ptr<RBoxDataCache> cache = caches_[key.str()].lock();
+  if (cache) {
+    return cache;
+  }
+  Header identity;
+  Identify(data_param, transform_param, &identity);
+  cache.reset(new RBoxDataCache());
+  if (!cache_file.empty() && cache->Map(cache_file, identity)) {
+    LOG(INFO) << "Mapped " << cache->size() << " decoded records ("
+        << (cache->bytes() >> 20) << " MB) from " << cache_file;
+  } else {
+    cache->Build(data_param, identity);
+    LOG(INFO) << "Decoded " << cache->size() << " records ("
+        << (cache->bytes() >> 20) << " MB) of " << data_param.source();
+    if (!cache_file.empty()) {
+      cache->Write(cache_file);
+    }
+  }
+  caches_[key.str()] = weak_ptr<RBoxDataCache>(cache);
+  return cache;
+}
+
+void RBoxDataCache::Identify(const DataParameter& data_param,
+    const TransformationParameter& transform_param, Header* header) {
+  memset(header, 0, sizeof(Header));
+  memcpy(header->magic, kCacheMagic, sizeof(kCacheMagic));
+  header->version = kCacheVersion;
+  header->source_hash = HashString(data_param.source());
+  header->force_color = transform_param.force_color();
+  header->force_gray = transform_param.force_gray();
+  // Only the files holding the records count: the lock files, logs and
+  // manifests of a DB change whenever it is opened.
+  namespace fs = boost::filesystem;
+  const fs::path source(data_param.source());
+  vector<fs::path> files;
+  if (!fs::is_directory(source)) {
+    files.push_back(source);
+  } else if (data_param.backend() == DataParameter_DB_LMDB) {
+    files.push_back(source / "data.mdb");
+  } else {
+    for (fs::directory_iterator it(source), end; it != end; ++it) {
+      const string extension = it->path().extension().string();
+      if (extension == ".ldb" || extension == ".sst") {
+        files.push_back(it->path());
+      }
+    }
+  }
+  for (int i = 0; i < files.size(); ++i) {
+    if (fs::exists(files[i])) {
+      header->source_bytes += fs::file_size(files[i]);
+      header->source_mtime = std::max<int64_t>(header->source_mtime,
+          fs::last_write_time(files[i]));
+    }
+  }
+}
+
+void RBoxDataCache::Build(const DataParameter& data_param,
+    const Header& identity) {
+  shared_ptr<db::DB> db(db::GetDB(data_param.backend()));
+  db->Open(data_param.source(), db::READ);
+  shared_ptr<db::Cursor> cursor(db->NewCursor());
+
+  // Records are decoded in parallel chunks, and the images of each chunk
+  // are appended to the arena before the next chunk is decoded. Only the
+  // records and rboxes, which are small, are kept aside until the end.
+  const int kChunkSize = 256;
+  vector<Record> records;
+  vector<float> rows;
+  size_t image_bytes = 0;
+  vector<string> values;
+  vector<vector<uint8_t> > images(kChunkSize);
+  vector<vector<float> > chunk_rows(kChunkSize);
+  Reserve(ImageAreaOffset() + (64 << 20));
+  while (cursor->valid()) {
+    values.clear();
+    for (; cursor->valid() && values.size() < kChunkSize; cursor->Next()) {
+      values.push_back(cursor->value());
+    }
+    const int begin = records.size();
+    const int chunk = values.size();
+    records.resize(begin + chunk);
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < chunk; ++i) {
+      DecodeRecord(values[i], identity.force_color, identity.force_gray,
+          &images[i], &records[begin + i], &chunk_rows[i]);
+    }
+    for (int i = 0; i < chunk; ++i) {
+      const size_t offset = ImageAreaOffset() + image_bytes;
+      Reserve(offset + images[i].size());
+      if (!images[i].empty()) {
+        memcpy(arena_ + offset, &images[i][0], images[i].size());
+      }
+      records[begin + i].image_offset = image_bytes;
+      records[begin + i].rbox_offset = rows.size() / kRBoxRowSize;
+      image_bytes += images[i].size();
+      rows.insert(rows.end(), chunk_rows[i].begin(), chunk_rows[i].end());
+    }
+  }
+  CHECK(!records.empty()) << "Empty source " << data_param.source();
+
+  Header header = identity;
+  header.num_records = records.size();
+  header.num_rboxes = rows.size() / kRBoxRowSize;
+  header.image_bytes = image_bytes;
+  arena_size_ = ArenaSize(header);
+  Reserve(arena_size_);
+  header_ = reinterpret_cast<Header*>(arena_);
+  *header_ = header;
+  SetPointers();
+  memcpy(records_, &records[0], sizeof(Record) * records.size());
+  if (!rows.empty()) {
+    memcpy(rboxes_, &rows[0], sizeof(float) * rows.size());
+  }
+}
+
+void RBoxDataCache::Reserve(size_t size) {
+  if (size <= arena_capacity_) {
+    return;
+  }
+  const size_t capacity = std::max(size, 2 * arena_capacity_);
+  void* arena;
+  if (arena_ == NULL) {
+    arena = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  } else {
+#ifdef MREMAP_MAYMOVE
+    // Moves the pages rather than copying them.
+    arena = mremap(arena_, arena_capacity_, capacity, MREMAP_MAYMOVE);
+#else
+    arena = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena != MAP_FAILED) {
+      memcpy(arena, arena_, arena_capacity_);
+      munmap(arena_, arena_capacity_);
+    }
+#endif
+  }
+  CHECK(arena != MAP_FAILED) << "Cannot allocate " << (capacity >> 20)
+      << " MB for the decoded cache";
+  arena_ = static_cast<char*>(arena);
+  arena_capacity_ = capacity;
+#ifdef MADV_HUGEPAGE
+  // Back the arena with huge pages where available to reduce TLB misses.
+  madvise(arena_, arena_capacity_, MADV_HUGEPAGE);
+#endif
+}
+
+size_t RBoxDataCache::ImageAreaOffset() {
+  return (sizeof(Header) + 63) / 64 * 64;
+}
+
+size_t RBoxDataCache::RecordAreaOffset(size_t image_bytes) {
+  return (ImageAreaOffset() + image_bytes + 63) / 64 * 64;
+}
+
+size_t RBoxDataCache::ArenaSize(const Header& header) {
+  return RecordAreaOffset(header.image_bytes)
+      + sizeof(Record) * header.num_records
+      + sizeof(float) * kRBoxRowSize * header.num_rboxes;
+}
+
+void RBoxDataCache::SetPointers() {
+  images_ = reinterpret_cast<uint8_t*>(arena_ + ImageAreaOffset());
+  records_ = reinterpret_cast<Record*>(arena_ +
+      RecordAreaOffset(header_->image_bytes));
+  rboxes_ = reinterpret_cast<float*>(records_ + header_->num_records);
+}
+
+bool RBoxDataCache::Map(const string& filename, const Header& identity) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Cannot stat " << filename;
+  if (st.st_size < sizeof(Header)) {
+    LOG(WARNING) << "Ignoring truncated cache file " << filename;
+    close(fd);
+    return false;
+  }
+  void* arena = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(arena != MAP_FAILED) << "Cannot map " << filename;
+  const Header* header = static_cast<const Header*>(arena);
+  if (memcmp(header->magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+      header->version != kCacheVersion ||
+      ArenaSize(*header) != st.st_size) {
+    LOG(WARNING) << "Ignoring incompatible cache file " << filename;
+    munmap(arena, st.st_size);
+    return false;
+  }
+  if (header->source_hash != identity.source_hash ||
+      header->source_bytes != identity.source_bytes ||
+      header->source_mtime != identity.source_mtime ||
+      header->force_color != identity.force_color ||
+      header->force_gray != identity.force_gray) {
+    LOG(WARNING) << "Ignoring cache file " << filename
+        << " of another source, or decoded with other options";
+    munmap(arena, st.st_size);
+    return false;
+  }
+  arena_ = static_cast<char*>(arena);
+  arena_size_ = st.st_size;
+  arena_capacity_ = st.st_size;
+  file_backed_ = true;
+  header_ = reinterpret_cast<Header*>(arena_);
+  SetPointers();
+  madvise(arena_, arena_size_, MADV_WILLNEED);
+  return true;
+}
+
+void RBoxDataCache::Write(const string& filename) const {
+  // Write to a temporary file first so that an interrupted run or a crash
+  // never leaves a truncated cache behind.
+  const string tmp_filename = filename + ".tmp";
+  std::ofstream file(tmp_filename.c_str(), std::ios::out | std::ios::binary);
+  CHECK(file.good()) << "Cannot write " << tmp_filename;
+  file.write(arena_, arena_size_);
+  file.close();
+  CHECK(!file.fail()) << "Failed writing " << tmp_filename;
+  CommitTempFile(tmp_filename, filename);
+  LOG(INFO) << "Wrote decoded cache to " << filename;
+}
+
+}  // namespace caffe
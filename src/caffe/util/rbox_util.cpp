@@ -8,7 +8,6 @@
 #include <utility>
 #include <vector>
 #include <math.h>
-#include <omp.h>
 
 #include "boost/iterator/counting_iterator.hpp"
 
@@ -923,6 +922,45 @@ Dtype JaccardOverlapR(const Dtype* rbox1, const Dtype* rbox2)
 template float JaccardOverlapR(const float* rbox1, const float* rbox2);
 template double JaccardOverlapR(const double* rbox1, const double* rbox2);
 
+void JaccardOverlapRRBatch(const vector<NormalizedRBox>& rboxes1,
+	const vector<NormalizedRBox>& rboxes2, vector<float>* overlaps)
+{
+	const int num1 = rboxes1.size();
+	const int num2 = rboxes2.size();
+	overlaps->assign(num1 * num2, 0.);
+	if (num1 == 0 || num2 == 0)
+	{
+		return;
+	}
+	vector<float> radius2(num2);
+	for (int j = 0; j < num2; ++j)
+	{
+		radius2[j] = 0.5 * sqrt(rboxes2[j].width() * rboxes2[j].width() +
+			rboxes2[j].height() * rboxes2[j].height());
+	}
+	float* overlap_data = &(*overlaps)[0];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if (num1 * num2 > 256)
+#endif
+	for (int i = 0; i < num1; ++i)
+	{
+		const NormalizedRBox& rbox1 = rboxes1[i];
+		const float radius1 = 0.5 * sqrt(rbox1.width() * rbox1.width() +
+			rbox1.height() * rbox1.height());
+		for (int j = 0; j < num2; ++j)
+		{
+			const float dx = rboxes2[j].xcenter() - rbox1.xcenter();
+			const float dy = rboxes2[j].ycenter() - rbox1.ycenter();
+			const float reach = radius1 + radius2[j];
+			if (dx * dx + dy * dy >= reach * reach)
+			{
+				continue;
+			}
+			overlap_data[i * num2 + j] = JaccardOverlapRR(rbox1, rboxes2[j]);
+		}
+	}
+}
+
 void MatchRBox(const vector<NormalizedRBox>& gt_rboxes,
 	const vector<NormalizedRBox>& pred_rboxes, const int label,
 	const MatchType match_type, const float overlap_threshold,
@@ -2016,7 +2054,6 @@ void DecodeRBoxesAll(const vector<LabelRBox>& all_loc_preds,
 	CHECK_EQ(all_loc_preds.size(), num);
 	all_decode_rboxes->clear();
 	all_decode_rboxes->resize(num);
-	omp_set_num_threads(16);
 	#pragma omp parallel for
 	for (int i = 0; i < num; ++i) {
 		// Decode predictions into rboxes.
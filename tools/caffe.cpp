@@ -13,6 +13,7 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/gemm.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -48,6 +49,30 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_bool(fuse_layers, false,
+    "Optional; fold BatchNorm, Scale and ReLU layers into the preceding "
+    "convolutions before testing.");
+DEFINE_bool(share_memory, false,
+    "Optional; let activations with disjoint lifetimes share memory "
+    "when testing.");
+DEFINE_bool(half_params, false,
+    "Optional; keep the weights in half precision when testing on CPU.");
+DEFINE_bool(half_activations, false,
+    "Optional; keep the activations between the layers that support it in "
+    "half precision when testing on CPU.");
+DEFINE_int32(cpu_threads, 0,
+    "Optional; the number of threads of the CPU layers. By default the "
+    "OpenMP default: OMP_NUM_THREADS, or else the number of cores.");
+DEFINE_int32(cpu_workers, 1,
+    "Optional; train on the CPU with this many workers in data parallel, "
+    "each on batches of its own. The effective training batch size is "
+    "multiplied by the number of workers.");
+DEFINE_string(gemm_backend, "BLAS",
+    "Optional; the GEMM backend: BLAS for the linked BLAS library, or "
+    "PACKED for the built-in blocked GEMM.");
+DEFINE_string(gemm_backends_file, "",
+    "Optional; the GEMM backend of every GEMM shape, as written by "
+    "gemm_benchmark. Shapes not in the file use -gemm_backend.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -207,9 +232,13 @@ int train() {
 
   vector<int> gpus;
   get_gpus(&gpus);
+  CHECK_GE(FLAGS_cpu_workers, 1) << "Need at least one CPU worker.";
+  CHECK(gpus.size() == 0 || FLAGS_cpu_workers == 1)
+      << "cpu_workers can not be combined with GPUs.";
   if (gpus.size() == 0) {
-    LOG(INFO) << "Use CPU.";
+    LOG(INFO) << "Use CPU with " << Caffe::cpu_threads() << " threads.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_solver_count(FLAGS_cpu_workers);
   } else {
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
@@ -249,6 +278,9 @@ int train() {
   if (gpus.size() > 1) {
     caffe::P2PSync<float> sync(solver, NULL, solver->param());
     sync.Run(gpus);
+  } else if (FLAGS_cpu_workers > 1) {
+    caffe::CPUSync<float> sync(solver);
+    sync.Run(FLAGS_cpu_workers);
   } else {
     LOG(INFO) << "Starting Optimization";
     solver->Solve();
@@ -278,12 +310,24 @@ int test() {
     Caffe::SetDevice(gpus[0]);
     Caffe::set_mode(Caffe::GPU);
   } else {
-    LOG(INFO) << "Use CPU.";
+    LOG(INFO) << "Use CPU with " << Caffe::cpu_threads() << " threads.";
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
   caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  if (FLAGS_fuse_layers) {
+    LOG(INFO) << "Fused " << caffe_net.FuseLayersForInference() << " layers.";
+  }
+  if (FLAGS_half_params) {
+    caffe_net.StoreParamsInHalf();
+  }
+  if (FLAGS_half_activations) {
+    caffe_net.StoreActivationsInHalf();
+  }
+  if (FLAGS_share_memory) {
+    caffe_net.ShareActivationMemory();
+  }
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
   vector<int> test_score_output_id;
@@ -346,7 +390,7 @@ int time() {
     Caffe::SetDevice(gpus[0]);
     Caffe::set_mode(Caffe::GPU);
   } else {
-    LOG(INFO) << "Use CPU.";
+    LOG(INFO) << "Use CPU with " << Caffe::cpu_threads() << " threads.";
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
@@ -439,6 +483,16 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_cpu_threads > 0) {
+    Caffe::set_cpu_threads(FLAGS_cpu_threads);
+  }
+  caffe::GemmBackend gemm_backend;
+  CHECK(caffe::GemmBackendFromName(FLAGS_gemm_backend, &gemm_backend))
+      << "Unknown GEMM backend " << FLAGS_gemm_backend;
+  caffe::caffe_set_gemm_backend(gemm_backend);
+  if (FLAGS_gemm_backends_file.size()) {
+    caffe::ReadGemmBackendsFromFile(FLAGS_gemm_backends_file);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
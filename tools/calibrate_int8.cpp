@@ -0,0 +1,221 @@
+// Calibrates a trained net for INT8 inference on CPU. Runs sample batches
+// through the float net to find the range of the input of every Convolution
+// and InnerProduct layer, writes a copy of the model with a
+// quantization_param for each of them, and then runs the INT8 net on the same
+// batches to report how much its outputs differ: the mAP for the outputs of
+// (R)DetectionEvaluate layers, and the mean value for any other output.
+//
+// Usage:
+//    calibrate_int8 --model=test.prototxt --weights=net.caffemodel
+//        --output=test_int8.prototxt [FLAGS]
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::make_pair;
+using std::pair;
+
+DEFINE_string(model, "", "The TEST model definition to calibrate.");
+DEFINE_string(weights, "", "The trained weights.");
+DEFINE_string(output, "", "Where to write the calibrated model definition.");
+DEFINE_int32(iterations, 50, "Number of batches to calibrate and compare on.");
+DEFINE_string(skip, "", "Optional; comma separated names of layers to keep "
+    "in floating point, e.g. the first convolution.");
+DEFINE_string(ap_version, "Integral",
+    "The AP version of detection outputs: 11point, MaxIntegral or Integral.");
+
+// The outputs of a net accumulated over batches.
+struct OutputStats {
+  // Sum over the batches of the mean of every output.
+  vector<double> sum;
+  // Detections of the (R)DetectionEvaluate outputs, by output and label.
+  map<int, map<int, vector<pair<float, int> > > > true_pos;
+  map<int, map<int, vector<pair<float, int> > > > false_pos;
+  map<int, map<int, int> > num_pos;
+};
+
+static bool IsQuantizable(const string& type) {
+  return type == "Convolution" || type == "InnerProduct";
+}
+
+// Output indices of the net produced by detection evaluation layers.
+static set<int> DetectionOutputs(const Net<float>& net) {
+  set<int> outputs;
+  for (int i = 0; i < net.layers().size(); ++i) {
+    const string type = net.layers()[i]->type();
+    if (type != "DetectionEvaluate" && type != "RDetectionEvaluate") {
+      continue;
+    }
+    for (int j = 0; j < net.output_blobs().size(); ++j) {
+      const vector<Blob<float>*>& tops = net.top_vecs()[i];
+      if (std::find(tops.begin(), tops.end(), net.output_blobs()[j])
+          != tops.end()) {
+        outputs.insert(j);
+      }
+    }
+  }
+  return outputs;
+}
+
+// Runs the net for FLAGS_iterations batches, accumulating its outputs and,
+// if bottom_max is not NULL, the largest absolute input of every
+// quantizable layer.
+static void Run(Net<float>* net, OutputStats* stats,
+    map<string, float>* bottom_max) {
+  const set<int> detection_outputs = DetectionOutputs(*net);
+  const int num_layers = net->layers().size();
+  stats->sum.assign(net->output_blobs().size(), 0);
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    for (int i = 0; i < num_layers; ++i) {
+      if (bottom_max != NULL && IsQuantizable(net->layers()[i]->type())) {
+        const Blob<float>* bottom = net->bottom_vecs()[i][0];
+        const float* data = bottom->cpu_data();
+        float& max_abs = (*bottom_max)[net->layer_names()[i]];
+        for (int k = 0; k < bottom->count(); ++k) {
+          max_abs = std::max(max_abs, std::fabs(data[k]));
+        }
+      }
+      net->ForwardFromTo(i, i);
+    }
+    for (int j = 0; j < net->output_blobs().size(); ++j) {
+      const Blob<float>* output = net->output_blobs()[j];
+      const float* data = output->cpu_data();
+      if (detection_outputs.count(j) == 0) {
+        stats->sum[j] +=
+            std::accumulate(data, data + output->count(), 0.) /
+            output->count();
+        continue;
+      }
+      // Rows of [item_id, label, score, tp, fp], where item_id -1 holds the
+      // number of positives of the label, as in Solver::TestDetection.
+      CHECK_EQ(output->width(), 5);
+      for (int k = 0; k < output->height(); ++k) {
+        const float* row = data + k * 5;
+        const int label = static_cast<int>(row[1]);
+        if (static_cast<int>(row[0]) == -1) {
+          stats->num_pos[j][label] += static_cast<int>(row[2]);
+        } else if (row[3] != 0 || row[4] != 0) {
+          stats->true_pos[j][label].push_back(
+              make_pair(row[2], static_cast<int>(row[3])));
+          stats->false_pos[j][label].push_back(
+              make_pair(row[2], static_cast<int>(row[4])));
+        }
+      }
+    }
+  }
+}
+
+// The mAP of a detection output, or the mean of any other output.
+static float Score(OutputStats* stats, const int j) {
+  if (stats->num_pos.find(j) == stats->num_pos.end()) {
+    return stats->sum[j] / FLAGS_iterations;
+  }
+  const map<int, int>& num_pos = stats->num_pos[j];
+  float mAP = 0;
+  for (map<int, int>::const_iterator it = num_pos.begin();
+       it != num_pos.end(); ++it) {
+    vector<float> prec, rec;
+    float ap = 0;
+    ComputeAP(stats->true_pos[j][it->first], it->second,
+        stats->false_pos[j][it->first], FLAGS_ap_version, &prec, &rec, &ap);
+    mAP += ap;
+  }
+  return num_pos.empty() ? 0 : mAP / num_pos.size();
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::SetUsageMessage("Calibrate a net for INT8 inference on CPU.\n"
+      "Usage:\n"
+      "    calibrate_int8 --model=test.prototxt --weights=net.caffemodel \\\n"
+      "        --output=test_int8.prototxt [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_model.empty() || FLAGS_weights.empty() || FLAGS_output.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/calibrate_int8");
+    return 1;
+  }
+  Caffe::set_mode(Caffe::CPU);
+
+  NetParameter model_param;
+  ReadNetParamsFromTextFileOrDie(FLAGS_model, &model_param);
+  NetParameter net_param(model_param);
+  net_param.mutable_state()->set_phase(TEST);
+  vector<string> skip;
+  if (!FLAGS_skip.empty()) {
+    boost::split(skip, FLAGS_skip, boost::is_any_of(","));
+  }
+
+  // Calibrate, keeping the float scores of the same batches.
+  map<string, float> bottom_max;
+  OutputStats float_stats;
+  vector<string> output_names;
+  {
+    Net<float> net(net_param);
+    net.CopyTrainedLayersFrom(FLAGS_weights);
+    Run(&net, &float_stats, &bottom_max);
+    for (int j = 0; j < net.output_blob_indices().size(); ++j) {
+      output_names.push_back(net.blob_names()[net.output_blob_indices()[j]]);
+    }
+  }
+
+  int num_quantized = 0;
+  for (int i = 0; i < model_param.layer_size(); ++i) {
+    LayerParameter* layer_param = model_param.mutable_layer(i);
+    map<string, float>::const_iterator it =
+        bottom_max.find(layer_param->name());
+    if (it == bottom_max.end() || it->second <= 0 ||
+        std::find(skip.begin(), skip.end(), layer_param->name())
+        != skip.end()) {
+      continue;
+    }
+    layer_param->mutable_quantization_param()->set_bottom_max(it->second);
+    LOG(INFO) << "Layer " << layer_param->name() << ": bottom_max "
+        << it->second;
+    ++num_quantized;
+  }
+  WriteProtoToTextFile(model_param, FLAGS_output);
+  LOG(INFO) << "Quantized " << num_quantized << " layers into "
+      << FLAGS_output;
+
+  // Compare with the INT8 net on the same batches; the data readers of the
+  // float net are gone, so the sources are read from the start again.
+  net_param = model_param;
+  net_param.mutable_state()->set_phase(TEST);
+  OutputStats int8_stats;
+  {
+    Net<float> net(net_param);
+    net.CopyTrainedLayersFrom(FLAGS_weights);
+    Run(&net, &int8_stats, NULL);
+  }
+  for (int j = 0; j < output_names.size(); ++j) {
+    const float float_score = Score(&float_stats, j);
+    const float int8_score = Score(&int8_stats, j);
+    LOG(INFO) << output_names[j]
+        << (float_stats.num_pos.count(j) ? " mAP" : " mean") << ": float "
+        << float_score << ", int8 " << int8_score << " (delta "
+        << int8_score - float_score << ")";
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+// Times the CPU forward pass of one convolution under the CAFFE and WINOGRAD
+// engines on random data and checks that both produce the same output.
+//
+// Usage:
+//    conv_engine_benchmark [FLAGS]
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(num, 1, "Number of images in the input batch.");
+DEFINE_int32(channels, 64, "Number of input channels.");
+DEFINE_int32(height, 150, "Height of the input.");
+DEFINE_int32(width, 150, "Width of the input.");
+DEFINE_int32(num_output, 64, "Number of output channels.");
+DEFINE_int32(kernel_size, 3, "Kernel size.");
+DEFINE_int32(pad, 1, "Padding.");
+DEFINE_int32(iterations, 20, "Number of timed forward passes per engine.");
+
+static double TimeForward(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top) {
+  layer->Forward(bottom, top);  // warm up
+  Timer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    layer->Forward(bottom, top);
+  }
+  return timer.MilliSeconds() / FLAGS_iterations;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::SetUsageMessage("Compare the CAFFE and WINOGRAD convolution "
+      "engines on CPU.\n"
+      "Usage:\n"
+      "    conv_engine_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  Caffe::set_mode(Caffe::CPU);
+
+  LayerParameter param;
+  param.set_name("conv");
+  param.set_type("Convolution");
+  ConvolutionParameter* conv_param = param.mutable_convolution_param();
+  conv_param->set_num_output(FLAGS_num_output);
+  conv_param->add_kernel_size(FLAGS_kernel_size);
+  conv_param->add_pad(FLAGS_pad);
+  conv_param->mutable_weight_filler()->set_type("gaussian");
+  conv_param->mutable_weight_filler()->set_std(0.01);
+
+  Blob<float> bottom(FLAGS_num, FLAGS_channels, FLAGS_height, FLAGS_width);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<float>*> bottom_vec(1, &bottom);
+
+  const ConvolutionParameter_Engine engines[] = {
+      ConvolutionParameter_Engine_CAFFE, ConvolutionParameter_Engine_WINOGRAD};
+  Blob<float> tops[2];
+  shared_ptr<Layer<float> > layers[2];
+  for (int e = 0; e < 2; ++e) {
+    conv_param->set_engine(engines[e]);
+    layers[e] = LayerRegistry<float>::CreateLayer(param);
+    vector<Blob<float>*> top_vec(1, &tops[e]);
+    layers[e]->SetUp(bottom_vec, top_vec);
+    if (e > 0) {
+      for (int i = 0; i < layers[e]->blobs().size(); ++i) {
+        layers[e]->blobs()[i]->CopyFrom(*layers[0]->blobs()[i]);
+      }
+    }
+    const double ms = TimeForward(layers[e].get(), bottom_vec, top_vec);
+    LOG(INFO) << ConvolutionParameter_Engine_Name(engines[e]) << ": " << ms
+        << " ms per forward pass";
+  }
+  float max_diff = 0;
+  for (int i = 0; i < tops[0].count(); ++i) {
+    max_diff = std::max(max_diff,
+        std::fabs(tops[0].cpu_data()[i] - tops[1].cpu_data()[i]));
+  }
+  LOG(INFO) << "Max absolute difference: " << max_diff;
+  return 0;
+}
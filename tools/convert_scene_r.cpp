@@ -0,0 +1,374 @@
+// This program cuts large annotated scenes into overlapping square tiles at
+// one or more ground resolutions and stores them to a lmdb/leveldb as
+// AnnotatedDatumR proto buffers, ready to be consumed by AnnotatedRData.
+// Usage:
+//   convert_scene_r [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME
+//
+// where ROOTFOLDER is the root folder that holds all the scenes and their
+// .rbox annotations, and LISTFILE should be a list of scenes with their
+// annotation files, e.g.
+//   scenes/scene1.tif scenes/scene1.tif.rbox
+//   ....
+// Each line of a .rbox file describes one object in scene pixels (the format
+// written by SelectRotatedTarget.m):
+//   xcenter ycenter width height label angle
+//
+// For every output resolution in --resolution_out the scene is resampled by
+// resolution_in / resolution_out and cut into tile_size x tile_size tiles,
+// stepping by tile_step * tile_size (as done in examples/rbox/deploy). Tiles on
+// the right/bottom border are zero padded. Every rbox is re-projected into
+// tile coordinates and kept only if at least --min_visible of its area falls
+// inside the tile. Tiles are cut and encoded in parallel; records are written
+// in a deterministic order.
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#endif  // USE_OPENCV
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/rng.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::pair;
+using std::string;
+using std::vector;
+using boost::scoped_ptr;
+
+DEFINE_bool(gray, false,
+    "When this option is on, treat images as grayscale ones");
+DEFINE_bool(shuffle, false,
+    "Randomly shuffle the order of the scenes");
+DEFINE_string(backend, "lmdb",
+    "The backend {lmdb, leveldb} for storing the result");
+DEFINE_int32(tile_size, 300, "Width and height of the output tiles");
+DEFINE_double(tile_step, 0.65,
+    "Stride between neighbouring tiles as a fraction of tile_size");
+DEFINE_double(resolution_in, 0.23, "Ground resolution of the input scenes");
+DEFINE_string(resolution_out, "0.23",
+    "Comma separated list of ground resolutions to cut tiles at");
+DEFINE_double(min_visible, 0.5,
+    "Minimum fraction of an rbox area that must lie inside a tile to keep it");
+DEFINE_bool(skip_empty, false,
+    "When this option is on, tiles without any rbox are not stored");
+DEFINE_int32(tile_batch, 256,
+    "Number of tiles cut in parallel before they are written to the db");
+DEFINE_string(encode_type, "jpg",
+    "Encode tiles as ('png','jpg',...); empty stores raw pixels.");
+
+#ifdef USE_OPENCV
+namespace {
+
+struct SceneRBox {
+  float xcenter, ycenter, width, height, angle;
+  int label;
+};
+
+struct Tile {
+  int scene_id;
+  float resolution;
+  int x, y;  // top-left corner in the resampled scene.
+};
+
+bool ReadSceneRBoxes(const string& filename, vector<SceneRBox>* rboxes) {
+  rboxes->clear();
+  std::ifstream infile(filename.c_str());
+  if (!infile.good()) {
+    return false;
+  }
+  SceneRBox r;
+  while (infile >> r.xcenter >> r.ycenter >> r.width >> r.height
+         >> r.label >> r.angle) {
+    rboxes->push_back(r);
+  }
+  return true;
+}
+
+// Corners of an rbox, following the rotation convention of OverlapArea() in
+// rbox_util.cpp (angle in degrees, image y axis pointing down).
+void RBoxCorners(const SceneRBox& r, float* px, float* py) {
+  const float theta = -r.angle * static_cast<float>(M_PI) / 180.f;
+  const float c = cosf(theta), s = sinf(theta);
+  const float hw = r.width / 2, hh = r.height / 2;
+  const float u[4] = {hw, -hw, -hw, hw};
+  const float v[4] = {hh, hh, -hh, -hh};
+  for (int i = 0; i < 4; ++i) {
+    px[i] = r.xcenter + c * u[i] - s * v[i];
+    py[i] = r.ycenter + s * u[i] + c * v[i];
+  }
+}
+
+// Clip a convex polygon against one axis-aligned half plane:
+// keep points with sign * (coord - bound) <= 0.
+void ClipHalfPlane(const vector<pair<float, float> >& in, bool use_x,
+    float bound, float sign, vector<pair<float, float> >* out) {
+  out->clear();
+  const int n = in.size();
+  for (int i = 0; i < n; ++i) {
+    const pair<float, float>& a = in[i];
+    const pair<float, float>& b = in[(i + 1) % n];
+    const float da = sign * ((use_x ? a.first : a.second) - bound);
+    const float db = sign * ((use_x ? b.first : b.second) - bound);
+    if (da <= 0) {
+      out->push_back(a);
+    }
+    if ((da < 0 && db > 0) || (da > 0 && db < 0)) {
+      const float t = da / (da - db);
+      out->push_back(std::make_pair(a.first + t * (b.first - a.first),
+                                    a.second + t * (b.second - a.second)));
+    }
+  }
+}
+
+float PolygonArea(const vector<pair<float, float> >& poly) {
+  float area = 0;
+  const int n = poly.size();
+  for (int i = 0; i < n; ++i) {
+    const pair<float, float>& a = poly[i];
+    const pair<float, float>& b = poly[(i + 1) % n];
+    area += a.first * b.second - b.first * a.second;
+  }
+  return std::fabs(area) / 2;
+}
+
+// Fraction of the rbox area inside [0, size) x [0, size).
+float VisibleFraction(const SceneRBox& r, const float size) {
+  const float full = r.width * r.height;
+  if (full <= 0) {
+    return 0;
+  }
+  float px[4], py[4];
+  RBoxCorners(r, px, py);
+  vector<pair<float, float> > poly, clipped;
+  for (int i = 0; i < 4; ++i) {
+    poly.push_back(std::make_pair(px[i], py[i]));
+  }
+  ClipHalfPlane(poly, true, 0, -1, &clipped);
+  ClipHalfPlane(clipped, true, size, 1, &poly);
+  ClipHalfPlane(poly, false, 0, -1, &clipped);
+  ClipHalfPlane(clipped, false, size, 1, &poly);
+  if (poly.size() < 3) {
+    return 0;
+  }
+  return std::min(PolygonArea(poly) / full, 1.f);
+}
+
+// Re-project scene rboxes into the tile frame and store the visible ones.
+int AnnotateTile(const vector<SceneRBox>& scene_rboxes, const float scale,
+    const Tile& tile, const int tile_size, const float min_visible,
+    AnnotatedDatumR* anno_datum) {
+  anno_datum->clear_annotation_group();
+  int num_rboxes = 0;
+  for (int i = 0; i < scene_rboxes.size(); ++i) {
+    SceneRBox r = scene_rboxes[i];
+    r.xcenter = r.xcenter * scale - tile.x;
+    r.ycenter = r.ycenter * scale - tile.y;
+    r.width *= scale;
+    r.height *= scale;
+    if (VisibleFraction(r, tile_size) < min_visible) {
+      continue;
+    }
+    AnnotationGroupR* anno_group = NULL;
+    for (int g = 0; g < anno_datum->annotation_group_size(); ++g) {
+      if (anno_datum->annotation_group(g).group_label() == r.label) {
+        anno_group = anno_datum->mutable_annotation_group(g);
+        break;
+      }
+    }
+    if (anno_group == NULL) {
+      anno_group = anno_datum->add_annotation_group();
+      anno_group->set_group_label(r.label);
+    }
+    AnnotationR* anno = anno_group->add_annotation();
+    anno->set_instance_id(anno_group->annotation_size() - 1);
+    NormalizedRBox* rbox = anno->mutable_rbox();
+    rbox->set_xcenter(r.xcenter / tile_size);
+    rbox->set_ycenter(r.ycenter / tile_size);
+    rbox->set_width(r.width / tile_size);
+    rbox->set_height(r.height / tile_size);
+    rbox->set_angle(r.angle);
+    rbox->set_label(r.label);
+    ++num_rboxes;
+  }
+  return num_rboxes;
+}
+
+}  // namespace
+#endif  // USE_OPENCV
+
+int main(int argc, char** argv) {
+#ifdef USE_OPENCV
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Cut annotated scenes into rbox tiles stored in "
+        "the leveldb/lmdb format used as input for Caffe.\n"
+        "Usage:\n"
+        "    convert_scene_r [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 4) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/convert_scene_r");
+    return 1;
+  }
+
+  const bool is_color = !FLAGS_gray;
+  const int tile_size = FLAGS_tile_size;
+  const int tile_stride = std::max<int>(1, round(FLAGS_tile_step * tile_size));
+  const string encode_type = FLAGS_encode_type;
+  CHECK_GT(tile_size, 0);
+  CHECK_GT(FLAGS_tile_batch, 0);
+  CHECK_GT(FLAGS_resolution_in, 0);
+
+  vector<float> resolutions;
+  std::stringstream res_stream(FLAGS_resolution_out);
+  string res_str;
+  while (std::getline(res_stream, res_str, ',')) {
+    resolutions.push_back(atof(res_str.c_str()));
+    CHECK_GT(resolutions.back(), 0) << "Invalid resolution " << res_str;
+  }
+  CHECK(!resolutions.empty()) << "No output resolution given.";
+
+  std::ifstream infile(argv[2]);
+  vector<pair<string, string> > lines;
+  string filename, labelname;
+  while (infile >> filename >> labelname) {
+    lines.push_back(std::make_pair(filename, labelname));
+  }
+  if (FLAGS_shuffle) {
+    // randomly shuffle data
+    LOG(INFO) << "Shuffling data";
+    shuffle(lines.begin(), lines.end());
+  }
+  LOG(INFO) << "A total of " << lines.size() << " scenes.";
+
+  // Create new DB
+  scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
+  db->Open(argv[3], db::NEW);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+
+  const string root_folder(argv[1]);
+  int count = 0;
+  int num_rboxes_total = 0;
+  for (int line_id = 0; line_id < lines.size(); ++line_id) {
+    filename = root_folder + lines[line_id].first;
+    cv::Mat scene = ReadImageToCVMat(filename, is_color);
+    if (!scene.data) {
+      LOG(WARNING) << "Failed to read " << lines[line_id].first;
+      continue;
+    }
+    vector<SceneRBox> scene_rboxes;
+    if (!ReadSceneRBoxes(root_folder + lines[line_id].second,
+                         &scene_rboxes)) {
+      LOG(WARNING) << "Failed to read " << lines[line_id].second;
+      continue;
+    }
+    for (int r = 0; r < resolutions.size(); ++r) {
+      const float scale = FLAGS_resolution_in / resolutions[r];
+      const int width = round(scene.cols * scale);
+      const int height = round(scene.rows * scale);
+      if (width <= 0 || height <= 0) {
+        continue;
+      }
+      cv::Mat resampled;
+      if (width == scene.cols && height == scene.rows) {
+        resampled = scene;
+      } else {
+        cv::resize(scene, resampled, cv::Size(width, height), 0, 0,
+                   scale < 1 ? cv::INTER_AREA : cv::INTER_LINEAR);
+      }
+      vector<Tile> tiles;
+      for (int y = 0; y < height; y += tile_stride) {
+        for (int x = 0; x < width; x += tile_stride) {
+          Tile tile;
+          tile.scene_id = line_id;
+          tile.resolution = resolutions[r];
+          tile.x = x;
+          tile.y = y;
+          tiles.push_back(tile);
+          if (x + tile_size >= width) break;
+        }
+        if (y + tile_size >= height) break;
+      }
+      // Cut, annotate and serialize tiles in parallel, then write them in
+      // order so that the db content does not depend on the thread count.
+      for (int begin = 0; begin < tiles.size(); begin += FLAGS_tile_batch) {
+        const int end = std::min<int>(begin + FLAGS_tile_batch, tiles.size());
+        vector<string> values(end - begin);
+        vector<int> tile_rboxes(end - begin, 0);
+        #pragma omp parallel for schedule(dynamic)
+        for (int t = begin; t < end; ++t) {
+          const Tile& tile = tiles[t];
+          AnnotatedDatumR anno_datum;
+          anno_datum.set_type(AnnotatedDatumR_AnnotationType_RBOX);
+          tile_rboxes[t - begin] = AnnotateTile(scene_rboxes, scale, tile,
+              tile_size, FLAGS_min_visible, &anno_datum);
+          if (FLAGS_skip_empty && tile_rboxes[t - begin] == 0) {
+            continue;
+          }
+          cv::Mat cv_tile = cv::Mat::zeros(tile_size, tile_size,
+                                           resampled.type());
+          const int w = std::min(tile_size, width - tile.x);
+          const int h = std::min(tile_size, height - tile.y);
+          resampled(cv::Rect(tile.x, tile.y, w, h)).copyTo(
+              cv_tile(cv::Rect(0, 0, w, h)));
+          Datum* datum = anno_datum.mutable_datum();
+          if (encode_type.size()) {
+            EncodeCVMatToDatum(cv_tile, encode_type, datum);
+          } else {
+            CVMatToDatum(cv_tile, datum);
+          }
+          datum->set_label(-1);
+          CHECK(anno_datum.SerializeToString(&values[t - begin]));
+        }
+        for (int t = begin; t < end; ++t) {
+          if (values[t - begin].empty()) {
+            continue;
+          }
+          std::ostringstream key;
+          key << caffe::format_int(count, 8) << "_" << lines[line_id].first
+              << "_" << tiles[t].resolution << "_" << tiles[t].x << "_"
+              << tiles[t].y;
+          txn->Put(key.str(), values[t - begin]);
+          num_rboxes_total += tile_rboxes[t - begin];
+          if (++count % 1000 == 0) {
+            // Commit db
+            txn->Commit();
+            txn.reset(db->NewTransaction());
+            LOG(INFO) << "Processed " << count << " tiles.";
+          }
+        }
+      }
+    }
+  }
+  // write the last batch
+  if (count % 1000 != 0) {
+    txn->Commit();
+  }
+  LOG(INFO) << "Processed " << count << " tiles with " << num_rboxes_total
+      << " rboxes.";
+#else
+  LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+  return 0;
+}
@@ -0,0 +1,119 @@
+// Times the GEMM shapes that a net runs on every GEMM backend, and writes
+// the fastest backend of every shape to a file that caffe reads with
+// -gemm_backends_file.
+//
+// Usage:
+//    gemm_benchmark --model=deploy.prototxt [--output=gemm_backends.txt]
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/gemm.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::map;
+
+DEFINE_string(model, "", "The model definition whose GEMMs to time.");
+DEFINE_string(phase, "TEST", "TEST times the forward GEMMs; TRAIN also "
+    "times the backward ones.");
+DEFINE_string(output, "", "Optional; where to write the fastest backends.");
+DEFINE_int32(iterations, 10, "Number of timed GEMMs per shape and backend.");
+
+// Average time in ms of a GEMM of the shape on the backend.
+static double TimeGemm(const GemmBackend backend, const GemmShape& shape) {
+  Blob<float> a(1, 1, shape.M, shape.K);
+  Blob<float> b(1, 1, shape.K, shape.N);
+  Blob<float> c(1, 1, shape.M, shape.N);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&a);
+  filler.Fill(&b);
+  const CBLAS_TRANSPOSE trans_a = shape.trans_a ? CblasTrans : CblasNoTrans;
+  const CBLAS_TRANSPOSE trans_b = shape.trans_b ? CblasTrans : CblasNoTrans;
+  caffe_cpu_gemm_on<float>(backend, trans_a, trans_b, shape.M, shape.N,
+      shape.K, 1., a.cpu_data(), b.cpu_data(), 0., c.mutable_cpu_data());
+  Timer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    caffe_cpu_gemm_on<float>(backend, trans_a, trans_b, shape.M, shape.N,
+        shape.K, 1., a.cpu_data(), b.cpu_data(), 0., c.mutable_cpu_data());
+  }
+  return timer.MilliSeconds() / FLAGS_iterations;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::SetUsageMessage("Find the fastest GEMM backend for the GEMMs of "
+      "a net.\n"
+      "Usage:\n"
+      "    gemm_benchmark --model=deploy.prototxt [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_model.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/gemm_benchmark");
+    return 1;
+  }
+  CHECK(FLAGS_phase == "TEST" || FLAGS_phase == "TRAIN")
+      << "phase must be TEST or TRAIN.";
+  Caffe::set_mode(Caffe::CPU);
+
+  // Record the GEMMs of one pass through the net.
+  Net<float> net(FLAGS_model, FLAGS_phase == "TRAIN" ? TRAIN : TEST);
+  map<GemmShape, int> calls;
+  caffe_record_gemm_shapes(&calls);
+  net.Forward();
+  if (FLAGS_phase == "TRAIN") {
+    net.Backward();
+  }
+  caffe_record_gemm_shapes(NULL);
+  LOG(INFO) << "The net runs " << calls.size() << " GEMM shapes.";
+
+  map<GemmShape, GemmBackend> fastest;
+  vector<double> total_ms(kNumGemmBackends, 0);
+  double fastest_ms = 0;
+  for (map<GemmShape, int>::const_iterator it = calls.begin();
+       it != calls.end(); ++it) {
+    const GemmShape& shape = it->first;
+    std::ostringstream line;
+    line << (shape.trans_a ? "T" : "N") << (shape.trans_b ? "T" : "N")
+        << " M " << shape.M << " N " << shape.N << " K " << shape.K
+        << " x" << it->second << ":";
+    double best_ms = 0;
+    for (int b = 0; b < kNumGemmBackends; ++b) {
+      const GemmBackend backend = static_cast<GemmBackend>(b);
+      const double ms = TimeGemm(backend, shape);
+      total_ms[b] += ms * it->second;
+      if (b == 0 || ms < best_ms) {
+        best_ms = ms;
+        fastest[shape] = backend;
+      }
+      line << " " << GemmBackendName(backend) << " " << ms << " ms";
+    }
+    fastest_ms += best_ms * it->second;
+    LOG(INFO) << line.str() << " -> " << GemmBackendName(fastest[shape]);
+  }
+  for (int b = 0; b < kNumGemmBackends; ++b) {
+    LOG(INFO) << "GEMM time per pass with "
+        << GemmBackendName(static_cast<GemmBackend>(b)) << ": "
+        << total_ms[b] << " ms";
+  }
+  LOG(INFO) << "GEMM time per pass with the fastest backends: " << fastest_ms
+      << " ms";
+  if (!FLAGS_output.empty()) {
+    WriteGemmBackendsToFile(FLAGS_output, fastest);
+    LOG(INFO) << "Wrote the fastest backends to " << FLAGS_output;
+  }
+  return 0;
+}
@@ -1,7 +1,115 @@
-#include "caffe/caffe.hpp"
+// Times the CPU forward pass of a net with different numbers of threads and
+// reports the time of every layer and its speedup over the first count.
+//
+// Usage:
+//    net_speed_benchmark --model=deploy.prototxt [--threads=1,4] [FLAGS]
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "boost/lexical_cast.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "", "The model definition to time.");
+DEFINE_string(weights, "", "Optional; the trained weights.");
+DEFINE_string(threads, "", "Comma separated thread counts to time the net "
+    "with; by default 1 and the OpenMP default.");
+DEFINE_int32(iterations, 10, "Number of timed forward passes per count.");
+
+// Average forward time in ms of every layer, and of the whole net last.
+static vector<double> TimeForward(Net<float>* net) {
+  const int num_layers = net->layers().size();
+  net->Forward();  // warm up
+  vector<double> ms(num_layers + 1, 0);
+  Timer timer;
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    for (int i = 0; i < num_layers; ++i) {
+      timer.Start();
+      net->ForwardFromTo(i, i);
+      const double layer_ms = timer.MilliSeconds();
+      ms[i] += layer_ms;
+      ms[num_layers] += layer_ms;
+    }
+  }
+  for (int i = 0; i <= num_layers; ++i) {
+    ms[i] /= FLAGS_iterations;
+  }
+  return ms;
+}
 
 int main(int argc, char** argv) {
-  LOG(FATAL) << "Deprecated. Use caffe time --model=... "
-             "[--iterations=50] [--gpu] [--device_id=0]";
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::SetUsageMessage("Time the CPU forward pass of a net with "
+      "different numbers of threads.\n"
+      "Usage:\n"
+      "    net_speed_benchmark --model=deploy.prototxt [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_model.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/net_speed_benchmark");
+    return 1;
+  }
+  Caffe::set_mode(Caffe::CPU);
+  vector<int> threads;
+  if (FLAGS_threads.empty()) {
+    threads.push_back(1);
+    threads.push_back(Caffe::cpu_threads());
+  } else {
+    vector<string> counts;
+    boost::split(counts, FLAGS_threads, boost::is_any_of(","));
+    for (int i = 0; i < counts.size(); ++i) {
+      threads.push_back(boost::lexical_cast<int>(counts[i]));
+    }
+  }
+
+  Net<float> net(FLAGS_model, TEST);
+  if (!FLAGS_weights.empty()) {
+    net.CopyTrainedLayersFrom(FLAGS_weights);
+  }
+  // Give the inputs random values, as Input layers leave them zero.
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  for (int i = 0; i < net.layers().size(); ++i) {
+    if (net.bottom_vecs()[i].empty()) {
+      for (int j = 0; j < net.top_vecs()[i].size(); ++j) {
+        filler.Fill(net.top_vecs()[i][j]);
+      }
+    }
+  }
+
+  vector<vector<double> > ms(threads.size());
+  for (int t = 0; t < threads.size(); ++t) {
+    Caffe::set_cpu_threads(threads[t]);
+    ms[t] = TimeForward(&net);
+    LOG(INFO) << threads[t] << " threads: " << ms[t].back()
+        << " ms per forward pass";
+  }
+  const int num_layers = net.layers().size();
+  for (int i = 0; i <= num_layers; ++i) {
+    std::ostringstream line;
+    line << (i < num_layers ? net.layer_names()[i] + " (" +
+             net.layers()[i]->type() + ")" : string("total")) << ":";
+    for (int t = 0; t < threads.size(); ++t) {
+      line << " " << ms[t][i] << " ms";
+      if (t > 0 && ms[t][i] > 0) {
+        line << " (x" << ms[0][i] / ms[t][i] << ")";
+      }
+    }
+    LOG(INFO) << line.str();
+  }
   return 0;
 }